@@ -0,0 +1,356 @@
+/*===========================================================================*
+ ActionRules.cpp :
+ The built in action rules, reading rule files, and compiling the lot
+ into the table makeTransaction() looks rows up in.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "ActionRules.h"
+
+#include <string.h>
+#include <utility>
+
+#include "HeaderMap.h"
+#include "MappedFile.h"
+#include "PerfectHash.h"
+#include "QifFormat.h"
+#include "Stats.h"
+
+/*---------------------------------------------------------------------------*
+ What main() used to hard code: Before-Tax buys (or sells) with a transfer
+ from cash, withdrawals sell to cash, and everything else is a Buy or a
+ SellX with no transfer.
+ *---------------------------------------------------------------------------*/
+static const char BUILTIN_RULES[] =
+    ACTIVITY_BEFORE_TAX " = + " ACTION_BUYX  " T " CASH_TSFR_ACCT "\n"
+    ACTIVITY_BEFORE_TAX " = - " ACTION_SELLX " T " CASH_TSFR_ACCT "\n"
+    ACTIVITY_WITHDRAWLS " = + " ACTION_BUY   " T " CASH_TSFR_ACCT "\n"
+    ACTIVITY_WITHDRAWLS " = - " ACTION_SELLX " T " CASH_TSFR_ACCT "\n"
+    "*"                 " = + " ACTION_BUY                        "\n"
+    "*"                 " = - " ACTION_SELLX                      "\n";
+
+static bool isBlank( char c )
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static std::string ruleError( const std::string & source
+                            , int                 lineNumber
+                            , const std::string & why
+                            )
+{
+    return std::string( "ERROR: Action rules...\n" )
+         + source
+         + "\n...line "
+         + std::to_string( lineNumber )
+         + ": "
+         + why
+         + "\n";
+}
+
+// The --stats counter for an action, if it has one.
+static int statCounterFor( const std::string & action )
+{
+    if (action == ACTION_BUYX)  return STAT_ACTION_BUYX;
+    if (action == ACTION_BUY)   return STAT_ACTION_BUY;
+    if (action == ACTION_SELLX) return STAT_ACTION_SELLX;
+    return -1;
+}
+
+ActionRules::ActionRules()
+{
+    std::string error;
+
+    add( BUILTIN_RULES, sizeof( BUILTIN_RULES ) - 1, "(built in)", error );
+}
+
+bool ActionRules::add( const char        * text
+                     , size_t              len
+                     , const std::string & source
+                     , std::string       & error
+                     )
+{
+    const char *       p          = text;
+    const char *       end        = text + len;
+    int                lineNumber = 0;
+    std::vector<Entry> added;
+
+    // Notepad likes to start UTF-8 files with a byte order mark.
+    if (  end - p >= 3
+       && memcmp( p, "\xEF\xBB\xBF", 3 ) == 0
+       )
+    {
+        p += 3;
+    }
+
+    for (; p < end; p++)
+    {
+        const char * eol = (const char *)memchr( p, '\n', (size_t)( end - p ) );
+        const char * lineEnd;
+
+        eol     = eol ? eol : end;
+        lineEnd = eol;
+        lineNumber++;
+
+        while (p < lineEnd && isBlank( *p ))               p++;
+        while (lineEnd > p && isBlank( lineEnd[-1] ))      lineEnd--;
+
+        if (  p == lineEnd
+           || *p == '#'
+           )
+        {
+            p = eol;
+            continue;
+        }
+
+        // <activity type> = <sign> <action> [T <transfer account>]; the
+        // activity type may itself contain an '=', so split at the last one.
+        const char * equals = lineEnd;
+        while (equals > p && equals[-1] != '=')
+        {
+            equals--;
+        }
+        if (equals == p)
+        {
+            error = ruleError( source, lineNumber, "expected <activity type> = <sign> <action>" );
+            return false;
+        }
+
+        const char * nameEnd = equals - 1;
+        const char * sign    = equals;
+        while (nameEnd > p && isBlank( nameEnd[-1] ))      nameEnd--;
+        while (sign < lineEnd && isBlank( *sign ))         sign++;
+
+        if (nameEnd == p)
+        {
+            error = ruleError( source, lineNumber, "no activity type" );
+            return false;
+        }
+        if (  sign == lineEnd
+           || strchr( "+-*", *sign ) == nullptr
+           || sign + 1 == lineEnd
+           || !isBlank( sign[1] )
+           )
+        {
+            error = ruleError( source, lineNumber, "sign should be one of +-* followed by an action" );
+            return false;
+        }
+
+        const char * action    = sign + 1;
+        const char * actionEnd;
+        while (action < lineEnd && isBlank( *action ))     action++;
+        actionEnd = action;
+        while (actionEnd < lineEnd && !isBlank( *actionEnd )) actionEnd++;
+
+        const char * option = actionEnd;
+        while (option < lineEnd && isBlank( *option ))     option++;
+
+        Entry entry;
+        entry.activity.assign( p, nameEnd );
+        entry.positive = *sign != '-';
+        entry.negative = *sign != '+';
+        entry.action  .assign( action, actionEnd );
+
+        if (option < lineEnd)
+        {
+            const char * account = option + 1;
+            while (account < lineEnd && isBlank( *account )) account++;
+
+            if (  ( *option != 'T' && *option != 't' )
+               || option + 1 == lineEnd
+               || !isBlank( option[1] )
+               || account == lineEnd
+               )
+            {
+                error = ruleError( source, lineNumber, "expected T <transfer account> after the action" );
+                return false;
+            }
+            entry.txfrAcct.assign( account, lineEnd );
+        }
+
+        added.push_back( std::move( entry ) );
+        p = eol;
+    } // for each line
+
+    size_t had = m_entries.size();
+
+    m_entries.insert( m_entries.end()
+                    , std::make_move_iterator( added.begin() )
+                    , std::make_move_iterator( added.end() )
+                    );
+    if (!compile( error ))
+    {
+        error = std::string( "ERROR: Action rules...\n" )
+              + source
+              + "\n..." + error + "\n";
+
+        // The table points into the entries, which may have moved.
+        m_entries.resize( had );
+        std::string ignored;
+        compile( ignored );
+        return false;
+    }
+    return true;
+
+} // ActionRules::add()
+
+/*---------------------------------------------------------------------------*
+ compile() :
+ Build the table from the entries, later ones overriding earlier ones for
+ the same activity type and sign.  An activity type with a rule for only
+ one sign goes by the * rule for the other.  Nothing changes unless it
+ works.
+ *---------------------------------------------------------------------------*/
+bool ActionRules::compile( std::string & error )
+{
+    static const ActionRule UNSET = { nullptr, 0, nullptr, 0, -1 };
+
+    std::vector<std::string> names;
+    std::vector<ActionRule>  table( 2, UNSET );
+
+    for (const Entry & entry : m_entries)
+    {
+        size_t id = 0;
+
+        if (entry.activity != "*")
+        {
+            while (  id < names.size()
+                  && !equalsNoCase( names[id].c_str(), entry.activity.c_str() )
+                  )
+            {
+                id++;
+            }
+            if (id == names.size())
+            {
+                names.push_back( entry.activity );
+                table.resize( table.size() + 2, UNSET );
+            }
+            id++;
+        }
+
+        ActionRule rule = { entry.action.c_str()
+                          , entry.action.size()
+                          , entry.txfrAcct.empty() ? nullptr : entry.txfrAcct.c_str()
+                          , entry.txfrAcct.size()
+                          , statCounterFor( entry.action )
+                          };
+
+        if (entry.positive) table[2 * id]     = rule;
+        if (entry.negative) table[2 * id + 1] = rule;
+    } // for each entry
+
+    if (  table[0].action == nullptr
+       || table[1].action == nullptr
+       )
+    {
+        error = "there's no * rule for both signs";
+        return false;
+    }
+    for (size_t i = 2; i < table.size(); i++)
+    {
+        if (table[i].action == nullptr)
+        {
+            table[i] = table[i & 1];
+        }
+    }
+
+    size_t                count = names.size();
+    std::vector<uint64_t> hashes( count );
+    std::vector<uint32_t> displacement( count > 0 ? bucketsFor( count ) : 0 );
+    std::vector<int32_t>  slot        ( count > 0 ? slotsFor  ( count ) : 0 );
+
+    for (size_t i = 0; i < count; i++)
+    {
+        hashes[i] = foldedHash( names[i].c_str(), names[i].size() );
+    }
+    if (  count > 0
+       && !buildPerfectHash( hashes.data()
+                           , count
+                           , displacement.data()
+                           , displacement.size()
+                           , slot.data()
+                           , slot.size()
+                           )
+       )
+    {
+        error = "has activity types that can't be told apart";
+        return false;
+    }
+
+    m_names        = std::move( names );
+    m_displacement = std::move( displacement );
+    m_slot         = std::move( slot );
+    m_table        = std::move( table );
+    return true;
+
+} // ActionRules::compile()
+
+int32_t ActionRules::activityID( const FieldView & activity ) const
+{
+    if (  activity.escaped
+       || m_slot.empty()
+       )
+    {
+        return 0;
+    }
+
+    int32_t i = perfectHashSlot( foldedHash( activity.ptr, activity.len )
+                               , m_displacement.data()
+                               , m_displacement.size()
+                               , m_slot.data()
+                               , m_slot.size()
+                               );
+
+    if (  i >= 0
+       && nameIs( activity.ptr, activity.len, m_names[i].c_str() )
+       )
+    {
+        return i + 1;
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*
+ The rules, built in and loaded.  Written once by loadActionRules() before
+ any conversion starts, read only after that.
+ *---------------------------------------------------------------------------*/
+static ActionRules actionRules;
+static bool        rulesLoaded = false;
+
+const ActionRule & findActionRule( const FieldView & activity
+                                 , bool              negative
+                                 )
+{
+    return actionRules.find( activity, negative );
+}
+
+bool loadActionRules( const char  * filename
+                    , std::string & error
+                    )
+{
+    if (rulesLoaded)
+    {
+        error = std::string( "ERROR: Only one rule file can be loaded...\n" )
+              + filename
+              + "\n...is one too many\n";
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open( filename ))
+    {
+        error = std::string( "ERROR: Action rules...\n" )
+              + filename
+              + "\n...not found\n";
+        return false;
+    }
+
+    if (!actionRules.add( file.data(), file.size(), filename, error ))
+    {
+        return false;
+    }
+    rulesLoaded = true;
+    return true;
+
+} // loadActionRules()
@@ -0,0 +1,118 @@
+/*===========================================================================*
+ ActionRules.h :
+ What a row's activity type makes of it: the QIF action to derive, and
+ whether it needs a transfer to or from a cash account.
+
+ The rules are text, one per line, in the built in set (ActionRules.cpp)
+ or a rule file loaded with -r:
+
+     # <activity type> = <sign> <action> [T <transfer account>]
+     Before-Tax      = + BuyX  T Cash
+     Before-Tax      = - SellX T Cash
+     Dividend        = + ReinvDiv
+     *               = - SellX
+
+ sign is + (the amount is zero or more), - (less than zero) or * (either).
+ T <transfer account> adds an L line for the account and a $ line with
+ the amount; without it there's no transfer.  Activity types are matched
+ case insensitively, and * is every activity type no rule names.  A rule
+ file's rules replace the built in ones for the same activity type and
+ sign and leave the rest alone.
+
+ Once loaded the rules are compiled into a dense table, two entries (+
+ and -) per interned activity type, with entry 0 for *.  The activity
+ types themselves go in a perfect hash (see PerfectHash.h), so finding a
+ row's rule is one hash lookup and one index, however many rules there
+ are.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "CsvReader.h"
+
+/*---------------------------------------------------------------------------*
+ ActionRule :
+ What to derive for one activity type and sign.  The text stays put for
+ as long as the ActionRules it came from.
+ *---------------------------------------------------------------------------*/
+struct ActionRule
+{
+    const char * action;
+    size_t       actionLen;
+    const char * txfrAcct;          // nullptr if there's no transfer
+    size_t       txfrAcctLen;
+    int          statCounter;       // a StatCounter, or -1
+};
+
+class ActionRules
+{
+public:
+    // Just the built in rules.
+    ActionRules();
+
+    // Add the rules in text (a rule file's contents; source names it in
+    // errors) over the ones there are.  On failure error says why and
+    // nothing has changed.
+    bool add( const char        * text
+            , size_t              len
+            , const std::string & source
+            , std::string       & error
+            );
+
+    // The rule for a row with this activity type, and a negative amount
+    // or not.  An activity type with "" pairs in it never matches a rule.
+    const ActionRule & find( const FieldView & activity
+                           , bool              negative
+                           ) const
+    {
+        return m_table[2 * (size_t)activityID( activity ) + ( negative ? 1 : 0 )];
+    }
+
+    // The activity type's interned ID: 1 up for ones a rule names, 0 for
+    // the rest.
+    int32_t activityID( const FieldView & activity ) const;
+
+    // How many activity types have rules of their own.
+    size_t  activityCount() const { return m_names.size(); }
+
+private:
+    ActionRules           ( const ActionRules & );    // not copyable
+    ActionRules & operator=( const ActionRules & );
+
+    struct Entry
+    {
+        std::string activity;           // "*" for every other one
+        bool        positive;
+        bool        negative;
+        std::string action;
+        std::string txfrAcct;           // empty if there's no transfer
+    };
+
+    bool compile( std::string & error );
+
+    std::vector<Entry>       m_entries;         // in the order they were added
+    std::vector<std::string> m_names;           // activity ID - 1 to its name
+    std::vector<uint32_t>    m_displacement;
+    std::vector<int32_t>     m_slot;
+    std::vector<ActionRule>  m_table;           // 2 x activity ID + negative
+
+}; // class ActionRules
+
+// The rule makeTransaction() goes by: the built in rules, and over them
+// the rule file, if one's been loaded.
+const ActionRule & findActionRule( const FieldView & activity
+                                 , bool              negative
+                                 );
+
+// Load the rule file in filename over the built in rules.  Only one can be
+// loaded, and it has to happen before anything converts.  On failure error
+// says why.
+bool loadActionRules( const char  * filename
+                    , std::string & error
+                    );
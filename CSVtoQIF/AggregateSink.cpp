@@ -0,0 +1,378 @@
+/*===========================================================================*
+ AggregateSink.cpp :
+ Merging a day's rows for the same fund and kind of transaction.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "AggregateSink.h"
+
+#include <string.h>
+
+#include "CsvReader.h"
+
+static Decimal Transaction::* const NUMBERS[3] = { &Transaction::amount,     &Transaction::price,     &Transaction::units     };
+static bool    Transaction::* const HAS    [3] = { &Transaction::hasAmount,  &Transaction::hasPrice,  &Transaction::hasUnits  };
+static char  ( Transaction::* const STORAGE[3] )[DECIMAL_STR_LEN]
+                                               = { &Transaction::amountText, &Transaction::priceText, &Transaction::unitsText };
+static const int                    SCALE  [3] = { AMOUNT_SCALE,             PRICE_SCALE,             QUANTITY_SCALE          };
+
+// NUMBERS[i]'s line is TRANSACTION_TEXTS[TEXT_AMOUNT_LINE + i].
+const int AMOUNT = 0;
+const int PRICE  = 1;
+const int UNITS  = 2;
+
+// What rows have to share to be merged, besides the date.
+static const TransactionText KEY_TEXTS[] = { TEXT_SECURITY, TEXT_ACTION, TEXT_TXFR_ACCT, TEXT_COMMISSION, TEXT_CLEARED };
+
+#define MEMO_SEPARATOR         ", "
+
+static inline bool sameView( const FieldView & a
+                           , const FieldView & b
+                           )
+{
+    return a.ptr     == b.ptr
+        && a.len     == b.len
+        && a.escaped == b.escaped;
+}
+
+void AggregateSink::Held::hold( const FieldView & field )
+{
+    text.assign( field.ptr, field.len );
+    escaped = field.escaped;
+}
+
+FieldView AggregateSink::Held::view() const
+{
+    FieldView field = { text.data(), text.size(), escaped };
+    return field;
+}
+
+AggregateSink::AggregateSink( TransactionSink & next
+                            , ConvertStats    * stats
+                            )
+    : m_next        ( next )
+    , m_stats       ( stats != nullptr ? stats : &m_noStats )
+    , m_mark        ( 0 )
+    , m_dateLate    ( false )
+    , m_used        ( 0 )
+    , m_rows        ( 0 )
+    , m_transactions( 0 )
+    , m_late        ( 0 )
+{
+}
+
+void AggregateSink::begin( const HeaderMap & header )
+{
+    m_next.begin( header );
+}
+
+/*---------------------------------------------------------------------------*
+ mergeable() :
+ Can t be added up with others?  Not without a date or numbers to add,
+ and not if it has a commission or transfer amount of its own that would
+ need adding up too.
+ *---------------------------------------------------------------------------*/
+bool AggregateSink::mergeable( const Transaction & t ) const
+{
+    if (  t.date.len == 0
+       || !t.hasAmount
+       || !t.hasUnits
+       )
+    {
+        return false;
+    }
+    if (  t.txfrAmount.len > 0
+       && !sameView( t.txfrAmount, t.amountLine )
+       )
+    {
+        return false;
+    }
+    if (t.commission.len > 0)
+    {
+        Decimal commission;
+        if (  parseDecimal( t.commission.ptr, t.commission.len, AMOUNT_SCALE, commission ) != DECIMAL_OK
+           || commission.value != 0
+           )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AggregateSink::transaction( const Transaction & t )
+{
+    STATS_RESTART( *m_stats, m_mark );
+    STATS_COUNT( *m_stats, STAT_AGGREGATE_IN );
+    m_rows++;
+
+    // A new date; the last one's done with.
+    if (  t.date.len != m_date.size()
+       || memcmp( t.date.ptr, m_date.data(), t.date.len ) != 0
+       )
+    {
+        flush();
+        m_date.assign( t.date.ptr, t.date.len );
+        m_dateLate = m_written.count( m_date ) > 0;
+    }
+    if (m_dateLate)
+    {
+        m_late++;
+    }
+
+    m_key.clear();
+    if (mergeable( t ))
+    {
+        for (TransactionText text : KEY_TEXTS)
+        {
+            const FieldView & field = t.*TRANSACTION_TEXTS[text];
+            uint32_t          len   = (uint32_t)field.len;
+
+            m_key.append( (const char *)&len, sizeof( len ) );
+            m_key += field.escaped ? '\1' : '\0';
+            m_key.append( field.ptr, field.len );
+        }
+        m_key += t.securityPrefix;
+    }
+    else
+    {
+        // A group of its own.
+        m_key = '\2' + std::to_string( m_rows );
+    }
+
+    std::unordered_map<std::string, size_t>::const_iterator found = m_index.find( m_key );
+    if (found != m_index.end())
+    {
+        add( m_groups[found->second], t );
+    }
+    else
+    {
+        if (m_used == m_groups.size())
+        {
+            m_groups.emplace_back();
+        }
+        start( m_groups[m_used], t );
+        m_index.emplace( m_key, m_used++ );
+    }
+    STATS_LAP( *m_stats, STAT_AGGREGATE, m_mark );
+
+} // AggregateSink::transaction()
+
+void AggregateSink::start( Group             & group
+                         , const Transaction & t
+                         )
+{
+    group.rows           = 1;
+    group.securityPrefix = t.securityPrefix;
+    group.samePrice      = true;
+
+    for (size_t i = 0; i < TEXT_COUNT; i++)
+    {
+        group.texts[i].hold( t.*TRANSACTION_TEXTS[i] );
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        group.numbers[i] = t.*NUMBERS[i];
+        group.has[i]     = t.*HAS[i];
+    }
+
+    // Lines that show a field follow it, so a merged field shows merged.
+    group.lines.resize( t.lineCount );
+    for (size_t i = 0; i < t.lineCount; i++)
+    {
+        const TransactionLine & line  = t.lines[i];
+        Shape                 & shape = group.lines[i];
+
+        shape.fieldID  = line.fieldID;
+        shape.prefixed = line.prefixLen > 0;
+        shape.field    = -1;
+        for (size_t field = 0; field < TEXT_COUNT; field++)
+        {
+            if (sameView( t.*TRANSACTION_TEXTS[field], line.text ))
+            {
+                shape.field = (int)field;
+                break;
+            }
+        }
+        if (shape.field < 0)
+        {
+            shape.text.hold( line.text );
+        }
+    }
+
+    group.memos.clear();
+    if (t.memo.len > 0)
+    {
+        m_memo.resize( t.memo.len );
+        m_memo.resize( csvUnescape( t.memo, &m_memo[0] ) );
+        group.memos.push_back( m_memo );
+    }
+
+} // AggregateSink::start()
+
+void AggregateSink::add( Group             & group
+                       , const Transaction & t
+                       )
+{
+    group.rows++;
+
+    for (int i = 0; i < 3; i++)
+    {
+        const Decimal & d   = t.*NUMBERS[i];
+        Decimal       & sum = group.numbers[i];
+
+        if (i == PRICE)
+        {
+            group.samePrice = group.samePrice
+                           && t.hasPrice
+                           && d.value == sum.value;
+        }
+        else
+        {
+            sum.value += d.value;
+            sum.plain  = true;
+        }
+        if (d.digits > sum.digits)
+        {
+            sum.digits = d.digits;
+        }
+    }
+
+    if (t.memo.len > 0)
+    {
+        m_memo.resize( t.memo.len );
+        m_memo.resize( csvUnescape( t.memo, &m_memo[0] ) );
+
+        bool seen = false;
+        for (const std::string & memo : group.memos)
+        {
+            seen = seen || memo == m_memo;
+        }
+        if (!seen)
+        {
+            group.memos.push_back( m_memo );
+        }
+    }
+
+} // AggregateSink::add()
+
+/*---------------------------------------------------------------------------*
+ emit() :
+ The group as one Transaction, to the next sink.  One row goes on as it
+ was; more get the sums, a price from them if the rows' prices differed,
+ and every memo.
+ *---------------------------------------------------------------------------*/
+void AggregateSink::emit( Group & group )
+{
+    Transaction & t = m_out;
+
+    for (size_t i = 0; i < TEXT_COUNT; i++)
+    {
+        t.*TRANSACTION_TEXTS[i] = group.texts[i].view();
+    }
+    t.securityPrefix = group.securityPrefix;
+    for (int i = 0; i < 3; i++)
+    {
+        t.*NUMBERS[i] = group.numbers[i];
+        t.*HAS[i]     = group.has[i];
+    }
+
+    if (group.rows > 1)
+    {
+        for (int i = AMOUNT; i <= UNITS; i += UNITS - AMOUNT)
+        {
+            FieldView & line = t.*TRANSACTION_TEXTS[TEXT_AMOUNT_LINE + i];
+
+            line.ptr     = t.*STORAGE[i];
+            line.len     = formatDecimal( group.numbers[i].value, SCALE[i], group.numbers[i].digits, t.*STORAGE[i] );
+            line.escaped = false;
+        }
+
+        Decimal price;
+        if (  group.has[PRICE]
+           && !group.samePrice
+           && unitPrice( t.amount, t.units, price )
+           )
+        {
+            // As many digits as the rows had, or more if it takes them.
+            int64_t rest = price.value;
+            while (  price.digits > group.numbers[PRICE].digits
+                  && rest % 10 == 0
+                  )
+            {
+                rest /= 10;
+                price.digits--;
+            }
+            t.price          = price;
+            t.priceLine.ptr  = t.priceText;
+            t.priceLine.len  = formatDecimal( price.value, PRICE_SCALE, price.digits, t.priceText );
+            t.priceLine.escaped = false;
+        }
+
+        if (t.txfrAmount.len > 0)
+        {
+            t.txfrAmount = t.amountLine;    // mergeable() says it was
+        }
+
+        m_memo.clear();
+        for (const std::string & memo : group.memos)
+        {
+            if (!m_memo.empty())
+            {
+                m_memo += MEMO_SEPARATOR;
+            }
+            m_memo += memo;
+        }
+        t.memo.ptr     = m_memo.data();
+        t.memo.len     = m_memo.size();
+        t.memo.escaped = false;
+    } // if merged
+
+    if (t.lines.size() < group.lines.size())
+    {
+        t.lines.resize( group.lines.size() );
+    }
+    for (size_t i = 0; i < group.lines.size(); i++)
+    {
+        const Shape     & shape = group.lines[i];
+        TransactionLine & line  = t.lines[i];
+
+        line.fieldID   = shape.fieldID;
+        line.prefix    = shape.prefixed ? group.securityPrefix : "";
+        line.prefixLen = strlen( line.prefix );
+        line.text      = shape.field >= 0 ? t.*TRANSACTION_TEXTS[shape.field] : shape.text.view();
+    }
+    t.lineCount = group.lines.size();
+
+    m_transactions++;
+    STATS_COUNT( *m_stats, STAT_AGGREGATE_OUT );
+
+    // The next sink times itself.
+    STATS_LAP( *m_stats, STAT_AGGREGATE, m_mark );
+    m_next.transaction( t );
+    STATS_RESTART( *m_stats, m_mark );
+
+} // AggregateSink::emit()
+
+void AggregateSink::flush()
+{
+    for (size_t i = 0; i < m_used; i++)
+    {
+        emit( m_groups[i] );
+    }
+    m_used = 0;
+    m_index.clear();
+    if (!m_date.empty())
+    {
+        m_written.insert( m_date );
+    }
+}
+
+void AggregateSink::end()
+{
+    STATS_RESTART( *m_stats, m_mark );
+    flush();
+    STATS_LAP( *m_stats, STAT_AGGREGATE, m_mark );
+    m_next.end();
+}
@@ -0,0 +1,123 @@
+/*===========================================================================*
+ AggregateSink.h :
+ A TransactionSink that merges the rows a pay period writes - Before-Tax,
+ Company Match, Nonelective Contributions, each for every fund - into one
+ transaction per day, fund and kind of transaction, before handing them
+ on.  Quicken gets a fraction of the transactions to import, with the same
+ holdings and cash at the end.
+
+ Rows are grouped in a hash table on their posting date, fund, action,
+ transfer account, commission and cleared status, so a BuyX paid for from
+ Cash never merges with a Buy that wasn't.  A group's amounts and units
+ are summed in fixed point, its price is kept if every row had the same
+ one and worked out again from the sums if not, and its memo lists the
+ different memos its rows had.  A group of one row goes on just as it
+ came in.
+
+ Rows without a date, or whose amount or units aren't numbers, or with a
+ commission or transfer amount of their own, aren't merged with anything.
+
+ Groups are written when the date changes, so memory only grows with the
+ funds in a day - if the export comes grouped by date, as the custodians'
+ do.  If it doesn't, rows for a date that's already been written can't be
+ merged with it; late() counts them, and sorting first (see SortSink.h)
+ puts every export in date order in bounded memory.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "FixedPoint.h"
+#include "Stats.h"
+#include "Transaction.h"
+
+class AggregateSink : public TransactionSink
+{
+public:
+    AggregateSink( TransactionSink & next
+                 , ConvertStats    * stats = nullptr
+                 );
+
+    void begin      ( const HeaderMap & header ) override;
+    void transaction( const Transaction & transaction ) override;
+    void end        () override;
+
+    // Rows in, and transactions out.
+    size_t rows        () const { return m_rows; }
+    size_t transactions() const { return m_transactions; }
+
+    // Rows for a date whose transactions had already been written.
+    size_t late        () const { return m_late; }
+
+private:
+    AggregateSink           ( const AggregateSink & );   // not copyable
+    AggregateSink & operator=( const AggregateSink & );
+
+    // A copy of some text from a row, as it was.
+    struct Held
+    {
+        std::string text;
+        bool        escaped;
+
+        void      hold( const FieldView & field );
+        FieldView view() const;
+    };
+
+    // A line of the group's first row: the field it shows, or its own text.
+    struct Shape
+    {
+        char fieldID;
+        bool prefixed;
+        int  field;                     // TransactionText, or -1 for text
+        Held text;
+    };
+
+    struct Group
+    {
+        size_t                   rows;
+        Held                     texts[TEXT_COUNT];     // the first row's
+        const char             * securityPrefix;
+        std::vector<Shape>       lines;
+        Decimal                  numbers[3];            // amount, price, units
+        bool                     has[3];
+        bool                     samePrice;             // every row's was the first's
+        std::vector<std::string> memos;                 // the different ones, unescaped
+    };
+
+    void      start   ( Group             & group
+                      , const Transaction & t
+                      );
+    void      add     ( Group             & group
+                      , const Transaction & t
+                      );
+    void      emit    ( Group & group );
+    void      flush   ();
+    bool      mergeable( const Transaction & t ) const;
+
+    TransactionSink                         & m_next;
+    ConvertStats                              m_noStats;    // if there's no m_stats
+    ConvertStats                            * m_stats;
+    uint64_t                                  m_mark;
+
+    std::string                               m_date;       // the one being grouped, as written
+    bool                                      m_dateLate;
+    std::vector<Group>                        m_groups;     // for m_date, in the order they started
+    size_t                                    m_used;       // of m_groups; the rest are kept to reuse
+    std::unordered_map<std::string, size_t>   m_index;      // key -> m_groups
+    std::unordered_set<std::string>           m_written;    // dates already flushed
+    std::string                               m_key;
+    std::string                               m_memo;
+    Transaction                               m_out;
+
+    size_t                                    m_rows;
+    size_t                                    m_transactions;
+    size_t                                    m_late;
+
+}; // class AggregateSink
@@ -0,0 +1,413 @@
+/*===========================================================================*
+ BatchConvert.cpp :
+ Input expansion, the parallel run, and the summary report.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "BatchConvert.h"
+#include "ThreadPool.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <system_error>
+#include <utility>
+
+#include "ColumnCache.h"
+#include "HeaderMap.h"
+
+namespace fs = std::filesystem;
+
+/*---------------------------------------------------------------------------*
+ wildcardMatch() :
+ * and ? matching, case insensitive since exports turn up as both .csv and
+ .CSV.
+ *---------------------------------------------------------------------------*/
+static bool wildcardMatch( const char * pattern
+                         , const char * name
+                         )
+{
+    const char * star      = nullptr;
+    const char * starMatch = nullptr;
+
+    while (*name != '\0')
+    {
+        if (  *pattern == '?'
+           || tolower( (unsigned char)*pattern ) == tolower( (unsigned char)*name )
+           )
+        {
+            pattern++;
+            name++;
+        }
+        else if (*pattern == '*')
+        {
+            star      = pattern++;
+            starMatch = name;
+        }
+        else if (star != nullptr)
+        {
+            pattern = star + 1;
+            name    = ++starMatch;
+        }
+        else
+        {
+            return false;
+        }
+    } // for each character of name
+
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == '\0';
+
+} // wildcardMatch()
+
+static bool hasWildcard( const std::string & arg )
+{
+    return arg.find_first_of( "*?" ) != std::string::npos;
+}
+
+bool isBatchInput( const std::string & arg )
+{
+    std::error_code error;
+
+    return hasWildcard( arg ) || fs::is_directory( arg, error );
+}
+
+bool isExportFile( const std::string & name )
+{
+    size_t len    = name.size() - strlen( compressionExtension( compressionOf( name ) ) );
+    size_t extLen = strlen( CSV_EXTENSION );
+
+    return len > extLen
+        && equalsNoCase( name.substr( len - extLen, extLen ).c_str(), CSV_EXTENSION );
+}
+
+std::string outputName( const char * inputName
+                      , const char * extension
+                      )
+{
+    std::string name = inputName;
+
+    name.resize( name.size() - strlen( compressionExtension( compressionOf( name ) ) ) );
+    for (const char * inputExtension : { CSV_EXTENSION, CACHE_EXTENSION })
+    {
+        size_t extLen = strlen( inputExtension );
+
+        if (  name.size() >= extLen
+           && equalsNoCase( name.c_str() + name.size() - extLen, inputExtension )
+           )
+        {
+            return name.replace( name.size() - extLen, extLen, extension );
+        }
+    }
+    return name + extension;
+}
+
+std::string qifName( const std::string    & input
+                   , const ConvertOptions & options
+                   )
+{
+    return !options.output.empty() ? options.output
+                                   : outputName( input.c_str(), QIF_EXTENSION ) + compressionExtension( options.compress );
+}
+
+/*---------------------------------------------------------------------------*
+ OutputClaims
+ *---------------------------------------------------------------------------*/
+// Absolute and case folded, so ./a.qif and A.QIF are the same file - as
+// they are on Windows and macOS; elsewhere it's safe to be cautious.
+static std::string outputKey( const std::string & filename )
+{
+    std::error_code error;
+    fs::path        path = fs::absolute( filename, error );
+    std::string     key  = ( error ? fs::path( filename ) : path ).lexically_normal().string();
+
+    std::transform( key.begin()
+                  , key.end()
+                  , key.begin()
+                  , []( char c ) { return (char)tolower( (unsigned char)c ); }
+                  );
+    return key;
+}
+
+std::string OutputClaims::claim( const std::string    & input
+                               , const ConvertOptions & options
+                               )
+{
+    std::string qifFilename = qifName( input, options );
+    std::string key         = outputKey( qifFilename );
+
+    std::pair<std::map<std::string, std::string>::iterator, bool> added = m_owners.emplace( key, input );
+    const std::string & owner = added.first->second;
+
+    if (  added.second
+       || owner == input
+       )
+    {
+        m_keys[input] = key;
+        return std::string();
+    }
+    return "ERROR: Not converting...\n" + input
+         + "\n...its QIF file, " + qifFilename + ", is the one for...\n" + owner
+         + "\n...rename one of them.\n";
+
+} // OutputClaims::claim()
+
+void OutputClaims::release( const std::string & input )
+{
+    std::map<std::string, std::string>::iterator it = m_keys.find( input );
+
+    if (it != m_keys.end())
+    {
+        m_owners.erase( it->second );
+        m_keys.erase( it );
+    }
+}
+
+/*---------------------------------------------------------------------------*
+ expandInputs() :
+ Turn the command line into a list of files, each once however many times
+ it's named.  Patterns that match nothing go straight into failures.
+ *---------------------------------------------------------------------------*/
+static void expandInputs( const std::vector<std::string> & args
+                        , std::vector<std::string>       & files
+                        , std::vector<ConvertResult>     & failures
+                        )
+{
+    std::set<std::string> listed;
+
+    for (const std::string & arg : args)
+    {
+        std::error_code error;
+        fs::path        dir;
+        std::string     pattern;
+
+        if (fs::is_directory( arg, error ))
+        {
+            dir     = arg;              // pattern stays empty: isExportFile()
+        }
+        else if (hasWildcard( arg ))
+        {
+            fs::path path( arg );
+            dir     = path.has_parent_path() ? path.parent_path() : fs::path( "." );
+            pattern = path.filename().string();
+        }
+        else
+        {
+            if (listed.insert( arg ).second)
+            {
+                files.push_back( arg );
+            }
+            continue;
+        }
+
+        size_t before  = files.size();
+        bool   matched = false;
+        for (fs::directory_iterator it( dir, error ), end; !error && it != end; it.increment( error ))
+        {
+            std::string name = it->path().filename().string();
+
+            if (  it->is_regular_file( error )
+               && ( pattern.empty() ? isExportFile( name ) : wildcardMatch( pattern.c_str(), name.c_str() ) )
+               )
+            {
+                matched = true;
+                if (listed.insert( it->path().string() ).second)
+                {
+                    files.push_back( it->path().string() );
+                }
+            }
+        }
+
+        // Directory order is arbitrary; keep each argument's files tidy.
+        std::sort( files.begin() + before, files.end() );
+
+        if (!matched)
+        {
+            ConvertResult result;
+            result.csvFilename = arg;
+            result.error       = "ERROR: No CSV files match...\n" + arg + "\n";
+            failures.push_back( result );
+        }
+    } // for each argument
+
+} // expandInputs()
+
+int runBatch( const std::vector<std::string> & args
+            , unsigned                         jobs
+            , const ConvertOptions           & options
+            , ConvertFn                        convert
+            )
+{
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    std::vector<std::string>   files;
+    std::vector<ConvertResult> failures;
+
+    expandInputs( args, files, failures );
+
+    // One slot per file, so workers never touch shared state.  The pool is
+    // already busy, so each file converts on the one thread it lands on.
+    std::vector<ConvertResult> results( files.size() );
+    ConvertOptions             fileOptions = options;
+    OutputClaims               claims;                  // in file order
+
+    fileOptions.verbose = false;
+    fileOptions.threads = 1;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        results[i].csvFilename = files[i];
+        results[i].error       = claims.claim( files[i], fileOptions );
+    }
+
+    if (options.dedup != nullptr)
+    {
+        // One at a time, in order, so each file leaves out what the ones
+        // before it wrote (see DedupIndex.h) whatever the thread count;
+        // a big file still splits across jobs threads.
+        fileOptions.threads = jobs;
+
+        printf( "Converting %zu file(s) in order\n", files.size() );
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            if (results[i].error.empty())
+            {
+                convert( files[i].c_str(), fileOptions, results[i] );
+            }
+        }
+    }
+    else
+    {
+        ThreadPool pool( jobs );
+
+        printf( "Converting %zu file(s) on %u thread(s)\n"
+              , files.size()
+              , pool.size()
+              );
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            if (!results[i].error.empty())
+            {
+                continue;
+            }
+
+            pool.submit( [&, i]
+                         {
+                             convert( files[i].c_str(), fileOptions, results[i] );
+                         }
+                       );
+        }
+        pool.wait();
+    }
+
+    size_t       converted = 0;
+    size_t       rows      = 0;
+    size_t       bytes     = 0;
+    ConvertStats stats;
+    for (const ConvertResult & result : results)
+    {
+        if (result.error.empty())
+        {
+            converted++;
+            rows  += result.rows;
+            bytes += result.bytes;
+            stats.add( result.stats );
+        }
+        else
+        {
+            failures.push_back( result );
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+
+    printf( "%zu of %zu file(s) converted, %zu rows, %.1f MB in %.3f sec\n"
+          , converted
+          , results.size()
+          , rows
+          , bytes / 1048576.0
+          , elapsed
+          );
+
+    for (const ConvertResult & result : results)
+    {
+        if (result.error.empty())
+        {
+            printWarnings( result );
+        }
+    }
+
+    if (options.stats != STATS_OFF)
+    {
+        std::string what = std::to_string( converted ) + " file(s)";
+        printf( "%s", formatStats( stats, options.stats, what, bytes, elapsed ).c_str() );
+    }
+
+    if (!failures.empty())
+    {
+        printf( "\n%zu failure(s):\n", failures.size() );
+        for (const ConvertResult & failure : failures)
+        {
+            printf( "%s", failure.error.c_str() );
+        }
+    }
+
+    return (int)failures.size();
+
+} // runBatch()
+
+void printWarnings( const ConvertResult & result )
+{
+    if (result.duplicates > 0)
+    {
+        printf( result.keptDuplicates ? "WARNING: %s: %zu row(s) were already converted before\n"
+                                      : "%s: %zu row(s) already converted before were left out\n"
+              , result.csvFilename.c_str()
+              , result.duplicates
+              );
+    }
+    if (result.badNumbers > 0)
+    {
+        printf( "WARNING: %s: %zu amount/price/units value(s) aren't numbers\n"
+              , result.csvFilename.c_str()
+              , result.badNumbers
+              );
+    }
+    if (result.priceMismatches > 0)
+    {
+        printf( "WARNING: %s: %zu row(s) where price x units doesn't match the amount\n"
+              , result.csvFilename.c_str()
+              , result.priceMismatches
+              );
+    }
+    if (result.undated > 0)
+    {
+        printf( "WARNING: %s: %zu row(s) left out of the OFX file - no date it could read\n"
+              , result.csvFilename.c_str()
+              , result.undated
+              );
+    }
+    if (result.priceConflicts > 0)
+    {
+        printf( "WARNING: %s: %zu row(s) priced a fund differently from its first price that day, which was kept\n"
+              , result.csvFilename.c_str()
+              , result.priceConflicts
+              );
+    }
+    if (result.lateRows > 0)
+    {
+        printf( "WARNING: %s: %zu row(s) not merged - their date came again after other dates (add --sort)\n"
+              , result.csvFilename.c_str()
+              , result.lateRows
+              );
+    }
+}
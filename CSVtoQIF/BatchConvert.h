@@ -0,0 +1,157 @@
+/*===========================================================================*
+ BatchConvert.h :
+ Converting lots of exports in one run.  The command line can name any mix
+ of files, directories (every .csv, .csv.gz and .csv.zst directly inside)
+ and wildcard patterns
+ (* and ? in the file name part).  Each file is converted on a ThreadPool
+ worker - or with a dedup index, one at a time in order, so each leaves
+ out what the ones before it wrote (see DedupIndex.h).  Failures are
+ collected rather than stopping the run, and a summary is printed at the
+ end.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Compression.h"
+#include "SecuritySink.h"
+#include "Stats.h"
+
+#define CSV_EXTENSION          ".csv"
+#define QIF_EXTENSION          ".qif"
+
+class DedupIndex;
+
+/*---------------------------------------------------------------------------*
+ ConvertResult :
+ How one file went.  error is empty if it worked; the counts of rows
+ whose numbers didn't add up are warnings, not failures.
+ *---------------------------------------------------------------------------*/
+struct ConvertResult
+{
+    std::string  csvFilename;
+    std::string  qifFilename;
+    std::string  error;
+    size_t       rows;
+    size_t       bytes;
+    double       seconds;
+    size_t       badNumbers;
+    size_t       priceMismatches;
+    size_t       duplicates;
+    bool         keptDuplicates;
+    size_t       undated;          // rows the OFX file had to leave out
+    size_t       transactions;     // what rows came to, with aggregate
+    size_t       lateRows;         // ...that came too late to merge
+    size_t       securities;       // funds and fund-days priced, with securities
+    size_t       prices;
+    size_t       priceConflicts;   // rows priced differently from the day's first
+    ConvertStats stats;            // counted whether or not --stats asked
+
+    ConvertResult() : rows( 0 ), bytes( 0 ), seconds( 0.0 ), badNumbers( 0 ), priceMismatches( 0 ), duplicates( 0 ), keptDuplicates( false ), undated( 0 ), transactions( 0 ), lateRows( 0 ), securities( 0 ), prices( 0 ), priceConflicts( 0 ) {}
+};
+
+/*---------------------------------------------------------------------------*
+ ConvertOptions :
+ How to convert a file.  verbose gets the old single file chatter on
+ stdout; big files are split across threads workers (0 = one per core);
+ incremental only converts rows added since the last incremental run;
+ with a dedup index, rows it already has are left out (or, with
+ keepDuplicates, only counted) and the rest are staged for it.  stats
+ turns on the phase timers and says how to report them.  ofx and cache
+ write an OFX file and a column cache (see ColumnCache.h) next to the QIF
+ file, from the same parse.  sort puts the rows in date and fund order
+ first, in sortMemory bytes (0 for the default) or on disk (see
+ SortSink.h).  aggregate merges each day's rows for the same fund and
+ action (see AggregateSink.h), after sorting if sort is on too.  output
+ names the QIF file ("-" for stdout) in place of the input's name with
+ QIF_EXTENSION, and compress compresses it (see Compression.h).
+ securities adds the security list and the funds' daily prices, to the
+ QIF file or a file of their own (see SecuritySink.h).
+ *---------------------------------------------------------------------------*/
+struct ConvertOptions
+{
+    bool         verbose;
+    unsigned     threads;
+    bool         incremental;
+    DedupIndex * dedup;
+    bool         keepDuplicates;
+    StatsFormat  stats;
+    bool         ofx;
+    bool         cache;
+    bool         sort;
+    size_t       sortMemory;
+    bool         aggregate;
+    std::string  output;
+    Compression  compress;
+    SecurityList securities;
+
+    ConvertOptions() : verbose( false ), threads( 0 ), incremental( false ), dedup( nullptr ), keepDuplicates( false ), stats( STATS_OFF ), ofx( false ), cache( false ), sort( false ), sortMemory( 0 ), aggregate( false ), compress( COMPRESSION_NONE ), securities( SECURITIES_OFF ) {}
+};
+
+typedef bool (*ConvertFn)( const char           * csvFilename
+                         , const ConvertOptions & options
+                         , ConvertResult        & result
+                         );
+
+// True if arg is a directory or a wildcard pattern rather than one file.
+bool isBatchInput( const std::string & arg );
+
+// True if name ends CSV_EXTENSION, compressed or not (see Compression.h) -
+// what a directory is searched for.
+bool isExportFile( const std::string & name );
+
+// inputName with its CSV (or cache) extension swapped for extension, or
+// with extension tacked on the end if it doesn't have one.  A .gz or .zst
+// on the end of inputName goes first.
+std::string outputName( const char * inputName
+                      , const char * extension
+                      );
+
+// The QIF file options says input converts to.
+std::string qifName   ( const std::string    & input
+                      , const ConvertOptions & options
+                      );
+
+/*---------------------------------------------------------------------------*
+ OutputClaims :
+ Which input each QIF file is being written for.  x.csv and x.csv.gz in
+ the same directory both convert to x.qif, as do ./x.csv and x.csv; only
+ the first input to claim it gets it, and the rest fail rather than have
+ one overwrite the other.  The OFX file, the cache and the rest are named
+ the same way, so they go with the QIF file.
+ *---------------------------------------------------------------------------*/
+class OutputClaims
+{
+public:
+    // Empty if input's QIF file is free (or already input's), otherwise
+    // the error for it.
+    std::string claim  ( const std::string    & input
+                       , const ConvertOptions & options
+                       );
+
+    // input's gone, so its QIF file is up for grabs.
+    void        release( const std::string & input );
+
+private:
+    std::map<std::string, std::string> m_owners;    // QIF file -> input
+    std::map<std::string, std::string> m_keys;      // input -> QIF file
+
+}; // class OutputClaims
+
+// Print any number warnings for result.
+void printWarnings( const ConvertResult & result );
+
+// Convert everything args names on jobs threads (0 = one per core), each
+// file quietly on one thread but otherwise as options says.  Prints a
+// summary (and with options.stats, the stats of every file put together)
+// and returns the number of files that failed.
+int  runBatch    ( const std::vector<std::string> & args
+                 , unsigned                         jobs
+                 , const ConvertOptions           & options
+                 , ConvertFn                        convert
+                 );
@@ -0,0 +1,190 @@
+/*===========================================================================*
+ Checkpoint.cpp :
+ Making, checking and persisting incremental checkpoints.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "Checkpoint.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+#include <system_error>
+
+#define CHECKPOINT_MAGIC       "CSVtoQIF checkpoint 1"
+
+const size_t PREFIX_SAMPLES      = 32;
+const size_t PREFIX_SAMPLE_BYTES = 512;
+
+// 64 bit FNV-1a, carrying on from hash.
+static uint64_t hashBytes( const void * data
+                         , size_t       len
+                         , uint64_t     hash = 14695981039346656037ULL
+                         )
+{
+    const unsigned char * p = (const unsigned char *)data;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// PREFIX_SAMPLES pieces of data[0, size), from the start to near the end.
+static uint64_t hashPrefix( const char * data
+                          , size_t       size
+                          )
+{
+    uint64_t hash = hashBytes( &size, sizeof( size ) );
+
+    for (size_t k = 0; k < PREFIX_SAMPLES; k++)
+    {
+        size_t at  = (size_t)( (uint64_t)size * k / PREFIX_SAMPLES );
+        size_t len = size - at < PREFIX_SAMPLE_BYTES ? size - at : PREFIX_SAMPLE_BYTES;
+
+        hash = hashBytes( data + at, len, hash );
+    }
+    return hash;
+}
+
+uint64_t headerSignature( const HeaderMap & header )
+{
+    uint64_t hash = hashBytes( &header.columnCount, sizeof( header.columnCount ) );
+
+    hash = hashBytes( header.fieldID.data(), header.fieldID.size(), hash );
+    hash = hashBytes( &header.prePendSF, sizeof( header.prePendSF ), hash );
+    return hash;
+}
+
+Checkpoint makeCheckpoint( const char * data
+                         , size_t       size
+                         , uint64_t     signature
+                         )
+{
+    // The last row runs from just after the newline before it (not the
+    // one that ends it) to the end of the data.
+    size_t start = size > 0 ? size - 1 : 0;
+    while (  start > 0
+          && data[start - 1] != '\n'
+          )
+    {
+        start--;
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.offset          = size;
+    checkpoint.lastRowLength   = size - start;
+    checkpoint.lastRowHash     = hashBytes( data + start, size - start );
+    checkpoint.prefixHash      = hashPrefix( data, size );
+    checkpoint.headerSignature = signature;
+    return checkpoint;
+}
+
+const char * checkResume( const Checkpoint & saved
+                        , const char       * data
+                        , size_t             size
+                        , uint64_t           signature
+                        )
+{
+    if (saved.headerSignature != signature)
+    {
+        return "the columns have changed";
+    }
+    if (saved.offset > size)
+    {
+        return "the export is shorter than last time";
+    }
+    if (saved.lastRowLength > saved.offset)
+    {
+        return "the checkpoint doesn't make sense";
+    }
+
+    size_t start = (size_t)( saved.offset - saved.lastRowLength );
+    if (hashBytes( data + start, (size_t)saved.lastRowLength ) != saved.lastRowHash)
+    {
+        return "the last row converted last time has changed";
+    }
+    if (hashPrefix( data, (size_t)saved.offset ) != saved.prefixHash)
+    {
+        return "rows converted last time have changed";
+    }
+    return nullptr;
+}
+
+bool readCheckpoint( const std::string & filename
+                   , Checkpoint        & checkpoint
+                   )
+{
+    FILE * file = fopen( filename.c_str(), "r" );
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    char line[64];
+    int  fields = 0;
+
+    if (  fgets( line, sizeof( line ), file )
+       && strncmp( line, CHECKPOINT_MAGIC, sizeof( CHECKPOINT_MAGIC ) - 1 ) == 0
+       )
+    {
+        fields += fscanf( file, " offset %" SCNu64, &checkpoint.offset );
+        fields += fscanf( file, " lastRowLength %" SCNu64, &checkpoint.lastRowLength );
+        fields += fscanf( file, " lastRowHash %" SCNx64, &checkpoint.lastRowHash );
+        fields += fscanf( file, " prefixHash %" SCNx64, &checkpoint.prefixHash );
+        fields += fscanf( file, " headerSignature %" SCNx64, &checkpoint.headerSignature );
+    }
+    fclose( file );
+
+    return fields == 5;
+
+} // readCheckpoint()
+
+bool writeCheckpoint( const std::string & filename
+                    , const Checkpoint  & checkpoint
+                    )
+{
+    std::string temporary = filename + ".tmp";
+
+    FILE * file = fopen( temporary.c_str(), "w" );
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    fprintf( file
+           , CHECKPOINT_MAGIC "\n"
+             "offset %" PRIu64 "\n"
+             "lastRowLength %" PRIu64 "\n"
+             "lastRowHash %016" PRIx64 "\n"
+             "prefixHash %016" PRIx64 "\n"
+             "headerSignature %016" PRIx64 "\n"
+           , checkpoint.offset
+           , checkpoint.lastRowLength
+           , checkpoint.lastRowHash
+           , checkpoint.prefixHash
+           , checkpoint.headerSignature
+           );
+
+    bool written = ( ferror( file ) == 0 );
+    written = ( fclose( file ) == 0 ) && written;
+
+    std::error_code error;
+    if (written)
+    {
+        std::filesystem::rename( temporary, filename, error );
+    }
+    if (  !written
+       || error
+       )
+    {
+        std::filesystem::remove( temporary, error );
+        return false;
+    }
+    return true;
+
+} // writeCheckpoint()
@@ -0,0 +1,68 @@
+/*===========================================================================*
+ Checkpoint.h :
+ Where the last incremental run got to in an export.
+
+ Exports only ever grow at the end, so after converting one we note how
+ far we got (offset), a hash of the last row we converted (the bytes just
+ before offset) and a signature of what the columns meant.  The next run
+ checks all of that still holds for the export in front of it - the same
+ bytes are at the same place and the header maps the same way - and if so
+ only converts what's past offset.  If anything's off it says what and
+ the caller converts the whole thing again.
+
+ Hashing everything before offset would cost most of what skipping it
+ saves, so the rest of the prefix is only sampled: PREFIX_SAMPLES evenly
+ spaced pieces, the first of which covers the header and first rows.
+ That catches most re-exports (a different start date, restated
+ history), though not a single edited digit in the middle of last year.
+
+ The checkpoint is a few lines of text in a sidecar next to the QIF file
+ (<name>.qif.state), replaced atomically so an interrupted run leaves the
+ old one intact.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "HeaderMap.h"
+
+#define CHECKPOINT_EXTENSION   ".state"
+
+struct Checkpoint
+{
+    uint64_t offset;            // converted everything before this
+    uint64_t lastRowLength;     // the last row is [offset - lastRowLength, offset)
+    uint64_t lastRowHash;
+    uint64_t prefixHash;        // of the samples of [0, offset)
+    uint64_t headerSignature;
+};
+
+// Hash of everything mapHeader() decided about the columns.
+uint64_t     headerSignature( const HeaderMap & header );
+
+// The checkpoint for having converted all of data[0, size).
+Checkpoint   makeCheckpoint ( const char * data
+                            , size_t       size
+                            , uint64_t     signature
+                            );
+
+// nullptr if data[0, size) carries on from saved, otherwise why not.
+const char * checkResume    ( const Checkpoint & saved
+                            , const char       * data
+                            , size_t             size
+                            , uint64_t           signature
+                            );
+
+// False if there's no readable checkpoint in filename.
+bool         readCheckpoint ( const std::string & filename
+                            , Checkpoint        & checkpoint
+                            );
+
+// Write to a temporary file and rename it over filename.
+bool         writeCheckpoint( const std::string & filename
+                            , const Checkpoint  & checkpoint
+                            );
@@ -0,0 +1,444 @@
+/*===========================================================================*
+ ColumnCache.cpp :
+ Writing transactions as columns, and reading them back.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "ColumnCache.h"
+
+#include <string.h>
+
+#include "FixedPoint.h"
+#include "HeaderMap.h"
+#include "QifFormat.h"
+
+static const char     CACHE_MAGIC[8]   = { 'C', 'S', 'V', 'Q', 'C', 'O', 'L', 'S' };
+const uint32_t        CACHE_VERSION    = 1;
+const uint32_t        CACHE_BYTE_ORDER = 0x01020304;
+
+static size_t padded( size_t bytes )
+{
+    return ( bytes + 7 ) & ~(size_t)7;
+}
+
+static bool sameText( const FieldView & a
+                    , const FieldView & b
+                    )
+{
+    return a.len     == b.len
+        && a.escaped == b.escaped
+        && memcmp( a.ptr, b.ptr, a.len ) == 0;
+}
+
+/*---------------------------------------------------------------------------*
+ ColumnCacheSink
+ *---------------------------------------------------------------------------*/
+ColumnCacheSink::ColumnCacheSink( QifWriter & writer )
+    : m_writer ( writer )
+    , m_offsets( 2, 0 )             // "" is string 0
+{
+}
+
+uint32_t ColumnCacheSink::intern( const FieldView & text )
+{
+    if (text.len == 0)
+    {
+        return 0;
+    }
+
+    m_key.resize( text.len );
+    m_key.resize( csvUnescape( text, &m_key[0] ) );
+
+    std::unordered_map<std::string, uint32_t>::const_iterator found = m_ids.find( m_key );
+    if (found != m_ids.end())
+    {
+        return found->second;
+    }
+
+    uint32_t id = (uint32_t)( m_offsets.size() - 1 );
+    m_strings.append( m_key );
+    m_offsets.push_back( m_strings.size() );
+    m_ids.emplace( m_key, id );
+    return id;
+}
+
+// The number, and its line's text only if the number won't reproduce it.
+void ColumnCacheSink::number( CacheNumber       column
+                            , CacheText         textColumn
+                            , const Decimal   & value
+                            , bool              has
+                            , const FieldView & line
+                            , int               scale
+                            )
+{
+    uint32_t textID = 0;
+
+    if (line.len > 0)
+    {
+        char      text[DECIMAL_STR_LEN];
+        FieldView formatted = { text, 0, false };
+
+        if (has)
+        {
+            formatted.len = formatDecimal( value.value, scale, value.digits, text );
+        }
+        if (  !has
+           || !sameText( formatted, line )
+           )
+        {
+            textID = intern( line );
+        }
+    }
+
+    m_values[column]    .push_back( has ? value.value : 0 );
+    m_digits[column]    .push_back( (uint8_t)( value.digits < 0 ? 0 : value.digits > 255 ? 255 : value.digits ) );
+    m_text  [textColumn].push_back( textID );
+}
+
+void ColumnCacheSink::transaction( const Transaction & t )
+{
+    uint8_t flags = 0;
+
+    if (t.hasAmount)                    flags |= CACHE_HAS_AMOUNT;
+    if (t.hasPrice)                     flags |= CACHE_HAS_PRICE;
+    if (t.hasUnits)                     flags |= CACHE_HAS_UNITS;
+    if (t.securityPrefix[0] != '\0')    flags |= CACHE_SF_PREFIX;
+    if (  t.txfrAmount.len > 0
+       && sameText( t.txfrAmount, t.amountLine )
+       )
+    {
+        flags |= CACHE_TXFR_IS_AMOUNT;
+    }
+
+    m_text[CACHE_DATE]       .push_back( intern( t.date ) );
+    m_text[CACHE_SECURITY]   .push_back( intern( t.security ) );
+    m_text[CACHE_MEMO]       .push_back( intern( t.memo ) );
+    m_text[CACHE_ACTION]     .push_back( intern( t.action ) );
+    m_text[CACHE_COMMISSION] .push_back( intern( t.commission ) );
+    m_text[CACHE_CLEARED]    .push_back( intern( t.cleared ) );
+    m_text[CACHE_TXFR_ACCT]  .push_back( intern( t.txfrAcct ) );
+    m_text[CACHE_TXFR_AMOUNT].push_back( ( flags & CACHE_TXFR_IS_AMOUNT ) ? 0 : intern( t.txfrAmount ) );
+
+    number( CACHE_AMOUNT, CACHE_AMOUNT_TEXT, t.amount, t.hasAmount, t.amountLine, AMOUNT_SCALE   );
+    number( CACHE_PRICE,  CACHE_PRICE_TEXT,  t.price,  t.hasPrice,  t.priceLine,  PRICE_SCALE    );
+    number( CACHE_UNITS,  CACHE_UNITS_TEXT,  t.units,  t.hasUnits,  t.unitsLine,  QUANTITY_SCALE );
+
+    m_flags.push_back( flags );
+
+} // ColumnCacheSink::transaction()
+
+void ColumnCacheSink::end()
+{
+    static const char ZEROS[8] = { 0 };
+
+    CacheHeader header;
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, CACHE_MAGIC, sizeof( header.magic ) );
+    header.version     = CACHE_VERSION;
+    header.byteOrder   = CACHE_BYTE_ORDER;
+    header.rows        = m_flags.size();
+    header.strings     = m_offsets.size() - 1;
+    header.stringBytes = m_strings.size();
+
+    size_t rows = m_flags.size();
+
+    m_writer.write( &header, sizeof( header ) );
+    m_writer.write( m_offsets.data(), m_offsets.size() * sizeof( uint64_t ) );
+    m_writer.write( m_strings.data(), m_strings.size() );
+    m_writer.write( ZEROS, padded( m_strings.size() ) - m_strings.size() );
+    for (const std::vector<uint32_t> & column : m_text)
+    {
+        m_writer.write( column.data(), rows * sizeof( uint32_t ) );
+    }
+    m_writer.write( ZEROS, padded( rows * sizeof( uint32_t ) * CACHE_TEXT_COUNT ) - rows * sizeof( uint32_t ) * CACHE_TEXT_COUNT );
+    for (const std::vector<int64_t> & column : m_values)
+    {
+        m_writer.write( column.data(), rows * sizeof( int64_t ) );
+    }
+    for (const std::vector<uint8_t> & column : m_digits)
+    {
+        m_writer.write( column.data(), rows );
+    }
+    m_writer.write( ZEROS, padded( rows * CACHE_NUMBER_COUNT ) - rows * CACHE_NUMBER_COUNT );
+    m_writer.write( m_flags.data(), rows );
+    m_writer.write( ZEROS, padded( rows ) - rows );
+
+} // ColumnCacheSink::end()
+
+/*---------------------------------------------------------------------------*
+ ColumnCache
+ *---------------------------------------------------------------------------*/
+ColumnCache::ColumnCache()
+    : m_rows      ( 0 )
+    , m_strings   ( 0 )
+    , m_offsets   ( nullptr )
+    , m_stringData( nullptr )
+    , m_flags     ( nullptr )
+{
+}
+
+bool ColumnCache::isCacheFile( const std::string & filename )
+{
+    size_t extLen = sizeof( CACHE_EXTENSION ) - 1;
+
+    return filename.size() >= extLen
+        && equalsNoCase( filename.c_str() + filename.size() - extLen, CACHE_EXTENSION );
+}
+
+bool ColumnCache::open( const char  * filename
+                      , std::string & error
+                      )
+{
+    if (!m_file.open( filename ))
+    {
+        error = std::string( "ERROR: Cache file...\n" )
+              + filename
+              + "\n...not found\n";
+        return false;
+    }
+
+    const char  * data = m_file.data();
+    size_t        size = m_file.size();
+    CacheHeader   header;
+    const char  * why  = nullptr;
+
+    if (size < sizeof( header ))
+    {
+        why = "is too short to be a cache file";
+    }
+    else
+    {
+        memcpy( &header, data, sizeof( header ) );
+        if (memcmp( header.magic, CACHE_MAGIC, sizeof( header.magic ) ) != 0)
+        {
+            why = "isn't a cache file";
+        }
+        else if (header.byteOrder != CACHE_BYTE_ORDER)
+        {
+            why = "was written on a machine with the other byte order";
+        }
+        else if (header.version != CACHE_VERSION)
+        {
+            why = "was written by a different version";
+        }
+    }
+
+    // What it'd take to hold what the header says it does, guarding against
+    // counts big enough to wrap.
+    uint64_t expected = 0;
+    if (why == nullptr)
+    {
+        if (  header.rows        > size
+           || header.strings     > size
+           || header.stringBytes > size
+           )
+        {
+            why = "is cut short";
+        }
+        else
+        {
+            expected = sizeof( header )
+                     + ( header.strings + 1 ) * sizeof( uint64_t )
+                     + padded( (size_t)header.stringBytes )
+                     + padded( (size_t)header.rows * sizeof( uint32_t ) * CACHE_TEXT_COUNT )
+                     + header.rows * sizeof( int64_t ) * CACHE_NUMBER_COUNT
+                     + padded( (size_t)header.rows * CACHE_NUMBER_COUNT )
+                     + padded( (size_t)header.rows );
+            if (expected != size)
+            {
+                why = "is cut short";
+            }
+        }
+    }
+
+    if (why != nullptr)
+    {
+        error = std::string( "ERROR: Cache file...\n" )
+              + filename
+              + "\n..." + why + "\n";
+        m_file.close();
+        return false;
+    }
+
+    m_rows    = (size_t)header.rows;
+    m_strings = (size_t)header.strings;
+
+    const char * p = data + sizeof( header );
+
+    m_offsets    = (const uint64_t *)p;          p += ( m_strings + 1 ) * sizeof( uint64_t );
+    m_stringData = p;                            p += padded( (size_t)header.stringBytes );
+    for (int i = 0; i < CACHE_TEXT_COUNT; i++)
+    {
+        m_text[i] = (const uint32_t *)p;         p += m_rows * sizeof( uint32_t );
+    }
+    p = data + padded( (size_t)( p - data ) );
+    for (int i = 0; i < CACHE_NUMBER_COUNT; i++)
+    {
+        m_values[i] = (const int64_t *)p;        p += m_rows * sizeof( int64_t );
+    }
+    for (int i = 0; i < CACHE_NUMBER_COUNT; i++)
+    {
+        m_digits[i] = (const uint8_t *)p;        p += m_rows;
+    }
+    p = data + padded( (size_t)( p - data ) );
+    m_flags = (const uint8_t *)p;
+
+    // A string table that points outside itself would read anywhere.
+    for (size_t i = 0; i < m_strings; i++)
+    {
+        if (  m_offsets[i] > m_offsets[i + 1]
+           || m_offsets[i + 1] > header.stringBytes
+           )
+        {
+            error = std::string( "ERROR: Cache file...\n" )
+                  + filename
+                  + "\n...has a broken string table\n";
+            m_file.close();
+            return false;
+        }
+    }
+    return true;
+
+} // ColumnCache::open()
+
+FieldView ColumnCache::string( uint32_t id ) const
+{
+    FieldView text = { "", 0, false };
+
+    if (  id > 0
+       && id < m_strings
+       )
+    {
+        text.ptr = m_stringData + m_offsets[id];
+        text.len = (size_t)( m_offsets[id + 1] - m_offsets[id] );
+    }
+    return text;
+}
+
+static void addLine( TransactionLine * & line
+                   , char                fieldID
+                   , const FieldView   & text
+                   , const char        * prefix = ""
+                   )
+{
+    if (text.len == 0)
+    {
+        return;
+    }
+    line->fieldID   = fieldID;
+    line->prefix    = prefix;
+    line->prefixLen = strlen( prefix );
+    line->text      = text;
+    line++;
+}
+
+void ColumnCache::replay( TransactionSink & sink ) const
+{
+    // The layout replayed rows come in, for whoever cares.
+    static const char * NAMES[] = { "Date", "Memo", "Security", "Amount", "Price", "Quantity", "Action", "Commission", "Cleared", "Transfer Account", "Amount Transfered" };
+    static const char   CODES[] = { FIELD_ID_DATE, FIELD_ID_MEMO, FIELD_ID_SECURITY, FIELD_ID_AMOUNT, FIELD_ID_PRICE, FIELD_ID_QUANTITY, FIELD_ID_ACTION, FIELD_ID_COMMISSION, FIELD_ID_CLEARED, FIELD_ID_TXFR_ACCT, FIELD_ID_TXFR_AMNT };
+
+    const size_t LINES = sizeof( CODES );
+
+    HeaderMap header;
+    header.columnCount     = (int)LINES;
+    header.columnName.assign( NAMES, NAMES + LINES );
+    header.fieldID   .assign( CODES, CODES + LINES );
+    header.commissionFound = true;
+    header.clearedFound    = true;
+    header.actionFound     = true;
+    header.txfrAcctFound   = true;
+    header.txfrAmtFound    = true;
+    header.prePendSF       = false;
+    for (size_t row = 0; row < m_rows; row++)
+    {
+        header.prePendSF = header.prePendSF || ( m_flags[row] & CACHE_SF_PREFIX ) != 0;
+    }
+
+    Transaction t;
+    t.lines.resize( LINES );
+
+    sink.begin( header );
+
+    for (size_t row = 0; row < m_rows; row++)
+    {
+        uint8_t flags = m_flags[row];
+
+        t.date           = string( m_text[CACHE_DATE]      [row] );
+        t.security       = string( m_text[CACHE_SECURITY]  [row] );
+        t.securityPrefix = ( flags & CACHE_SF_PREFIX ) ? SF_PREPEND : "";
+        t.memo           = string( m_text[CACHE_MEMO]      [row] );
+        t.action         = string( m_text[CACHE_ACTION]    [row] );
+        t.commission     = string( m_text[CACHE_COMMISSION][row] );
+        t.cleared        = string( m_text[CACHE_CLEARED]   [row] );
+        t.txfrAcct       = string( m_text[CACHE_TXFR_ACCT] [row] );
+        t.hasAmount      = ( flags & CACHE_HAS_AMOUNT ) != 0;
+        t.hasPrice       = ( flags & CACHE_HAS_PRICE  ) != 0;
+        t.hasUnits       = ( flags & CACHE_HAS_UNITS  ) != 0;
+
+        struct
+        {
+            CacheNumber column;
+            CacheText   textColumn;
+            int         scale;
+            bool        has;
+            Decimal   * value;
+            FieldView * line;
+            char      * storage;
+        }
+        numbers[CACHE_NUMBER_COUNT] =
+        {
+            { CACHE_AMOUNT, CACHE_AMOUNT_TEXT, AMOUNT_SCALE,   t.hasAmount, &t.amount, &t.amountLine, t.amountText },
+            { CACHE_PRICE,  CACHE_PRICE_TEXT,  PRICE_SCALE,    t.hasPrice,  &t.price,  &t.priceLine,  t.priceText  },
+            { CACHE_UNITS,  CACHE_UNITS_TEXT,  QUANTITY_SCALE, t.hasUnits,  &t.units,  &t.unitsLine,  t.unitsText  }
+        };
+
+        for (auto & n : numbers)
+        {
+            uint32_t textID = m_text[n.textColumn][row];
+
+            n.value->value  = m_values[n.column][row];
+            n.value->digits = m_digits[n.column][row];
+            n.value->plain  = textID == 0;
+
+            if (textID != 0)
+            {
+                *n.line = string( textID );
+            }
+            else if (n.has)
+            {
+                n.line->ptr     = n.storage;
+                n.line->len     = formatDecimal( n.value->value, n.scale, n.value->digits, n.storage );
+                n.line->escaped = false;
+            }
+            else
+            {
+                *n.line = string( 0 );
+            }
+        } // for each number
+
+        t.txfrAmount = ( flags & CACHE_TXFR_IS_AMOUNT ) ? t.amountLine : string( m_text[CACHE_TXFR_AMOUNT][row] );
+
+        TransactionLine * line = t.lines.data();
+
+        addLine( line, FIELD_ID_DATE,       t.date );
+        addLine( line, FIELD_ID_MEMO,       t.memo );
+        addLine( line, FIELD_ID_SECURITY,   t.security, t.securityPrefix );
+        addLine( line, FIELD_ID_AMOUNT,     t.amountLine );
+        addLine( line, FIELD_ID_PRICE,      t.priceLine );
+        addLine( line, FIELD_ID_QUANTITY,   t.unitsLine );
+        addLine( line, FIELD_ID_ACTION,     t.action );
+        addLine( line, FIELD_ID_COMMISSION, t.commission );
+        addLine( line, FIELD_ID_CLEARED,    t.cleared );
+        addLine( line, FIELD_ID_TXFR_ACCT,  t.txfrAcct );
+        addLine( line, FIELD_ID_TXFR_AMNT,  t.txfrAmount );
+        t.lineCount = (size_t)( line - t.lines.data() );
+
+        sink.transaction( t );
+    } // for each row
+
+    sink.end();
+
+} // ColumnCache::replay()
@@ -0,0 +1,166 @@
+/*===========================================================================*
+ ColumnCache.h :
+ Converted transactions as a columnar binary file, so they can be read
+ again - by us, to write them out in another format, or by anything else
+ that wants the numbers - without parsing the CSV.
+
+ ColumnCacheSink writes one: a column per field of the Transaction, the
+ numbers as fixed point, the text as IDs into one string table, so a
+ fund or activity type that turns up on every row is stored once.
+ ColumnCache memory maps it back and either hands out the columns as is
+ or replays the rows into a TransactionSink.
+
+ The layout (native byte order, checked when it's opened) is a
+ CacheHeader, then, each padded to a multiple of 8 bytes:
+
+     uint64_t offset[strings + 1]       string i is text[offset[i], offset[i+1])
+     char     text  [stringBytes]
+     uint32_t ID    [CACHE_TEXT_COUNT]  [rows]     0 is ""
+     int64_t  value [CACHE_NUMBER_COUNT][rows]     scaled like Transaction's
+     uint8_t  digits[CACHE_NUMBER_COUNT][rows]
+     uint8_t  flags [rows]                         CACHE_HAS_AMOUNT...
+
+ The sink keeps the columns in memory until end(), about 70 bytes a row
+ plus the distinct strings.
+
+ Replayed rows come out as if the export had the State Farm layout -
+ date, memo, security, amount, price, units, then the derived fields -
+ which for a State Farm export is exactly what converting it wrote.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.h"
+#include "QifWriter.h"
+#include "Transaction.h"
+
+#define CACHE_EXTENSION        ".txcache"
+
+enum CacheText
+{
+    CACHE_DATE,
+    CACHE_SECURITY,             // without the prefix
+    CACHE_MEMO,
+    CACHE_ACTION,
+    CACHE_COMMISSION,
+    CACHE_CLEARED,
+    CACHE_TXFR_ACCT,
+    CACHE_TXFR_AMOUNT,          // unless CACHE_TXFR_IS_AMOUNT
+    CACHE_AMOUNT_TEXT,          // a number line's text, if it isn't just the
+    CACHE_PRICE_TEXT,           // value with its digits (or didn't parse)
+    CACHE_UNITS_TEXT,
+
+    CACHE_TEXT_COUNT
+};
+
+enum CacheNumber
+{
+    CACHE_AMOUNT,
+    CACHE_PRICE,
+    CACHE_UNITS,
+
+    CACHE_NUMBER_COUNT
+};
+
+enum CacheFlag
+{
+    CACHE_HAS_AMOUNT     = 0x01,
+    CACHE_HAS_PRICE      = 0x02,
+    CACHE_HAS_UNITS      = 0x04,
+    CACHE_SF_PREFIX      = 0x08,    // security names get SF_PREPEND
+    CACHE_TXFR_IS_AMOUNT = 0x10     // the $ line is the T line's text
+};
+
+struct CacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;             // CACHE_BYTE_ORDER as it was written
+    uint64_t rows;
+    uint64_t strings;               // including ""
+    uint64_t stringBytes;
+};
+
+class ColumnCacheSink : public TransactionSink
+{
+public:
+    ColumnCacheSink( QifWriter & writer );
+
+    void transaction( const Transaction & transaction ) override;
+    void end        () override;
+
+private:
+    ColumnCacheSink           ( const ColumnCacheSink & );    // not copyable
+    ColumnCacheSink & operator=( const ColumnCacheSink & );
+
+    uint32_t intern( const FieldView & text );
+    void     number( CacheNumber       column
+                   , CacheText         textColumn
+                   , const Decimal   & value
+                   , bool              has
+                   , const FieldView & line
+                   , int               scale
+                   );
+
+    QifWriter                                 & m_writer;
+    std::unordered_map<std::string, uint32_t>   m_ids;
+    std::vector<uint64_t>                       m_offsets;
+    std::string                                 m_strings;
+    std::string                                 m_key;
+
+    std::vector<uint32_t>                       m_text  [CACHE_TEXT_COUNT];
+    std::vector<int64_t>                        m_values[CACHE_NUMBER_COUNT];
+    std::vector<uint8_t>                        m_digits[CACHE_NUMBER_COUNT];
+    std::vector<uint8_t>                        m_flags;
+
+}; // class ColumnCacheSink
+
+class ColumnCache
+{
+public:
+    ColumnCache();
+
+    // Map filename.  On failure error says why.
+    bool            open   ( const char  * filename
+                           , std::string & error
+                           );
+
+    size_t          rows   () const { return m_rows; }
+    size_t          bytes  () const { return m_file.size(); }
+
+    const uint32_t * text  ( CacheText   column ) const { return m_text[column]; }
+    const int64_t  * values( CacheNumber column ) const { return m_values[column]; }
+    const uint8_t  * digits( CacheNumber column ) const { return m_digits[column]; }
+    const uint8_t  * flags () const { return m_flags; }
+
+    // String id; "" for 0 (or anything out of range).
+    FieldView       string ( uint32_t id ) const;
+
+    // Send every row to sink as a Transaction, begin() to end().
+    void            replay ( TransactionSink & sink ) const;
+
+    // Is this a cache file's name?
+    static bool     isCacheFile( const std::string & filename );
+
+private:
+    ColumnCache           ( const ColumnCache & );    // not copyable
+    ColumnCache & operator=( const ColumnCache & );
+
+    MappedFile       m_file;
+    size_t           m_rows;
+    size_t           m_strings;
+    const uint64_t * m_offsets;
+    const char     * m_stringData;
+    const uint32_t * m_text  [CACHE_TEXT_COUNT];
+    const int64_t  * m_values[CACHE_NUMBER_COUNT];
+    const uint8_t  * m_digits[CACHE_NUMBER_COUNT];
+    const uint8_t  * m_flags;
+
+}; // class ColumnCache
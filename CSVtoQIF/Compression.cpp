@@ -0,0 +1,547 @@
+/*===========================================================================*
+ Compression.cpp :
+ Reading files that might be compressed, and the compressors QifWriter
+ uses.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "Compression.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+
+#ifdef    _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif // _WIN32
+
+#ifdef    CSVTOQIF_ZLIB
+#include <zlib.h>
+#endif // CSVTOQIF_ZLIB
+
+#ifdef    CSVTOQIF_ZSTD
+#include <zstd.h>
+#endif // CSVTOQIF_ZSTD
+
+#include "HeaderMap.h"
+
+static const unsigned char GZIP_MAGIC[] = { 0x1F, 0x8B };
+static const unsigned char ZSTD_MAGIC[] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+// What a compressor grows its output by at a time.
+const size_t COMPRESSED_CHUNK = 64 << 10;
+
+static bool endsWith( const std::string & name
+                    , const char        * extension
+                    )
+{
+    size_t extLen = strlen( extension );
+
+    return name.size() > extLen
+        && equalsNoCase( name.c_str() + name.size() - extLen, extension );
+}
+
+Compression compressionOf( const std::string & filename )
+{
+    return endsWith( filename, GZIP_EXTENSION ) ? COMPRESSION_GZIP
+         : endsWith( filename, ZSTD_EXTENSION ) ? COMPRESSION_ZSTD
+         :                                        COMPRESSION_NONE;
+}
+
+bool compressionNamed( const char  * name
+                     , Compression & compression
+                     )
+{
+    if (  equalsNoCase( name, "gz"   )
+       || equalsNoCase( name, "gzip" )
+       )
+    {
+        compression = COMPRESSION_GZIP;
+        return true;
+    }
+    if (  equalsNoCase( name, "zst"  )
+       || equalsNoCase( name, "zstd" )
+       )
+    {
+        compression = COMPRESSION_ZSTD;
+        return true;
+    }
+    return false;
+}
+
+const char * compressionExtension( Compression compression )
+{
+    return compression == COMPRESSION_GZIP ? GZIP_EXTENSION
+         : compression == COMPRESSION_ZSTD ? ZSTD_EXTENSION
+         :                                   "";
+}
+
+bool compressionBuiltIn( Compression compression )
+{
+    switch (compression)
+    {
+    case COMPRESSION_NONE:
+        return true;
+
+    case COMPRESSION_GZIP:
+        #ifdef    CSVTOQIF_ZLIB
+        return true;
+        #else
+        return false;
+        #endif // CSVTOQIF_ZLIB
+
+    case COMPRESSION_ZSTD:
+        #ifdef    CSVTOQIF_ZSTD
+        return true;
+        #else
+        return false;
+        #endif // CSVTOQIF_ZSTD
+    }
+    return false;
+}
+
+/*---------------------------------------------------------------------------*
+ InputStream::Codec :
+ A decompressor, a piece at a time.
+ *---------------------------------------------------------------------------*/
+struct InputStream::Codec
+{
+    virtual ~Codec() {}
+
+    // Decompress from in into out; used and made say how much of each.
+    // False if the data's corrupt.
+    virtual bool run    ( const char * in
+                        , size_t       inLen
+                        , size_t     & used
+                        , char       * out
+                        , size_t       outLen
+                        , size_t     & made
+                        ) = 0;
+
+    // Between gzip members or zstd frames, so the input may end here.
+    virtual bool between() const = 0;
+};
+
+#ifdef    CSVTOQIF_ZLIB
+struct GzipCodec : public InputStream::Codec
+{
+    z_stream stream;
+    bool     ended;
+
+    GzipCodec() : ended( false )
+    {
+        memset( &stream, 0, sizeof( stream ) );
+        inflateInit2( &stream, 15 + 16 );   // gzip wrapper only
+    }
+    ~GzipCodec() { inflateEnd( &stream ); }
+
+    bool run( const char * in
+            , size_t       inLen
+            , size_t     & used
+            , char       * out
+            , size_t       outLen
+            , size_t     & made
+            ) override
+    {
+        stream.next_in   = (Bytef *)in;
+        stream.avail_in  = (uInt)( inLen  < UINT_MAX ? inLen  : UINT_MAX );
+        stream.next_out  = (Bytef *)out;
+        stream.avail_out = (uInt)( outLen < UINT_MAX ? outLen : UINT_MAX );
+
+        uInt inBefore  = stream.avail_in;
+        uInt outBefore = stream.avail_out;
+        int  result    = inflate( &stream, Z_NO_FLUSH );
+
+        used = inBefore  - stream.avail_in;
+        made = outBefore - stream.avail_out;
+
+        if (result == Z_STREAM_END)
+        {
+            inflateReset( &stream );        // another member may follow
+            ended = true;
+            return true;
+        }
+        if (used > 0 || made > 0)
+        {
+            ended = false;
+        }
+        return result == Z_OK
+            || result == Z_BUF_ERROR;       // just no progress this time
+    }
+
+    bool between() const override { return ended; }
+};
+#endif // CSVTOQIF_ZLIB
+
+#ifdef    CSVTOQIF_ZSTD
+struct ZstdCodec : public InputStream::Codec
+{
+    ZSTD_DStream * stream;
+    bool           ended;
+
+    ZstdCodec() : stream( ZSTD_createDStream() ), ended( false )
+    {
+        ZSTD_initDStream( stream );
+    }
+    ~ZstdCodec() { ZSTD_freeDStream( stream ); }
+
+    bool run( const char * in
+            , size_t       inLen
+            , size_t     & used
+            , char       * out
+            , size_t       outLen
+            , size_t     & made
+            ) override
+    {
+        ZSTD_inBuffer  input  = { in,  inLen,  0 };
+        ZSTD_outBuffer output = { out, outLen, 0 };
+        size_t         result = ZSTD_decompressStream( stream, &output, &input );
+
+        used = input.pos;
+        made = output.pos;
+        if (ZSTD_isError( result ))
+        {
+            return false;
+        }
+        ended = result == 0;                // frame done and flushed
+        return true;
+    }
+
+    bool between() const override { return ended; }
+};
+#endif // CSVTOQIF_ZSTD
+
+/*---------------------------------------------------------------------------*
+ InputStream
+ *---------------------------------------------------------------------------*/
+InputStream::InputStream()
+    : m_fd         ( -1 )
+    , m_ownsFd     ( false )
+    , m_compression( COMPRESSION_NONE )
+    , m_rawStart   ( 0 )
+    , m_rawEnd     ( 0 )
+    , m_rawDone    ( false )
+{
+}
+
+InputStream::~InputStream()
+{
+    if (m_ownsFd)
+    {
+        #ifdef    _WIN32
+        _close( m_fd );
+        #else
+        ::close( m_fd );
+        #endif // _WIN32
+    }
+}
+
+bool InputStream::open( const char  * filename
+                      , std::string & error
+                      )
+{
+    m_filename = filename;
+
+    if (strcmp( filename, STANDARD_STREAM ) == 0)
+    {
+        m_fd       = 0;
+        m_ownsFd   = false;
+        m_filename = "stdin";
+        #ifdef    _WIN32
+        _setmode( m_fd, _O_BINARY );
+        #endif // _WIN32
+    }
+    else
+    {
+        #ifdef    _WIN32
+        m_fd = _open( filename, _O_RDONLY | _O_BINARY );
+        #else
+        m_fd = ::open( filename, O_RDONLY );
+        #endif // _WIN32
+        m_ownsFd = m_fd >= 0;
+    }
+    if (m_fd < 0)
+    {
+        error = std::string( "ERROR: Input file...\n" )
+              + filename
+              + "\n...not found\n";
+        return false;
+    }
+
+    // Enough to see the magic number, if there is one.
+    m_raw.resize( COMPRESSED_READ_SIZE );
+    while (  m_rawEnd < sizeof( ZSTD_MAGIC )
+          && !m_rawDone
+          )
+    {
+        if (!fillRaw())
+        {
+            error = m_error;
+            return false;
+        }
+    }
+
+    const unsigned char * start = (const unsigned char *)m_raw.data();
+    if (  m_rawEnd >= sizeof( GZIP_MAGIC )
+       && memcmp( start, GZIP_MAGIC, sizeof( GZIP_MAGIC ) ) == 0
+       )
+    {
+        m_compression = COMPRESSION_GZIP;
+    }
+    else if (  m_rawEnd >= sizeof( ZSTD_MAGIC )
+            && memcmp( start, ZSTD_MAGIC, sizeof( ZSTD_MAGIC ) ) == 0
+            )
+    {
+        m_compression = COMPRESSION_ZSTD;
+    }
+
+    #ifdef    CSVTOQIF_ZLIB
+    if (m_compression == COMPRESSION_GZIP) m_codec.reset( new GzipCodec );
+    #endif // CSVTOQIF_ZLIB
+    #ifdef    CSVTOQIF_ZSTD
+    if (m_compression == COMPRESSION_ZSTD) m_codec.reset( new ZstdCodec );
+    #endif // CSVTOQIF_ZSTD
+
+    if (  m_compression != COMPRESSION_NONE
+       && !m_codec
+       )
+    {
+        error = "ERROR: Input file...\n" + m_filename + "\n...is "
+              + ( m_compression == COMPRESSION_GZIP ? "gzip" : "zstd" )
+              + " compressed, and this build can't read that.\n";
+        return false;
+    }
+    return true;
+
+} // InputStream::open()
+
+// Move what's left of m_raw to the front and read more after it.
+bool InputStream::fillRaw()
+{
+    memmove( m_raw.data(), m_raw.data() + m_rawStart, m_rawEnd - m_rawStart );
+    m_rawEnd  -= m_rawStart;
+    m_rawStart = 0;
+
+    for (;;)
+    {
+        #ifdef    _WIN32
+        int got = _read( m_fd, m_raw.data() + m_rawEnd, (unsigned int)( m_raw.size() - m_rawEnd ) );
+        #else
+        ssize_t got = ::read( m_fd, m_raw.data() + m_rawEnd, m_raw.size() - m_rawEnd );
+        #endif // _WIN32
+
+        if (got > 0)
+        {
+            m_rawEnd += (size_t)got;
+            return true;
+        }
+        if (got == 0)
+        {
+            m_rawDone = true;
+            return true;
+        }
+        if (errno != EINTR)
+        {
+            m_error = "ERROR: Can't read...\n" + m_filename + "\n..." + strerror( errno ) + "\n";
+            return false;
+        }
+    }
+}
+
+size_t InputStream::read( char   * dest
+                        , size_t   len
+                        )
+{
+    while (m_error.empty())
+    {
+        size_t used = 0;
+        size_t made = 0;
+
+        if (!m_codec)
+        {
+            made = m_rawEnd - m_rawStart < len ? m_rawEnd - m_rawStart : len;
+            memcpy( dest, m_raw.data() + m_rawStart, made );
+            used = made;
+        }
+        else if (!m_codec->run( m_raw.data() + m_rawStart, m_rawEnd - m_rawStart, used, dest, len, made ))
+        {
+            m_error = "ERROR: Input file...\n" + m_filename + "\n...is corrupt; it doesn't decompress.\n";
+            return 0;
+        }
+        m_rawStart += used;
+
+        if (made > 0)
+        {
+            return made;
+        }
+        if (used > 0)
+        {
+            continue;
+        }
+
+        // Nothing doing without more input.
+        if (m_rawDone)
+        {
+            if (  m_codec
+               && !m_codec->between()
+               )
+            {
+                m_error = "ERROR: Input file...\n" + m_filename + "\n...ends part way through; it's been cut short.\n";
+            }
+            return 0;
+        }
+        fillRaw();
+    }
+    return 0;
+
+} // InputStream::read()
+
+/*---------------------------------------------------------------------------*
+ Compressors
+ *---------------------------------------------------------------------------*/
+#ifdef    CSVTOQIF_ZLIB
+class GzipCompressor : public Compressor
+{
+public:
+    GzipCompressor()
+    {
+        memset( &m_stream, 0, sizeof( m_stream ) );
+        deflateInit2( &m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY );
+    }
+    ~GzipCompressor() { deflateEnd( &m_stream ); }
+
+    bool write( const char        * data
+              , size_t              len
+              , std::vector<char> & out
+              ) override
+    {
+        while (len > 0)
+        {
+            uInt piece = (uInt)( len < UINT_MAX ? len : UINT_MAX );
+
+            m_stream.next_in  = (Bytef *)data;
+            m_stream.avail_in = piece;
+            if (!run( Z_NO_FLUSH, out ))
+            {
+                return false;
+            }
+            data += piece;
+            len  -= piece;
+        }
+        return true;
+    }
+
+    bool finish( std::vector<char> & out ) override
+    {
+        m_stream.next_in  = nullptr;
+        m_stream.avail_in = 0;
+        return run( Z_FINISH, out );
+    }
+
+private:
+    bool run( int                 flush
+            , std::vector<char> & out
+            )
+    {
+        int result;
+        do
+        {
+            size_t at = out.size();
+
+            out.resize( at + COMPRESSED_CHUNK );
+            m_stream.next_out  = (Bytef *)out.data() + at;
+            m_stream.avail_out = (uInt)COMPRESSED_CHUNK;
+            result = deflate( &m_stream, flush );
+            out.resize( at + COMPRESSED_CHUNK - m_stream.avail_out );
+
+            if (result == Z_STREAM_ERROR)
+            {
+                return false;
+            }
+        } while (  m_stream.avail_in > 0
+                || m_stream.avail_out == 0
+                || (  flush == Z_FINISH
+                   && result != Z_STREAM_END
+                   )
+                );
+        return true;
+    }
+
+    z_stream m_stream;
+};
+#endif // CSVTOQIF_ZLIB
+
+#ifdef    CSVTOQIF_ZSTD
+class ZstdCompressor : public Compressor
+{
+public:
+    ZstdCompressor() : m_stream( ZSTD_createCCtx() ) {}
+    ~ZstdCompressor() { ZSTD_freeCCtx( m_stream ); }
+
+    bool write( const char        * data
+              , size_t              len
+              , std::vector<char> & out
+              ) override
+    {
+        ZSTD_inBuffer input = { data, len, 0 };
+
+        while (input.pos < input.size)
+        {
+            if (run( input, ZSTD_e_continue, out ) == (size_t)-1)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool finish( std::vector<char> & out ) override
+    {
+        ZSTD_inBuffer input = { nullptr, 0, 0 };
+        size_t        left;
+
+        do
+        {
+            left = run( input, ZSTD_e_end, out );
+        } while (left != 0 && left != (size_t)-1);
+        return left == 0;
+    }
+
+private:
+    // What's left to flush, or -1 on an error.
+    size_t run( ZSTD_inBuffer     & input
+              , ZSTD_EndDirective   mode
+              , std::vector<char> & out
+              )
+    {
+        size_t at = out.size();
+
+        out.resize( at + COMPRESSED_CHUNK );
+        ZSTD_outBuffer output = { out.data() + at, COMPRESSED_CHUNK, 0 };
+        size_t         left   = ZSTD_compressStream2( m_stream, &output, &input, mode );
+        out.resize( at + output.pos );
+
+        return ZSTD_isError( left ) ? (size_t)-1 : left;
+    }
+
+    ZSTD_CCtx * m_stream;
+};
+#endif // CSVTOQIF_ZSTD
+
+Compressor * Compressor::create( Compression compression )
+{
+    switch (compression)
+    {
+    #ifdef    CSVTOQIF_ZLIB
+    case COMPRESSION_GZIP: return new GzipCompressor;
+    #endif // CSVTOQIF_ZLIB
+    #ifdef    CSVTOQIF_ZSTD
+    case COMPRESSION_ZSTD: return new ZstdCompressor;
+    #endif // CSVTOQIF_ZSTD
+    default:               return nullptr;
+    }
+}
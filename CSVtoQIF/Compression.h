@@ -0,0 +1,116 @@
+/*===========================================================================*
+ Compression.h :
+ gzip and zstd, for exports that are archived compressed and QIF files
+ that are wanted that way.
+
+ InputStream reads a file - or stdin, for "-" - and, if it starts with
+ the gzip or zstd magic number, decompresses it as it goes, whatever the
+ file is called.  Concatenated gzip members and zstd frames are read one
+ after the other, as gunzip and unzstd would.  Compressor is the other way
+ round, for QifWriter: what goes in comes out compressed, a piece at a
+ time.
+
+ Which codecs there are depends on the build: CSVTOQIF_ZLIB for gzip and
+ CSVTOQIF_ZSTD for zstd, each defined by CMake when it finds the library.
+ Without one, files that need it fail with an error saying so.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum Compression
+{
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+};
+
+#define GZIP_EXTENSION         ".gz"
+#define ZSTD_EXTENSION         ".zst"
+
+// Means stdin as an input name, stdout as an output name.
+#define STANDARD_STREAM        "-"
+
+// Raw bytes InputStream reads at a time.
+const size_t COMPRESSED_READ_SIZE = 256 << 10;
+
+// The compression filename's extension says, COMPRESSION_NONE if none.
+Compression compressionOf       ( const std::string & filename );
+
+// "gz", "zst" - for -z (--compress) and messages.  Returns false if name
+// isn't one.
+bool        compressionNamed    ( const char        * name
+                                , Compression       & compression
+                                );
+const char *compressionExtension( Compression compression );
+bool        compressionBuiltIn  ( Compression compression );
+
+/*---------------------------------------------------------------------------*
+ InputStream
+ *---------------------------------------------------------------------------*/
+class InputStream
+{
+public:
+    struct Codec;                           // see Compression.cpp
+
+    InputStream();
+    ~InputStream();
+
+    bool                open       ( const char  * filename
+                                   , std::string & error
+                                   );
+
+    // Up to len bytes of the input, decompressed; 0 at the end, or if
+    // something went wrong, when error() says what.
+    size_t              read       ( char   * dest
+                                   , size_t   len
+                                   );
+
+    Compression         compression() const { return m_compression; }
+    const std::string & error      () const { return m_error; }
+
+private:
+    InputStream           ( const InputStream & );  // not copyable
+    InputStream & operator=( const InputStream & );
+
+    bool                fillRaw    ();
+
+    int                   m_fd;
+    bool                  m_ownsFd;         // not stdin
+    std::string           m_filename;
+    Compression           m_compression;
+    std::unique_ptr<Codec> m_codec;
+    std::vector<char>     m_raw;            // read, not decompressed yet
+    size_t                m_rawStart;
+    size_t                m_rawEnd;
+    bool                  m_rawDone;        // read() hit the end of the file
+    std::string           m_error;
+
+}; // class InputStream
+
+/*---------------------------------------------------------------------------*
+ Compressor
+ *---------------------------------------------------------------------------*/
+class Compressor
+{
+public:
+    virtual ~Compressor() {}
+
+    // Compress len bytes of data, adding whatever comes of it to out.
+    virtual bool write ( const char        * data
+                       , size_t              len
+                       , std::vector<char> & out
+                       ) = 0;
+
+    // Nothing more to come: add the rest to out.
+    virtual bool finish( std::vector<char> & out ) = 0;
+
+    // nullptr for COMPRESSION_NONE, or if it isn't built in.
+    static Compressor * create( Compression compression );
+
+}; // class Compressor
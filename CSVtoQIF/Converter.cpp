@@ -0,0 +1,213 @@
+/*===========================================================================*
+ Converter.cpp :
+ Feeding an export through CsvReader a piece at a time.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "Converter.h"
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------*
+ findRowEnd() :
+ Offset just past the first newline in data that isn't inside quotes, or
+ size if there isn't one.  quoted says whether data starts inside quotes,
+ and is left saying whether the part looked at ends inside them.
+ *---------------------------------------------------------------------------*/
+static size_t findRowEnd( const char * data
+                        , size_t       size
+                        , bool       & quoted
+                        )
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (data[i] == '"')
+        {
+            quoted = !quoted;
+        }
+        else if (  data[i] == '\n'
+                && !quoted
+                )
+        {
+            return i + 1;
+        }
+    } // for each byte
+
+    return size;
+}
+
+/*---------------------------------------------------------------------------*
+ wholeRows() :
+ Count the quotes, then walk back from the end keeping track of whether
+ each byte is inside them, so only the unfinished row is looked at twice.
+ *---------------------------------------------------------------------------*/
+size_t wholeRows( const char * data
+                , size_t       size
+                )
+{
+    bool quoted = false;
+
+    for (const char * p = data; ; p++)
+    {
+        p = (const char *)memchr( p, '"', size - (size_t)( p - data ) );
+        if (p == nullptr)
+        {
+            break;
+        }
+        quoted = !quoted;
+    }
+
+    // quoted is now whether data[0, i) has an odd number of quotes.
+    for (size_t i = size; i > 0; i--)
+    {
+        if (data[i - 1] == '"')
+        {
+            quoted = !quoted;
+        }
+        else if (  data[i - 1] == '\n'
+                && !quoted
+                )
+        {
+            return i;
+        }
+    }
+    return 0;
+
+} // wholeRows()
+
+Converter::Converter( TransactionSink & sink )
+    : m_sink       ( sink )
+    , m_hasHeader  ( false )
+    , m_finished   ( false )
+    , m_rows       ( 0 )
+    , m_carryQuoted( false )
+{
+}
+
+/*---------------------------------------------------------------------------*
+ convertRows() :
+ Convert the rows in data, which starts at the start of a row.  Unless
+ it's the last of the input, a final row with no newline may not be
+ finished, so it's left alone.  Returns how much of data was used.
+ *---------------------------------------------------------------------------*/
+size_t Converter::convertRows( const char * data
+                             , size_t       size
+                             , bool         last
+                             )
+{
+    CsvReader reader( data, size );
+
+    STATS_MARK( m_checks.stats, mark );
+
+    for (;;)
+    {
+        size_t rowStart = reader.offset();
+
+        if (!reader.nextRow( m_fields ))
+        {
+            break;
+        }
+        if (  !reader.rowEnded()
+           && !last
+           )
+        {
+            return rowStart;
+        }
+        STATS_LAP( m_checks.stats, STAT_PARSE, mark );
+
+        if (!m_hasHeader)
+        {
+            mapHeader( m_fields, m_header );
+            m_hasHeader = true;
+            for (int i = 0; i < m_header.columnCount; i++)
+            {
+                if (m_header.fieldID[i] == FIELD_ID_IGNORE)
+                {
+                    STATS_COUNT( m_checks.stats, STAT_IGNORED_COLUMNS );
+                }
+            }
+            m_sink.begin( m_header );
+            STATS_LAP( m_checks.stats, STAT_HEADER, mark );
+        }
+        else
+        {
+            bool keep = makeTransaction( m_header, m_fields, m_transaction, m_checks );
+
+            STATS_LAP( m_checks.stats, STAT_DERIVE, mark );
+            if (keep)
+            {
+                // The sink times itself, if it cares to.
+                m_sink.transaction( m_transaction );
+                STATS_RESTART( m_checks.stats, mark );
+            }
+            m_rows++;
+        }
+    } // for each row
+
+    return size;
+
+} // Converter::convertRows()
+
+void Converter::feed( const char * data
+                    , size_t       size
+                    )
+{
+    if (!m_carry.empty())
+    {
+        // Finish off the row the last piece cut short first.
+        size_t rowEnd = findRowEnd( data, size, m_carryQuoted );
+
+        m_carry.insert( m_carry.end(), data, data + rowEnd );
+        data += rowEnd;
+        size -= rowEnd;
+
+        if (size == 0)
+        {
+            // Still might not be finished - see what there is.
+            size_t used = convertRows( m_carry.data(), m_carry.size(), false );
+            m_carry.erase( m_carry.begin(), m_carry.begin() + used );
+            return;
+        }
+
+        convertRows( m_carry.data(), m_carry.size(), false );
+        m_carry.clear();
+        m_carryQuoted = false;
+    } // if there's a row to finish
+
+    size_t used = convertRows( data, size, false );
+
+    if (used < size)
+    {
+        m_carry.assign( data + used, data + size );
+
+        // It doesn't end a row, so it's inside quotes if it has an odd
+        // number of them.
+        m_carryQuoted = false;
+        for (size_t i = used; i < size; i++)
+        {
+            if (data[i] == '"')
+            {
+                m_carryQuoted = !m_carryQuoted;
+            }
+        }
+    }
+
+} // Converter::feed()
+
+void Converter::finish()
+{
+    if (m_finished)
+    {
+        return;
+    }
+    m_finished = true;
+
+    if (!m_carry.empty())
+    {
+        convertRows( m_carry.data(), m_carry.size(), true );
+        m_carry.clear();
+        m_carryQuoted = false;
+    }
+    m_sink.end();
+}
@@ -0,0 +1,82 @@
+/*===========================================================================*
+ Converter.h :
+ The converter as a library: push an export in, get Transactions out.
+
+ feed() takes the export in whatever pieces it arrives in - a socket read,
+ a decompressor's output, a whole mapped file - and converts every row it
+ completes.  A row cut off at the end of one piece is held in a carry
+ buffer until the piece that finishes it turns up, so pieces can split
+ rows, fields, quoted newlines and CR LF pairs anywhere.  finish() says
+ there's nothing more coming and converts whatever's left.
+
+ The first row is the header (see HeaderMap.h); every row after it goes to
+ the sink as a Transaction.  The field vector, the Transaction and the
+ carry buffer are all reused, so once they've grown to fit the export
+ nothing is allocated per row.
+
+ A Converter is for one export on one thread.  Separate Converters share
+ nothing but the header profile, the action rules and a DedupIndex, all
+ only read while converting, so any number can run at once.  To send one
+ parse to several outputs, give it a FanOutSink.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "CsvReader.h"
+#include "HeaderMap.h"
+#include "QifRows.h"
+#include "Transaction.h"
+
+// How much of data, which starts at the start of a row, is whole rows -
+// up to and including the last newline that isn't inside quotes.
+size_t wholeRows( const char * data
+                , size_t       size
+                );
+
+class Converter
+{
+public:
+    Converter( TransactionSink & sink );
+
+    // Counts of what was wrong with the rows, and the dedup settings -
+    // set those before the first feed().
+    RowChecks       & checks   ()       { return m_checks; }
+
+    void              feed     ( const char * data
+                               , size_t       size
+                               );
+    void              finish   ();
+
+    bool              hasHeader() const { return m_hasHeader; }
+    const HeaderMap & header   () const { return m_header; }
+
+    // Data rows converted, including any left out as duplicates.
+    size_t            rows     () const { return m_rows; }
+
+private:
+    Converter           ( const Converter & );    // not copyable
+    Converter & operator=( const Converter & );
+
+    size_t convertRows( const char * data
+                      , size_t       size
+                      , bool         last
+                      );
+
+    TransactionSink      & m_sink;
+    RowChecks              m_checks;
+    HeaderMap              m_header;
+    bool                   m_hasHeader;
+    bool                   m_finished;
+    size_t                 m_rows;
+
+    std::vector<FieldView> m_fields;
+    Transaction            m_transaction;
+
+    std::vector<char>      m_carry;         // the start of a row not yet complete
+    bool                   m_carryQuoted;   // it ends inside quotes
+
+}; // class Converter
@@ -0,0 +1,167 @@
+/*===========================================================================*
+ CsvReader.cpp :
+ Row/field splitting over an in-memory CSV image.
+
+ The input is classified CSV_BLOCK_SIZE bytes at a time (see CsvScan.h),
+ quoted regions are masked out with a prefix XOR of the quote bits, and
+ what's left is a bitmap of the commas and newlines that really end a
+ field.  Handing out fields is then just counting trailing zeros.
+
+ A trailing CR is dropped from each row so DOS files read the same as they
+ did through a text mode FILE *.  Blank lines are skipped.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "CsvReader.h"
+
+#include <string.h>
+
+size_t csvUnescape( const FieldView & field
+                  , char            * dest
+                  )
+{
+    if (!field.escaped)
+    {
+        memcpy( dest, field.ptr, field.len );
+        return field.len;
+    }
+
+    const char * src = field.ptr;
+    const char * end = field.ptr + field.len;
+    char       * out = dest;
+
+    while (src < end)
+    {
+        char c = *src++;
+        *out++ = c;
+        if (  c   == '"'
+           && src <  end
+           && *src == '"'
+           )
+        {
+            src++;
+        }
+    } // for each character
+
+    return (size_t)( out - dest );
+
+} // csvUnescape()
+
+CsvReader::CsvReader( const char * data
+                    , size_t       size
+                    )
+    : m_begin     ( data )
+    , m_end       ( data + size )
+    , m_fieldStart( data )
+    , m_block     ( data )
+    , m_nextBlock ( 0 )
+    , m_delimiters( 0 )
+    , m_quoteCarry( 0 )
+    , m_rowEnded  ( false )
+{
+}
+
+/*---------------------------------------------------------------------------*
+ nextDelimiter() :
+ Pointer to the next comma or newline that isn't inside quotes, or m_end if
+ there aren't any more.
+ *---------------------------------------------------------------------------*/
+const char * CsvReader::nextDelimiter()
+{
+    while (m_delimiters == 0)
+    {
+        size_t size = (size_t)( m_end - m_begin );
+        if (m_nextBlock >= size)
+        {
+            return m_end;
+        }
+
+        size_t remaining = size - m_nextBlock;
+
+        m_block = m_begin + m_nextBlock;
+
+        CsvBlockMasks masks;
+        if (remaining >= (size_t)CSV_BLOCK_SIZE)
+        {
+            csvClassify( m_block, masks );
+        }
+        else
+        {
+            // Pad the last partial block with NULs, which aren't special.
+            memset( m_tail, 0, sizeof( m_tail ) );
+            memcpy( m_tail, m_block, remaining );
+            csvClassify( m_tail, masks );
+        }
+        m_nextBlock += CSV_BLOCK_SIZE;
+
+        uint64_t inQuotes = csvPrefixXor( masks.quote ) ^ m_quoteCarry;
+
+        m_quoteCarry = (uint64_t)( (int64_t)inQuotes >> 63 );
+        m_delimiters = ( masks.comma | masks.newline ) & ~inQuotes;
+    } // while this block has nothing left
+
+    int bit = csvCountTrailingZeros( m_delimiters );
+
+    m_delimiters &= m_delimiters - 1;
+    return m_block + bit;
+
+} // CsvReader::nextDelimiter()
+
+bool CsvReader::nextRow( std::vector<FieldView> & fields )
+{
+    fields.clear();
+
+    while (m_fieldStart < m_end)
+    {
+        const char * fieldEnd = nextDelimiter();
+        bool         rowEnd   = (  fieldEnd == m_end
+                                || *fieldEnd == '\n'
+                                );
+        FieldView    field    = { m_fieldStart
+                                , (size_t)( fieldEnd - m_fieldStart )
+                                , false
+                                };
+
+        m_fieldStart = ( fieldEnd == m_end ) ? m_end : fieldEnd + 1;
+
+        if (  rowEnd
+           && field.len > 0
+           && field.ptr[field.len - 1] == '\r'
+           )
+        {
+            field.len--;
+        }
+
+        // Lose the quotes, and note whether there are any "" pairs inside.
+        if (  field.len >= 2
+           && field.ptr[0]             == '"'
+           && field.ptr[field.len - 1] == '"'
+           )
+        {
+            field.ptr++;
+            field.len    -= 2;
+            field.escaped = memchr( field.ptr, '"', field.len ) != nullptr;
+        }
+
+        fields.push_back( field );
+
+        if (rowEnd)
+        {
+            m_rowEnded = fieldEnd != m_end;
+            if (  fields.size() == 1
+               && fields[0].len == 0
+               )
+            {
+                fields.clear();     // blank line
+                continue;
+            }
+            return true;
+        }
+    } // while not EOF
+
+    // A last row with no newline at all still counts.
+    m_rowEnded = false;
+    return !fields.empty();
+
+} // CsvReader::nextRow()
@@ -0,0 +1,76 @@
+/*===========================================================================*
+ CsvReader.h :
+ Walks a CSV image in memory (normally a MappedFile) one row at a time and
+ hands back each field as a pointer/length pair into that image.  Nothing
+ is copied and nothing is written, so there's no limit on row length other
+ than the size of the file.
+
+ Quoting follows RFC 4180: a field wrapped in double quotes may contain
+ commas, newlines and doubled ("") quotes.  The surrounding quotes are left
+ out of the view; doubled quotes are left in and flagged so whoever finally
+ copies the text out can collapse them (see csvUnescape()).
+
+ Empty fields are real fields, so column N of the header is always field N
+ of every row.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "CsvScan.h"
+
+/*---------------------------------------------------------------------------*
+ FieldView :
+ One field of one row.  Not NUL terminated - always use len.
+ *---------------------------------------------------------------------------*/
+struct FieldView
+{
+    const char * ptr;
+    size_t       len;
+    bool         escaped;     // contains "" pairs that stand for one "
+};
+
+/*---------------------------------------------------------------------------*
+ csvUnescape() :
+ Copy a field's text to dest, collapsing "" to ".  dest needs room for
+ field.len bytes.  Returns the number of bytes written (no NUL is added).
+ *---------------------------------------------------------------------------*/
+size_t csvUnescape( const FieldView & field
+                  , char            * dest
+                  );
+
+class CsvReader
+{
+public:
+    CsvReader( const char * data
+             , size_t       size
+             );
+
+    // Split the next non-blank row into fields.  Returns false at EOF.
+    bool   nextRow( std::vector<FieldView> & fields );
+
+    // Byte offset of the first row nextRow() hasn't returned yet.
+    size_t offset () const { return (size_t)( m_fieldStart - m_begin ); }
+
+    // Did the row nextRow() last returned end in a newline?  If not it was
+    // the end of the data, which may have cut it short.
+    bool   rowEnded() const { return m_rowEnded; }
+
+private:
+    const char * nextDelimiter();
+
+    const char * m_begin;
+    const char * m_end;
+    const char * m_fieldStart;     // first byte of the field being scanned
+    const char * m_block;          // block m_delimiters came from
+    size_t       m_nextBlock;      // offset of the next block to classify
+    uint64_t     m_delimiters;     // unquoted , and \n not yet handed out
+    uint64_t     m_quoteCarry;     // all ones if the last block ended in quotes
+    bool         m_rowEnded;
+    char         m_tail[CSV_BLOCK_SIZE];   // zero padded final partial block
+
+}; // class CsvReader
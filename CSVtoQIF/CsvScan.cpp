@@ -0,0 +1,224 @@
+/*===========================================================================*
+ CsvScan.cpp :
+ Scalar, SSE2 and AVX2 block classifiers plus the runtime CPU check that
+ picks between them.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "CsvScan.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CSV_SCAN_X86 (1)
+#include <immintrin.h>
+#endif
+
+#if defined(CSV_SCAN_X86) && !defined(_MSC_VER)
+#define CSV_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CSV_TARGET(isa)
+#endif
+
+/*---------------------------------------------------------------------------*
+ Scalar :
+ One byte at a time.  Used on non-x86 builds and as the reference the SIMD
+ versions have to agree with.
+ *---------------------------------------------------------------------------*/
+static void classifyScalar( const char    * block
+                          , CsvBlockMasks & masks
+                          )
+{
+    uint64_t quote   = 0;
+    uint64_t comma   = 0;
+    uint64_t newline = 0;
+
+    for (int i = 0; i < CSV_BLOCK_SIZE; i++)
+    {
+        uint64_t bit = (uint64_t)1 << i;
+
+        switch (block[i])
+        {
+        case '"':  quote   |= bit; break;
+        case ',':  comma   |= bit; break;
+        case '\n': newline |= bit; break;
+        default:
+            break;
+        } // switch character
+    } // for each byte
+
+    masks.quote   = quote;
+    masks.comma   = comma;
+    masks.newline = newline;
+
+} // classifyScalar()
+
+#ifdef    CSV_SCAN_X86
+
+/*---------------------------------------------------------------------------*
+ SSE2 :
+ Four 16 byte compares per character class.
+ *---------------------------------------------------------------------------*/
+CSV_TARGET("sse2")
+static inline uint64_t matchSse2( const __m128i * chunk
+                                , __m128i         c
+                                )
+{
+    uint64_t m0 = (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( chunk[0], c ) );
+    uint64_t m1 = (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( chunk[1], c ) );
+    uint64_t m2 = (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( chunk[2], c ) );
+    uint64_t m3 = (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( chunk[3], c ) );
+
+    return m0 | ( m1 << 16 ) | ( m2 << 32 ) | ( m3 << 48 );
+}
+
+CSV_TARGET("sse2")
+static void classifySse2( const char    * block
+                        , CsvBlockMasks & masks
+                        )
+{
+    __m128i chunk[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        chunk[i] = _mm_loadu_si128( (const __m128i *)( block + 16 * i ) );
+    }
+
+    masks.quote   = matchSse2( chunk, _mm_set1_epi8( '"'  ) );
+    masks.comma   = matchSse2( chunk, _mm_set1_epi8( ','  ) );
+    masks.newline = matchSse2( chunk, _mm_set1_epi8( '\n' ) );
+
+} // classifySse2()
+
+/*---------------------------------------------------------------------------*
+ AVX2 :
+ Two 32 byte compares per character class.
+ *---------------------------------------------------------------------------*/
+CSV_TARGET("avx2")
+static inline uint64_t matchAvx2( __m256i lo
+                                , __m256i hi
+                                , __m256i c
+                                )
+{
+    uint64_t m0 = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( lo, c ) );
+    uint64_t m1 = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( hi, c ) );
+
+    return m0 | ( m1 << 32 );
+}
+
+CSV_TARGET("avx2")
+static void classifyAvx2( const char    * block
+                        , CsvBlockMasks & masks
+                        )
+{
+    __m256i lo = _mm256_loadu_si256( (const __m256i *)( block      ) );
+    __m256i hi = _mm256_loadu_si256( (const __m256i *)( block + 32 ) );
+
+    masks.quote   = matchAvx2( lo, hi, _mm256_set1_epi8( '"'  ) );
+    masks.comma   = matchAvx2( lo, hi, _mm256_set1_epi8( ','  ) );
+    masks.newline = matchAvx2( lo, hi, _mm256_set1_epi8( '\n' ) );
+
+} // classifyAvx2()
+
+/*---------------------------------------------------------------------------*
+ cpuHas() :
+ What this CPU (and OS, for the AVX register state) will let us run.
+ *---------------------------------------------------------------------------*/
+static bool cpuHas( CsvScanIsa isa )
+{
+    #ifdef    _MSC_VER
+    int info[4];
+
+    __cpuid( info, 1 );
+    bool sse2 = ( info[3] & ( 1 << 26 ) ) != 0;
+    if (isa == CSV_SCAN_SSE2)
+    {
+        return sse2;
+    }
+
+    bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+    bool avx     = ( info[2] & ( 1 << 28 ) ) != 0;
+    if (!osxsave || !avx || ( _xgetbv( 0 ) & 6 ) != 6)
+    {
+        return false;
+    }
+    __cpuidex( info, 7, 0 );
+    return ( info[1] & ( 1 << 5 ) ) != 0;
+    #else
+    __builtin_cpu_init();
+    if (isa == CSV_SCAN_SSE2)
+    {
+        return __builtin_cpu_supports( "sse2" ) != 0;
+    }
+    return __builtin_cpu_supports( "avx2" ) != 0;
+    #endif // _MSC_VER
+
+} // cpuHas()
+
+#endif // CSV_SCAN_X86
+
+/*---------------------------------------------------------------------------*
+ classifierFor() :
+ The classifier for isa, or nullptr if this CPU/build can't run it.
+ *---------------------------------------------------------------------------*/
+static CsvClassifyFn classifierFor( CsvScanIsa isa )
+{
+    switch (isa)
+    {
+    #ifdef    CSV_SCAN_X86
+    case CSV_SCAN_AVX2: return cpuHas( CSV_SCAN_AVX2 ) ? classifyAvx2 : nullptr;
+    case CSV_SCAN_SSE2: return cpuHas( CSV_SCAN_SSE2 ) ? classifySse2 : nullptr;
+    #endif // CSV_SCAN_X86
+    case CSV_SCAN_SCALAR: return classifyScalar;
+    default:
+        break;
+    }
+    return nullptr;
+}
+
+static CsvScanIsa bestIsa()
+{
+    if (classifierFor( CSV_SCAN_AVX2 ) != nullptr) return CSV_SCAN_AVX2;
+    if (classifierFor( CSV_SCAN_SSE2 ) != nullptr) return CSV_SCAN_SSE2;
+    return CSV_SCAN_SCALAR;
+}
+
+// Picked once during static initialization, before any threads exist.
+static CsvScanIsa currentIsa  = bestIsa();
+CsvClassifyFn     csvClassify = classifierFor( currentIsa );
+
+bool csvSetScanIsa( CsvScanIsa isa )
+{
+    if (isa == CSV_SCAN_AUTO)
+    {
+        isa = bestIsa();
+    }
+
+    CsvClassifyFn classify = classifierFor( isa );
+    if (classify == nullptr)
+    {
+        return false;
+    }
+
+    csvClassify = classify;
+    currentIsa  = isa;
+    return true;
+
+} // csvSetScanIsa()
+
+CsvScanIsa csvGetScanIsa()
+{
+    return currentIsa;
+}
+
+const char * csvScanIsaName( CsvScanIsa isa )
+{
+    switch (isa)
+    {
+    case CSV_SCAN_SCALAR: return "scalar";
+    case CSV_SCAN_SSE2:   return "sse2";
+    case CSV_SCAN_AVX2:   return "avx2";
+    default:
+        break;
+    }
+    return "auto";
+}
@@ -0,0 +1,90 @@
+/*===========================================================================*
+ CsvScan.h :
+ Vectorized character classification for the CSV tokenizer.
+
+ The tokenizer looks at the input 64 bytes at a time.  For each 64 byte
+ block a classifier fills in one bit per byte for the three characters that
+ matter to CSV: '"', ',' and '\n'.  Bit n corresponds to block[n].
+
+ There are scalar, SSE2 and AVX2 classifiers; the best one the CPU supports
+ is picked at startup.  csvSetScanIsa() lets a benchmark (or a suspicious
+ user) force a particular one.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+
+const int CSV_BLOCK_SIZE = 64;
+
+struct CsvBlockMasks
+{
+    uint64_t quote;
+    uint64_t comma;
+    uint64_t newline;
+};
+
+enum CsvScanIsa
+{
+    CSV_SCAN_AUTO = 0,
+    CSV_SCAN_SCALAR,
+    CSV_SCAN_SSE2,
+    CSV_SCAN_AVX2
+};
+
+typedef void (*CsvClassifyFn)( const char    * block
+                             , CsvBlockMasks & masks
+                             );
+
+extern CsvClassifyFn csvClassify;     // best available, or csvSetScanIsa()
+
+// Returns false if the CPU (or build) doesn't support the requested ISA.
+bool         csvSetScanIsa ( CsvScanIsa isa );
+CsvScanIsa   csvGetScanIsa ();
+const char * csvScanIsaName( CsvScanIsa isa );
+
+/*---------------------------------------------------------------------------*
+ csvPrefixXor() :
+ Bit n of the result is the XOR of bits 0..n of x.  Applied to the quote
+ mask it gives a mask that's set for every byte inside a quoted string
+ (counting the opening quote, not counting the closing one).  Escaped
+ quotes ("") toggle out and straight back in, which is exactly right.
+ *---------------------------------------------------------------------------*/
+inline uint64_t csvPrefixXor( uint64_t x )
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/*---------------------------------------------------------------------------*
+ csvCountTrailingZeros() :
+ Index of the lowest set bit.  x must not be 0.
+ *---------------------------------------------------------------------------*/
+#ifdef    _MSC_VER
+#include <intrin.h>
+inline int csvCountTrailingZeros( uint64_t x )
+{
+    unsigned long index;
+    #ifdef    _WIN64
+    _BitScanForward64( &index, x );
+    #else
+    if (_BitScanForward( &index, (unsigned long)x ) == 0)
+    {
+        _BitScanForward( &index, (unsigned long)( x >> 32 ) );
+        index += 32;
+    }
+    #endif // _WIN64
+    return (int)index;
+}
+#else
+inline int csvCountTrailingZeros( uint64_t x )
+{
+    return __builtin_ctzll( x );
+}
+#endif // _MSC_VER
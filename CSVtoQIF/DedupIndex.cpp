@@ -0,0 +1,298 @@
+/*===========================================================================*
+ DedupIndex.cpp :
+ Transaction keys and the memory mapped table that remembers them.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "DedupIndex.h"
+
+#include <string.h>
+#include <filesystem>
+#include <system_error>
+
+#define DEDUP_MAGIC            "QIFDEDUP"
+
+// What's at the front of an index file; the slots follow it.
+struct IndexHeader
+{
+    char     magic[8];          // DEDUP_MAGIC, no NUL
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t reserved;
+};
+
+// Smallest table worth making.
+const size_t MIN_CAPACITY = 1024;
+
+/*---------------------------------------------------------------------------*
+ TransactionKey
+ *---------------------------------------------------------------------------*/
+void TransactionKey::mix( const void * data
+                        , size_t       len
+                        )
+{
+    const unsigned char * p = (const unsigned char *)data;
+
+    // A word at a time while there are words; this runs for every row.
+    for (; len >= sizeof( uint64_t ); p += sizeof( uint64_t ), len -= sizeof( uint64_t ))
+    {
+        uint64_t word;
+        memcpy( &word, p, sizeof( word ) );
+
+        m_hash  = ( m_hash ^ word ) * 0x9E3779B97F4A7C15ULL;
+        m_hash ^= m_hash >> 29;
+    }
+    for (; len > 0; p++, len--)
+    {
+        m_hash ^= *p;
+        m_hash *= 1099511628211ULL;
+    }
+}
+
+void TransactionKey::add( const void * data
+                        , size_t       len
+                        )
+{
+    uint64_t len64 = len;
+
+    mix( &len64, sizeof( len64 ) );
+    mix( data, len );
+}
+
+uint64_t TransactionKey::value() const
+{
+    // Multiplying leaves the low bits weak and they pick the slot, so
+    // finish it off.
+    uint64_t hash = m_hash;
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return hash != 0 ? hash : 1;
+}
+
+/*---------------------------------------------------------------------------*
+ insertKey() :
+ Put key in a table that has room for it.  1 if it's new, 0 if it was
+ already there.
+ *---------------------------------------------------------------------------*/
+static size_t insertKey( uint64_t * slots
+                       , size_t     capacity
+                       , uint64_t   key
+                       )
+{
+    size_t mask = capacity - 1;
+
+    for (size_t i = (size_t)key & mask; ; i = ( i + 1 ) & mask)
+    {
+        if (slots[i] == key)
+        {
+            return 0;
+        }
+        if (slots[i] == 0)
+        {
+            slots[i] = key;
+            return 1;
+        }
+    }
+}
+
+static size_t fileSizeFor( size_t capacity )
+{
+    return sizeof( IndexHeader ) + capacity * sizeof( uint64_t );
+}
+
+/*---------------------------------------------------------------------------*
+ DedupIndex
+ *---------------------------------------------------------------------------*/
+DedupIndex::DedupIndex()
+    : m_slots   ( nullptr )
+    , m_capacity( 0 )
+    , m_count   ( 0 )
+{
+}
+
+bool DedupIndex::open( const char  * filename
+                     , std::string & error
+                     )
+{
+    m_filename = filename;
+    m_slots    = nullptr;
+    m_capacity = 0;
+    m_count    = 0;
+
+    std::error_code exists;
+    if (!std::filesystem::exists( filename, exists ))
+    {
+        m_file.close();
+        return true;                    // first run - start empty
+    }
+
+    if (!m_file.open( filename ))
+    {
+        error = std::string( "ERROR: Can't open dedup index...\n" )
+              + filename
+              + "\n...for some reason.\n";
+        return false;
+    }
+
+    IndexHeader header;
+    if (m_file.size() >= sizeof( header ))
+    {
+        memcpy( &header, m_file.data(), sizeof( header ) );
+    }
+
+    if (  m_file.size() < sizeof( header )
+       || memcmp( header.magic, DEDUP_MAGIC, sizeof( header.magic ) ) != 0
+       || header.capacity == 0
+       || ( header.capacity & ( header.capacity - 1 ) ) != 0
+       || m_file.size() != fileSizeFor( (size_t)header.capacity )
+       || header.count > header.capacity / 2       // no empty slot to stop a probe
+       )
+    {
+        m_file.close();
+        error = std::string( "ERROR: Dedup index...\n" )
+              + filename
+              + "\n...isn't one, or is damaged.\n";
+        return false;
+    }
+
+    m_slots    = (const uint64_t *)( m_file.data() + sizeof( header ) );
+    m_capacity = (size_t)header.capacity;
+    m_count    = (size_t)header.count;
+    return true;
+
+} // DedupIndex::open()
+
+bool DedupIndex::contains( uint64_t key ) const
+{
+    size_t mask = m_capacity - 1;
+
+    for (size_t i = (size_t)key & mask; m_capacity > 0 && m_slots[i] != 0; i = ( i + 1 ) & mask)
+    {
+        if (m_slots[i] == key)
+        {
+            return true;
+        }
+    }
+
+    // Then what this run has written so far.
+    return !m_recent.empty()
+        && m_recent.count( key ) > 0;
+}
+
+void DedupIndex::stage( const std::vector<uint64_t> & keys )
+{
+    std::lock_guard<std::mutex> guard( m_stageLock );
+
+    m_staged.insert( m_staged.end(), keys.begin(), keys.end() );
+    m_recent.insert( keys.begin(), keys.end() );
+}
+
+bool DedupIndex::commit( std::string & error )
+{
+    std::lock_guard<std::mutex> guard( m_stageLock );
+
+    if (m_staged.empty())
+    {
+        return true;
+    }
+
+    size_t needed   = m_count + m_staged.size();
+    size_t capacity = m_capacity > MIN_CAPACITY ? m_capacity : MIN_CAPACITY;
+
+    // Always a new file, even if the keys would fit in this one: updating
+    // it where it is would leave it half done if we died part way.
+    while (capacity / 2 < needed)
+    {
+        capacity *= 2;
+    }
+    if (!rebuild( capacity, error ))
+    {
+        return false;
+    }
+
+    m_staged.clear();
+    m_recent.clear();
+    return open( m_filename.c_str(), error );
+
+} // DedupIndex::commit()
+
+/*---------------------------------------------------------------------------*
+ rebuild() :
+ Write the current keys and the staged ones into a new table of capacity
+ slots next to the index, then swap it in.
+ *---------------------------------------------------------------------------*/
+bool DedupIndex::rebuild( size_t        capacity
+                        , std::string & error
+                        )
+{
+    std::string temporary = m_filename + ".tmp";
+
+    {
+        MappedFile fresh;
+        if (!fresh.openForWriting( temporary.c_str(), fileSizeFor( capacity ) ))
+        {
+            std::error_code removed;
+            std::filesystem::remove( temporary, removed );
+            error = std::string( "ERROR: Can't write dedup index...\n" )
+                  + temporary
+                  + "\n...disk full?\n";
+            return false;
+        }
+
+        IndexHeader * header = (IndexHeader *)fresh.writableData();
+        uint64_t    * slots  = (uint64_t *)( header + 1 );
+        size_t        count  = 0;
+
+        for (size_t i = 0; i < m_capacity; i++)
+        {
+            if (m_slots[i] != 0)
+            {
+                count += insertKey( slots, capacity, m_slots[i] );
+            }
+        }
+        for (uint64_t key : m_staged)
+        {
+            count += insertKey( slots, capacity, key );
+        }
+
+        memcpy( header->magic, DEDUP_MAGIC, sizeof( header->magic ) );
+        header->capacity = capacity;
+        header->count    = count;
+        header->reserved = 0;
+
+        // On the disk before it has the index's name.
+        if (!fresh.flush())
+        {
+            fresh.close();
+            std::error_code removed;
+            std::filesystem::remove( temporary, removed );
+            error = std::string( "ERROR: Can't write dedup index...\n" )
+                  + temporary
+                  + "\n...disk full?\n";
+            return false;
+        }
+    }
+
+    // Let go of the old one first; Windows won't replace a mapped file.
+    m_file.close();
+    m_slots    = nullptr;
+    m_capacity = 0;
+
+    std::error_code renamed;
+    std::filesystem::rename( temporary, m_filename, renamed );
+    if (renamed)
+    {
+        error = std::string( "ERROR: Can't replace dedup index...\n" )
+              + m_filename
+              + "\n..." + renamed.message() + "\n";
+        return false;
+    }
+    return true;
+
+} // DedupIndex::rebuild()
@@ -0,0 +1,110 @@
+/*===========================================================================*
+ DedupIndex.h :
+ Every transaction we've ever written to a QIF file, so that custodians
+ re-issuing overlapping date ranges don't mean Quicken sees a row twice.
+
+ A transaction is known by a 64 bit key hashed from its posting date,
+ security (SF_PREPEND and all), fixed point amount and units, and memo -
+ see TransactionKey.  The keys live in an open addressing table (linear
+ probing, never more than half full) that is the index file itself: a
+ small header then the slots, memory mapped on open, so loading millions
+ of them costs no more than mapping the file.
+
+ Once a file's QIF file is in place, the keys of the rows it wrote are
+ staged, and from then on lookups see them too, in a set in front of the
+ table - so when two exports in one run overlap, only the first writes
+ the rows they share.  Staging changes what lookups see, so it mustn't
+ happen while another thread is converting: with an index, batch and
+ watch runs convert one file at a time, in order, and the result doesn't
+ depend on which thread got there first.  Any number of threads can look
+ keys up at once in between.
+
+ commit() adds everything staged to the file, into a new table (twice the
+ size, if they don't fit in half of this one) written next to the index,
+ flushed to the disk and renamed over it - so a run that dies part way,
+ or a disk that fills up, leaves the index as it was, never half updated.
+ A file whose count says it has no empty slot is taken as damaged.  Rows
+ that repeat within one file are all written: as far as we can tell
+ they're separate transactions.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "MappedFile.h"
+
+/*---------------------------------------------------------------------------*
+ TransactionKey :
+ Builds a key a piece at a time.  Each piece is length prefixed, so moving
+ text from one field to the next changes the key.
+ *---------------------------------------------------------------------------*/
+class TransactionKey
+{
+public:
+    TransactionKey() : m_hash( 14695981039346656037ULL ) {}
+
+    void     add  ( const void * data
+                  , size_t       len
+                  );
+    void     add  ( int64_t value ) { add( &value, sizeof( value ) ); }
+
+    // Never 0, which marks an empty slot.
+    uint64_t value() const;
+
+private:
+    void     mix  ( const void * data
+                  , size_t       len
+                  );
+
+    uint64_t m_hash;
+
+}; // class TransactionKey
+
+class DedupIndex
+{
+public:
+    DedupIndex();
+
+    // Map filename, or start empty if it doesn't exist yet.
+    bool   open    ( const char  * filename
+                   , std::string & error
+                   );
+
+    // Was key in the index when it was opened, or staged since?
+    bool   contains( uint64_t key ) const;
+
+    // Hold on to keys for commit(), and have contains() see them now.
+    // Safe from any thread, but not while another is calling contains().
+    void   stage   ( const std::vector<uint64_t> & keys );
+
+    // Add everything staged to the file.
+    bool   commit  ( std::string & error );
+
+    size_t size    () const { return m_count; }
+
+private:
+    DedupIndex           ( const DedupIndex & );   // not copyable
+    DedupIndex & operator=( const DedupIndex & );
+
+    bool   rebuild ( size_t        capacity
+                   , std::string & error
+                   );
+
+    std::string                  m_filename;
+    MappedFile                   m_file;
+    const uint64_t             * m_slots;
+    size_t                       m_capacity;   // a power of 2, or 0
+    size_t                       m_count;
+
+    std::mutex                   m_stageLock;
+    std::vector<uint64_t>        m_staged;
+    std::unordered_set<uint64_t> m_recent;     // m_staged, to look up
+
+}; // class DedupIndex
@@ -0,0 +1,514 @@
+/*===========================================================================*
+ FixedPoint.cpp :
+ Decimal parsing/formatting, the price x quantity cross check and dates.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "FixedPoint.h"
+
+#include <string.h>
+
+static const uint64_t powerOf10[] =
+{
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL
+};
+
+static inline bool isBlank( char c )
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline bool isDigit( char c )
+{
+    return (unsigned)( c - '0' ) < 10;
+}
+
+DecimalStatus parseDecimal( const char * text
+                          , size_t       len
+                          , int          scale
+                          , Decimal    & d
+                          )
+{
+    const char * p        = text;
+    const char * end      = text + len;
+    bool         negative = false;
+
+    d.value  = 0;
+    d.digits = 0;
+    d.plain  = true;
+
+    while (p < end && isBlank( *p ))          p++;
+    while (end > p && isBlank( end[-1] ))     end--;
+
+    if (p == end)
+    {
+        return DECIMAL_EMPTY;
+    }
+
+    // (123.45) accounting style negative...
+    if (  *p       == '('
+       && end[-1]  == ')'
+       )
+    {
+        negative = true;
+        d.plain  = false;
+        p++;
+        end--;
+    }
+    // ...or 123.45- the way some mainframes still do it.
+    else if (  end - p > 1
+            && end[-1] == '-'
+            )
+    {
+        negative = true;
+        d.plain  = false;
+        end--;
+    }
+
+    // Leading sign and currency symbol, in either order.
+    for (int i = 0; i < 2 && p < end; i++)
+    {
+        if (*p == '-' || *p == '+')
+        {
+            if (*p == '-')
+            {
+                if (negative)
+                {
+                    return DECIMAL_INVALID;
+                }
+                negative = true;
+            }
+            else
+            {
+                d.plain = false;
+            }
+            p++;
+        }
+        else if (*p == '$')
+        {
+            d.plain = false;
+            p++;
+        }
+    }
+
+    uint64_t value     = 0;
+    int      intDigits = 0;
+    int      group     = -1;        // digits since the last comma, -1 before one
+    bool     overflow  = false;
+
+    // Integer part, with optional thousands separators: one to three
+    // digits, then groups of exactly three - 1,234,567 but not 1,23.
+    for (; p < end; p++)
+    {
+        if (isDigit( *p ))
+        {
+            overflow |= value > ( (uint64_t)INT64_MAX - (uint64_t)( *p - '0' ) ) / 10;
+            value     = value * 10 + (uint64_t)( *p - '0' );
+            intDigits++;
+            group    += group >= 0 ? 1 : 0;
+        }
+        else if (*p == ',')
+        {
+            if (  intDigits == 0
+               || ( group < 0 ? intDigits > 3 : group != 3 )
+               )
+            {
+                return DECIMAL_INVALID;
+            }
+            group   = 0;
+            d.plain = false;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (  group >= 0
+       && group != 3
+       )
+    {
+        return DECIMAL_INVALID;
+    }
+
+    // Fraction: keep scale digits, round on the next one, count the rest.
+    int  kept    = 0;
+    bool roundUp = false;
+
+    if (  p   < end
+       && *p == '.'
+       )
+    {
+        for (p++; p < end && isDigit( *p ); p++)
+        {
+            if (kept < scale)
+            {
+                overflow |= value > ( (uint64_t)INT64_MAX - (uint64_t)( *p - '0' ) ) / 10;
+                value     = value * 10 + (uint64_t)( *p - '0' );
+                kept++;
+            }
+            else if (d.digits == scale)
+            {
+                roundUp = *p >= '5';
+            }
+            d.digits++;
+        }
+    }
+
+    if (  p != end
+       || intDigits + d.digits == 0
+       )
+    {
+        d.digits = 0;
+        return DECIMAL_INVALID;
+    }
+
+    overflow |= value > (uint64_t)INT64_MAX / powerOf10[scale - kept];
+    value    *= powerOf10[scale - kept];
+    value    += roundUp ? 1 : 0;
+
+    if (  overflow
+       || value > (uint64_t)INT64_MAX
+       )
+    {
+        d.digits = 0;
+        return DECIMAL_OVERFLOW;
+    }
+
+    d.value = negative ? -(int64_t)value : (int64_t)value;
+    return DECIMAL_OK;
+
+} // parseDecimal()
+
+size_t formatDecimal( int64_t value
+                    , int     scale
+                    , int     digits
+                    , char  * dest
+                    )
+{
+    if (digits > scale) digits = scale;
+    if (digits < 0)     digits = 0;
+
+    bool     negative  = value < 0;
+    uint64_t magnitude = negative ? 0 - (uint64_t)value : (uint64_t)value;
+    uint64_t drop      = powerOf10[scale - digits];
+
+    // Round half away from zero to the digits asked for.  Anything that
+    // rounds to zero comes out as plain zero, not -0.00.
+    magnitude = ( magnitude + drop / 2 ) / drop;
+    negative  = negative && magnitude != 0;
+
+    char   reversed[DECIMAL_STR_LEN];
+    size_t n = 0;
+
+    for (int i = 0; i < digits; i++)
+    {
+        reversed[n++] = (char)( '0' + magnitude % 10 );
+        magnitude /= 10;
+    }
+    if (digits > 0)
+    {
+        reversed[n++] = '.';
+    }
+    do
+    {
+        reversed[n++] = (char)( '0' + magnitude % 10 );
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    size_t len = 0;
+    if (negative)
+    {
+        dest[len++] = '-';
+    }
+    while (n > 0)
+    {
+        dest[len++] = reversed[--n];
+    }
+    dest[len] = '\0';
+    return len;
+
+} // formatDecimal()
+
+static bool digitsAt( const char * p
+                    , size_t       n
+                    , int        & value
+                    )
+{
+    value = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!isDigit( p[i] ))
+        {
+            return false;
+        }
+        value = value * 10 + ( p[i] - '0' );
+    }
+    return true;
+}
+
+bool parseDate( const char * text
+              , size_t       len
+              , uint32_t   & yyyymmdd
+              )
+{
+    const char * p = text;
+    int          year;
+    int          month;
+    int          day;
+
+    if (  len == 8
+       && digitsAt( p, 8, year )
+       )
+    {
+        month = year / 100 % 100;
+        day   = year % 100;
+        year /= 10000;
+    }
+    else if (  len == 10
+            && p[4] == '-'
+            && p[7] == '-'
+            && digitsAt( p, 4, year )
+            && digitsAt( p + 5, 2, month )
+            && digitsAt( p + 8, 2, day )
+            )
+    {
+    }
+    else
+    {
+        const char * slash1 = (const char *)memchr( p, '/', len );
+        const char * slash2 = slash1 ? (const char *)memchr( slash1 + 1, '/', (size_t)( p + len - slash1 - 1 ) ) : nullptr;
+
+        if (  slash2 == nullptr
+           || slash1 - p < 1 || slash1 - p > 2
+           || slash2 - slash1 < 2 || slash2 - slash1 > 3
+           || !digitsAt( p, (size_t)( slash1 - p ), month )
+           || !digitsAt( slash1 + 1, (size_t)( slash2 - slash1 - 1 ), day )
+           )
+        {
+            return false;
+        }
+
+        size_t yearLen = (size_t)( p + len - slash2 - 1 );
+        if (  ( yearLen != 2 && yearLen != 4 )
+           || !digitsAt( slash2 + 1, yearLen, year )
+           )
+        {
+            return false;
+        }
+        if (yearLen == 2)
+        {
+            year += year < 70 ? 2000 : 1900;
+        }
+    }
+
+    if (  month < 1 || month > 12
+       || day   < 1 || day   > 31
+       )
+    {
+        return false;
+    }
+    yyyymmdd = (uint32_t)( year * 10000 + month * 100 + day );
+    return true;
+
+} // parseDate()
+
+/*---------------------------------------------------------------------------*
+ U128 :
+ Just enough unsigned 128 bit arithmetic for the cross check and
+ unitPrice(), written out longhand so it builds the same everywhere.
+ *---------------------------------------------------------------------------*/
+struct U128
+{
+    uint64_t hi;
+    uint64_t lo;
+};
+
+static U128 multiply( uint64_t a
+                    , uint64_t b
+                    )
+{
+    uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32;
+    uint64_t bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+
+    uint64_t lolo = aLo * bLo;
+    uint64_t hilo = aHi * bLo;
+    uint64_t lohi = aLo * bHi;
+    uint64_t hihi = aHi * bHi;
+
+    uint64_t middle = ( lolo >> 32 ) + ( hilo & 0xFFFFFFFF ) + ( lohi & 0xFFFFFFFF );
+
+    U128 r;
+    r.lo = ( middle << 32 ) | ( lolo & 0xFFFFFFFF );
+    r.hi = hihi + ( hilo >> 32 ) + ( lohi >> 32 ) + ( middle >> 32 );
+    return r;
+}
+
+static U128 multiply( U128     a
+                    , uint64_t b
+                    )
+{
+    U128 r = multiply( a.lo, b );
+
+    r.hi += a.hi * b;
+    return r;
+}
+
+static U128 add( U128 a
+               , U128 b
+               )
+{
+    U128 r;
+    r.lo = a.lo + b.lo;
+    r.hi = a.hi + b.hi + ( r.lo < a.lo ? 1 : 0 );
+    return r;
+}
+
+static U128 subtract( U128 a           // a >= b
+                    , U128 b
+                    )
+{
+    U128 r;
+    r.lo = a.lo - b.lo;
+    r.hi = a.hi - b.hi - ( a.lo < b.lo ? 1 : 0 );
+    return r;
+}
+
+static bool lessThan( U128 a
+                    , U128 b
+                    )
+{
+    return a.hi < b.hi || ( a.hi == b.hi && a.lo < b.lo );
+}
+
+static inline uint64_t magnitude( int64_t value )
+{
+    return value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+}
+
+// Everything is compared in units of 10^-CHECK_SCALE.
+const int CHECK_SCALE = 18;
+
+static_assert( PRICE_SCALE + QUANTITY_SCALE <= CHECK_SCALE
+             , "price x quantity must fit the check scale"
+             );
+static_assert( CHECK_SCALE - PRICE_SCALE - QUANTITY_SCALE - 1 >= 0
+             , "rounding bounds must be whole check units"
+             );
+
+bool priceTimesQuantityMatches( const Decimal & price
+                              , const Decimal & quantity
+                              , const Decimal & amount
+                              )
+{
+    uint64_t p = magnitude( price.value    );
+    uint64_t q = magnitude( quantity.value );
+    uint64_t a = magnitude( amount.value   );
+
+    // Beyond anything a 401(k) will ever see, and beyond 128 bits below.
+    if (  p > powerOf10[15]
+       || q > powerOf10[15]
+       || a > powerOf10[15]
+       )
+    {
+        return true;
+    }
+
+    int dp = price.digits    < PRICE_SCALE    ? price.digits    : PRICE_SCALE;
+    int dq = quantity.digits < QUANTITY_SCALE ? quantity.digits : QUANTITY_SCALE;
+    int da = amount.digits   < AMOUNT_SCALE   ? amount.digits   : AMOUNT_SCALE;
+
+    U128 product = multiply( multiply( p, q ), powerOf10[CHECK_SCALE - PRICE_SCALE - QUANTITY_SCALE] );
+    U128 total   = multiply( a, powerOf10[CHECK_SCALE - AMOUNT_SCALE] );
+
+    // |q| x half a unit in p's last digit, |p| x half a unit in q's, half a
+    // unit in a's, and a cent of slack for custodians that round late.
+    U128 bound = multiply( q, 5 * powerOf10[CHECK_SCALE - QUANTITY_SCALE - dp - 1] );
+    bound = add( bound, multiply( p, 5 * powerOf10[CHECK_SCALE - PRICE_SCALE - dq - 1] ) );
+    bound = add( bound, multiply( 5, powerOf10[CHECK_SCALE - da - 1] ) );
+    bound = add( bound, multiply( 1, powerOf10[CHECK_SCALE - AMOUNT_SCALE] ) );
+
+    U128 difference = lessThan( product, total ) ? subtract( total, product )
+                                                 : subtract( product, total );
+
+    return !lessThan( bound, difference );
+
+} // priceTimesQuantityMatches()
+
+// |amount| x 10^(PRICE_SCALE - AMOUNT_SCALE + QUANTITY_SCALE) / |quantity|,
+// a bit at a time, so it's exact however big the amount.
+static_assert( PRICE_SCALE - AMOUNT_SCALE + QUANTITY_SCALE <= 19
+             , "the scale factor must fit 64 bits"
+             );
+
+bool unitPrice( const Decimal & amount
+              , const Decimal & quantity
+              , Decimal       & price
+              )
+{
+    uint64_t a = magnitude( amount.value   );
+    uint64_t q = magnitude( quantity.value );
+
+    if (q == 0)
+    {
+        return false;
+    }
+
+    U128     dividend  = multiply( a, powerOf10[PRICE_SCALE - AMOUNT_SCALE + QUANTITY_SCALE] );
+    U128     remainder = { 0, 0 };
+    U128     divisor   = { 0, q };
+    uint64_t quotient  = 0;
+
+    for (int bit = 127; bit >= 0; bit--)
+    {
+        uint64_t next = bit >= 64 ? ( dividend.hi >> ( bit - 64 ) ) & 1 : ( dividend.lo >> bit ) & 1;
+
+        remainder.hi = ( remainder.hi << 1 ) | ( remainder.lo >> 63 );
+        remainder.lo = ( remainder.lo << 1 ) | next;
+        if (!lessThan( remainder, divisor ))
+        {
+            remainder = subtract( remainder, divisor );
+            if (bit >= 63)
+            {
+                return false;           // 2^63 and up won't fit
+            }
+            quotient |= (uint64_t)1 << bit;
+        }
+    }
+
+    // Round half up.
+    U128 twice = add( remainder, remainder );
+    if (!lessThan( twice, divisor ))
+    {
+        quotient++;
+    }
+    if (quotient > (uint64_t)INT64_MAX)
+    {
+        return false;
+    }
+
+    price.value  = (int64_t)quotient;
+    price.digits = PRICE_SCALE;
+    price.plain  = true;
+    return true;
+
+} // unitPrice()
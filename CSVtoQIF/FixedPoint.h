@@ -0,0 +1,95 @@
+/*===========================================================================*
+ FixedPoint.h :
+ Exact decimal numbers for amounts, prices and quantities.
+
+ A Decimal is a 64 bit count of 10^-scale units, where the scale depends
+ on what the number is (AMOUNT_SCALE, PRICE_SCALE, QUANTITY_SCALE).  The
+ parser takes what custodians actually put in their exports - thousands
+ separators, a leading $, (parenthesized) or trailing-minus negatives -
+ without allocating and without going anywhere near floating point.
+
+ Dates get a little of the same: parseDate() turns the ways the exports
+ write them into a YYYYMMDD number, which orders like the dates do.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+const int AMOUNT_SCALE   = 2;     // cents
+const int PRICE_SCALE    = 6;
+const int QUANTITY_SCALE = 6;
+
+// Longest text formatDecimal() can produce, plus the NUL.
+const int DECIMAL_STR_LEN = 32;
+
+enum DecimalStatus
+{
+    DECIMAL_OK = 0,
+    DECIMAL_EMPTY,          // nothing but blanks
+    DECIMAL_INVALID,        // not a number
+    DECIMAL_OVERFLOW        // doesn't fit in 64 bits at this scale
+};
+
+struct Decimal
+{
+    int64_t value;          // in 10^-scale units
+    int     digits;         // fraction digits the text had (may be > scale)
+    bool    plain;          // text was just [-]digits[.digits]
+};
+
+/*---------------------------------------------------------------------------*
+ parseDecimal() :
+ Parse len bytes of text at the given scale.  Extra fraction digits are
+ rounded half away from zero (d.digits > scale says that happened).  On
+ anything but DECIMAL_OK, d.value is 0.
+ *---------------------------------------------------------------------------*/
+DecimalStatus parseDecimal( const char * text
+                          , size_t       len
+                          , int          scale
+                          , Decimal    & d
+                          );
+
+/*---------------------------------------------------------------------------*
+ formatDecimal() :
+ Plain [-]digits[.digits] text with the given number of fraction digits
+ (at most scale).  dest needs DECIMAL_STR_LEN bytes.  Returns the length.
+ *---------------------------------------------------------------------------*/
+size_t formatDecimal( int64_t value
+                    , int     scale
+                    , int     digits
+                    , char  * dest
+                    );
+
+/*---------------------------------------------------------------------------*
+ priceTimesQuantityMatches() :
+ Does |price x quantity| agree with |amount| to within the rounding of the
+ digits each was quoted to, plus one cent?  Signs are ignored since
+ custodians don't agree on which of units and amount goes negative.
+ *---------------------------------------------------------------------------*/
+bool priceTimesQuantityMatches( const Decimal & price
+                              , const Decimal & quantity
+                              , const Decimal & amount
+                              );
+
+/*---------------------------------------------------------------------------*
+ unitPrice() :
+ |amount| / |quantity| as a price, PRICE_SCALE digits, rounded half up.
+ False if quantity is 0 or the price won't fit.
+ *---------------------------------------------------------------------------*/
+bool unitPrice( const Decimal & amount
+              , const Decimal & quantity
+              , Decimal       & price
+              );
+
+/*---------------------------------------------------------------------------*
+ parseDate() :
+ A date as the exports write them - M/D/YYYY, M/D/YY, YYYY-MM-DD or
+ YYYYMMDD - as YYYYMMDD.  False if it's none of those.
+ *---------------------------------------------------------------------------*/
+bool parseDate( const char * text
+              , size_t       len
+              , uint32_t   & yyyymmdd
+              );
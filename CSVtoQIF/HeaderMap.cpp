@@ -0,0 +1,407 @@
+/*===========================================================================*
+ HeaderMap.cpp :
+ Column header to QIF field mapping: the built in synonyms and header
+ profiles, both in perfect hashes (see PerfectHash.h).
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "HeaderMap.h"
+#include "MappedFile.h"
+#include "PerfectHash.h"
+
+#include <string.h>
+#include <utility>
+
+/*---------------------------------------------------------------------------*
+ HeaderSynonym :
+ One header name and what a column with that name means.
+ *---------------------------------------------------------------------------*/
+struct HeaderSynonym
+{
+    const char * name;
+    char         fieldID;
+    bool         prePendSF;
+};
+
+static constexpr HeaderSynonym BUILTIN_HEADERS[] =
+{
+    { "Date"              , FIELD_ID_DATE      , false },
+    { "POSTING DATE"      , FIELD_ID_DATE      , false },
+    { "VALUATION DATE"    , FIELD_ID_IGNORE    , false },
+    { "Memo"              , FIELD_ID_MEMO      , false },
+    { "ACTIVITY TYPE"     , FIELD_ID_MEMO      , false },
+    { "ACCOUNT"           , FIELD_ID_IGNORE    , false },
+    { "PLAN"              , FIELD_ID_IGNORE    , false },
+    { "FUND"              , FIELD_ID_SECURITY  , true  },
+    { "Security Name"     , FIELD_ID_SECURITY  , false },
+    { "Investment Action" , FIELD_ID_ACTION    , false },
+    { "Commission"        , FIELD_ID_COMMISSION, false },     // 0 if not found
+    { "Amount"            , FIELD_ID_AMOUNT    , false },
+    { "Price"             , FIELD_ID_PRICE     , false },
+    { "FUND NAV/PRICE"    , FIELD_ID_PRICE     , false },
+    { "Quantity"          , FIELD_ID_QUANTITY  , false },
+    { "FUND UNITS"        , FIELD_ID_QUANTITY  , false },
+    { "CLEARED"           , FIELD_ID_CLEARED   , false },     // X if not found
+    { "Transfer Account"  , FIELD_ID_TXFR_ACCT , false },     // Cash if M=ACTIVITY_BEFORE_TAX
+    { "Amount Transfered" , FIELD_ID_TXFR_AMNT , false }      // T if M=ACTIVITY_BEFORE_TAX
+};
+
+// Every code a profile may map a header to.
+static const char FIELD_CODES[] =
+{
+    FIELD_ID_IGNORE,
+    FIELD_ID_DATE,
+    FIELD_ID_ACTION,
+    FIELD_ID_SECURITY,
+    FIELD_ID_PRICE,
+    FIELD_ID_QUANTITY,
+    FIELD_ID_AMOUNT,
+    FIELD_ID_CLEARED,
+    FIELD_ID_MEMO,
+    FIELD_ID_COMMISSION,
+    FIELD_ID_TXFR_ACCT,
+    FIELD_ID_TXFR_AMNT,
+    '\0'
+};
+
+/*---------------------------------------------------------------------------*
+ The built in synonyms, hashed by the compiler.
+ *---------------------------------------------------------------------------*/
+const size_t BUILTIN_COUNT = sizeof( BUILTIN_HEADERS ) / sizeof( BUILTIN_HEADERS[0] );
+
+struct BuiltinTable
+{
+    uint32_t displacement[bucketsFor( BUILTIN_COUNT )];
+    int32_t  slot        [slotsFor  ( BUILTIN_COUNT )];
+    bool     perfect;
+};
+
+static constexpr BuiltinTable buildBuiltinTable()
+{
+    BuiltinTable table  = {};
+    uint64_t     hashes[BUILTIN_COUNT] = {};
+
+    for (size_t i = 0; i < BUILTIN_COUNT; i++)
+    {
+        hashes[i] = foldedHash( BUILTIN_HEADERS[i].name, textLength( BUILTIN_HEADERS[i].name ) );
+    }
+    table.perfect = buildPerfectHash( hashes
+                                    , BUILTIN_COUNT
+                                    , table.displacement
+                                    , bucketsFor( BUILTIN_COUNT )
+                                    , table.slot
+                                    , slotsFor( BUILTIN_COUNT )
+                                    );
+    return table;
+}
+
+static constexpr BuiltinTable BUILTIN_TABLE = buildBuiltinTable();
+
+static_assert( BUILTIN_TABLE.perfect
+             , "two built in header names fold to the same text"
+             );
+
+/*---------------------------------------------------------------------------*
+ The header profile, if one's been loaded.  Written once by
+ loadHeaderProfile() before any conversion starts, read only after that.
+ *---------------------------------------------------------------------------*/
+struct HeaderProfile
+{
+    std::vector<std::string>   names;
+    std::vector<HeaderSynonym> synonyms;        // name points into names
+    std::vector<uint32_t>      displacement;
+    std::vector<int32_t>       slot;
+};
+
+static HeaderProfile headerProfile;
+static bool          profileLoaded = false;
+
+static const HeaderSynonym * findIn( const HeaderSynonym * synonyms
+                                   , const uint32_t      * displacement
+                                   , size_t                bucketCount
+                                   , const int32_t       * slot
+                                   , size_t                slotCount
+                                   , uint64_t              hash
+                                   , const char          * text
+                                   , size_t                len
+                                   )
+{
+    if (slotCount == 0)
+    {
+        return nullptr;
+    }
+
+    int32_t i = perfectHashSlot( hash, displacement, bucketCount, slot, slotCount );
+
+    if (  i >= 0
+       && nameIs( text, len, synonyms[i].name )
+       )
+    {
+        return &synonyms[i];
+    }
+    return nullptr;
+}
+
+/*---------------------------------------------------------------------------*
+ findHeader() :
+ What a header means: the profile's say first, then the built in one.
+ nullptr if neither has heard of it.
+ *---------------------------------------------------------------------------*/
+static const HeaderSynonym * findHeader( const char * text
+                                       , size_t       len
+                                       )
+{
+    uint64_t              hash  = foldedHash( text, len );
+    const HeaderSynonym * found = findIn( headerProfile.synonyms.data()
+                                        , headerProfile.displacement.data()
+                                        , headerProfile.displacement.size()
+                                        , headerProfile.slot.data()
+                                        , headerProfile.slot.size()
+                                        , hash
+                                        , text
+                                        , len
+                                        );
+    if (found == nullptr)
+    {
+        found = findIn( BUILTIN_HEADERS
+                      , BUILTIN_TABLE.displacement
+                      , bucketsFor( BUILTIN_COUNT )
+                      , BUILTIN_TABLE.slot
+                      , slotsFor( BUILTIN_COUNT )
+                      , hash
+                      , text
+                      , len
+                      );
+    }
+    return found;
+}
+
+void mapHeader( const std::vector<FieldView> & fields
+              , HeaderMap                    & header
+              )
+{
+    header.commissionFound = false;
+    header.clearedFound    = false;
+    header.actionFound     = false;
+    header.txfrAcctFound   = false;
+    header.txfrAmtFound    = false;
+    header.prePendSF       = false;
+
+    header.columnName.clear();
+    header.fieldID   .clear();
+    header.columnName.reserve( fields.size() );
+    header.fieldID   .reserve( fields.size() );
+
+    // Get the field IDs for each column
+    for (const FieldView & field : fields)
+    {
+        const HeaderSynonym * synonym = findHeader( field.ptr, field.len );
+        char                  fieldID = synonym ? synonym->fieldID : FIELD_ID_IGNORE;
+
+        header.columnName.emplace_back( field.ptr, field.len );
+        header.fieldID   .push_back( fieldID );
+
+        if (  synonym
+           && synonym->prePendSF
+           )
+        {
+            header.prePendSF = true;
+        }
+
+        switch(fieldID)
+        {
+        case FIELD_ID_COMMISSION: header.commissionFound = true; break;
+        case FIELD_ID_CLEARED:    header.clearedFound    = true; break;
+        case FIELD_ID_ACTION:     header.actionFound     = true; break;
+        case FIELD_ID_TXFR_ACCT:  header.txfrAcctFound   = true; break;
+        case FIELD_ID_TXFR_AMNT:  header.txfrAmtFound    = true; break;
+        default:
+             break;
+        } // switch fieldID
+    } // for each column
+
+    header.columnCount = (int)fields.size();
+
+} // mapHeader()
+
+static bool isBlank( char c )
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static std::string profileError( const char        * filename
+                               , int                 lineNumber
+                               , const std::string & why
+                               )
+{
+    return std::string( "ERROR: Header profile...\n" )
+         + filename
+         + "\n...line "
+         + std::to_string( lineNumber )
+         + ": "
+         + why
+         + "\n";
+}
+
+bool loadHeaderProfile( const char  * filename
+                      , std::string & error
+                      )
+{
+    if (profileLoaded)
+    {
+        error = std::string( "ERROR: Only one header profile can be loaded...\n" )
+              + filename
+              + "\n...is one too many\n";
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open( filename ))
+    {
+        error = std::string( "ERROR: Header profile...\n" )
+              + filename
+              + "\n...not found\n";
+        return false;
+    }
+
+    HeaderProfile     profile;
+    const char *      p          = file.data();
+    const char *      end        = p + file.size();
+    int               lineNumber = 0;
+    std::vector<char> fieldIDs;
+    std::vector<bool> prePend;
+
+    // Notepad likes to start UTF-8 files with a byte order mark.
+    if (  end - p >= 3
+       && memcmp( p, "\xEF\xBB\xBF", 3 ) == 0
+       )
+    {
+        p += 3;
+    }
+
+    for (; p < end; p++)
+    {
+        const char * eol = (const char *)memchr( p, '\n', (size_t)( end - p ) );
+        const char * lineEnd;
+
+        eol     = eol ? eol : end;
+        lineEnd = eol;
+        lineNumber++;
+
+        while (p < lineEnd && isBlank( *p ))               p++;
+        while (lineEnd > p && isBlank( lineEnd[-1] ))      lineEnd--;
+
+        if (  p == lineEnd
+           || *p == '#'
+           )
+        {
+            p = eol;
+            continue;
+        }
+
+        // <header name> = <field code> [SF]; the header may itself contain
+        // an '=', so split at the last one.
+        const char * equals = lineEnd;
+        while (equals > p && equals[-1] != '=')
+        {
+            equals--;
+        }
+        if (equals == p)
+        {
+            error = profileError( filename, lineNumber, "expected <header name> = <field code>" );
+            return false;
+        }
+
+        const char * nameEnd = equals - 1;
+        const char * code    = equals;
+        while (nameEnd > p && isBlank( nameEnd[-1] ))      nameEnd--;
+        while (code < lineEnd && isBlank( *code ))         code++;
+
+        if (nameEnd == p)
+        {
+            error = profileError( filename, lineNumber, "no header name" );
+            return false;
+        }
+        if (  code == lineEnd
+           || strchr( FIELD_CODES, *code ) == nullptr
+           || (  code + 1 < lineEnd
+              && !isBlank( code[1] )
+              )
+           )
+        {
+            error = profileError( filename, lineNumber, std::string( "field code should be one of " ) + FIELD_CODES );
+            return false;
+        }
+
+        const char * option = code + 1;
+        while (option < lineEnd && isBlank( *option ))     option++;
+
+        std::string optionText( option, lineEnd );
+        if (  !optionText.empty()
+           && !equalsNoCase( optionText.c_str(), "SF" )
+           )
+        {
+            error = profileError( filename, lineNumber, "don't know what '" + optionText + "' means" );
+            return false;
+        }
+
+        // A header listed twice means whatever it said last.
+        std::string name( p, nameEnd );
+        size_t      n = 0;
+        while (  n < profile.names.size()
+              && !equalsNoCase( profile.names[n].c_str(), name.c_str() )
+              )
+        {
+            n++;
+        }
+        if (n == profile.names.size())
+        {
+            profile.names.push_back( name );
+            fieldIDs.push_back( 0 );
+            prePend .push_back( false );
+        }
+        fieldIDs[n] = *code;
+        prePend [n] = !optionText.empty();
+
+        p = eol;
+    } // for each line
+
+    size_t                count = profile.names.size();
+    std::vector<uint64_t> hashes( count );
+
+    // names is done growing, so the pointers into it stay put from here on
+    // (moving the vector doesn't move the strings).
+    for (size_t i = 0; i < count; i++)
+    {
+        const std::string & name = profile.names[i];
+
+        profile.synonyms.push_back( { name.c_str(), fieldIDs[i], prePend[i] } );
+        hashes[i] = foldedHash( name.c_str(), name.size() );
+    }
+
+    if (count > 0)
+    {
+        profile.displacement.resize( bucketsFor( count ) );
+        profile.slot        .resize( slotsFor  ( count ) );
+
+        if (!buildPerfectHash( hashes.data()
+                             , count
+                             , profile.displacement.data()
+                             , profile.displacement.size()
+                             , profile.slot.data()
+                             , profile.slot.size()
+                             ))
+        {
+            error = std::string( "ERROR: Header profile...\n" )
+                  + filename
+                  + "\n...has header names that can't be told apart\n";
+            return false;
+        }
+    }
+
+    headerProfile = std::move( profile );
+    profileLoaded = true;
+    return true;
+
+} // loadHeaderProfile()
@@ -0,0 +1,79 @@
+/*===========================================================================*
+ HeaderMap.h :
+ What each column of an export means, worked out once from its header line.
+ After mapHeader() fills one in it's only ever read, so any number of
+ threads can share it.
+
+ Header names are looked up in a case insensitive perfect hash of known
+ synonyms ("Date", "POSTING DATE", "FUND NAV/PRICE"...), built at compile
+ time.  Other custodians' exports can be described in a header profile -
+ a text file of
+
+     # comment
+     Trade Date       = D
+     Fund Description = Y SF
+     Settlement Date  = i
+
+ one header per line, the QIF field code it maps to (i ignores the column)
+ and SF if security names need SF_PREPEND.  A profile is loaded once,
+ before anything converts, hashed the same way and never changes after
+ that; its entries take precedence over the built in ones.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "CsvReader.h"
+#include "QifFormat.h"
+
+struct HeaderMap
+{
+    int                      columnCount;
+    std::vector<std::string> columnName;
+    std::vector<char>        fieldID;
+
+    // Which derived fields the export supplies itself...
+    bool commissionFound;
+    bool clearedFound;
+    bool actionFound;
+    bool txfrAcctFound;
+    bool txfrAmtFound;
+
+    // ...and whether the security names need SF_PREPEND.
+    bool prePendSF;
+};
+
+void mapHeader( const std::vector<FieldView> & fields
+              , HeaderMap                    & header
+              );
+
+// Load the header profile in filename.  Only one can be loaded, and it has
+// to happen before the first mapHeader().  On failure error says why.
+bool loadHeaderProfile( const char  * filename
+                      , std::string & error
+                      );
+
+// ASCII case insensitive a == b, the portable stand-in for _strcmpi() == 0.
+inline bool equalsNoCase( const char * a
+                        , const char * b
+                        )
+{
+    for (;; a++, b++)
+    {
+        char ca = ( *a >= 'A' && *a <= 'Z' ) ? (char)( *a + 'a' - 'A' ) : *a;
+        char cb = ( *b >= 'A' && *b <= 'Z' ) ? (char)( *b + 'a' - 'A' ) : *b;
+
+        if (ca != cb)
+        {
+            return false;
+        }
+        if (ca == '\0')
+        {
+            return true;
+        }
+    }
+}
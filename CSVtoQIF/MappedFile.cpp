@@ -0,0 +1,394 @@
+/*===========================================================================*
+ MappedFile.cpp :
+ Memory mapping (or, failing that, block reading) of the CSV input, and
+ writable mappings of the index files.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "MappedFile.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#ifdef    _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+// Granularity of the read() fallback.  Big enough that a pipe gets drained in
+// a handful of system calls, and a multiple of any page size we'll run on.
+const size_t READ_BLOCK_SIZE = 1 << 20;
+
+MappedFile::MappedFile()
+    : m_data  ( nullptr )
+    , m_size  ( 0 )
+    , m_mapped( false )
+    , m_writable( false )
+    , m_heap  ( nullptr )
+    #ifdef    _WIN32
+    , m_fileHandle( INVALID_HANDLE_VALUE )
+    , m_mapHandle ( nullptr )
+    #else
+    , m_fd        ( -1 )
+    #endif // _WIN32
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+/*---------------------------------------------------------------------------*
+ open() :
+ Map the named file.  Returns false (with nothing held) if the file can't be
+ opened at all; a file that opens but won't map falls back to readAll().
+ *---------------------------------------------------------------------------*/
+bool MappedFile::open( const char * filename )
+{
+    close();
+
+    #ifdef    _WIN32
+
+    m_fileHandle = CreateFileA( filename
+                              , GENERIC_READ
+                              , FILE_SHARE_READ | FILE_SHARE_WRITE
+                              , nullptr
+                              , OPEN_EXISTING
+                              , FILE_FLAG_SEQUENTIAL_SCAN
+                              , nullptr
+                              );
+    if (m_fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (  GetFileType  ( m_fileHandle ) == FILE_TYPE_DISK
+       && GetFileSizeEx( m_fileHandle, &fileSize )
+       && fileSize.QuadPart > 0
+       )
+    {
+        m_mapHandle = CreateFileMappingA( m_fileHandle
+                                        , nullptr
+                                        , PAGE_READONLY
+                                        , 0
+                                        , 0
+                                        , nullptr
+                                        );
+        if (m_mapHandle != nullptr)
+        {
+            m_data = (const char *)MapViewOfFile( m_mapHandle
+                                                , FILE_MAP_READ
+                                                , 0
+                                                , 0
+                                                , 0
+                                                );
+            if (m_data != nullptr)
+            {
+                m_size   = (size_t)fileSize.QuadPart;
+                m_mapped = true;
+                return true;
+            }
+            CloseHandle( m_mapHandle );
+            m_mapHandle = nullptr;
+        }
+    } // if it's a plain file worth mapping
+
+    CloseHandle( m_fileHandle );
+    m_fileHandle = INVALID_HANDLE_VALUE;
+
+    int fd = _open( filename, _O_RDONLY | _O_BINARY );
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = readAll( fd );
+    _close( fd );
+    return ok;
+
+    #else
+
+    int fd = ::open( filename, O_RDONLY );
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (  fstat( fd, &st ) == 0
+       && S_ISREG( st.st_mode )
+       && st.st_size > 0
+       )
+    {
+        void * view = mmap( nullptr
+                          , (size_t)st.st_size
+                          , PROT_READ
+                          , MAP_PRIVATE
+                          , fd
+                          , 0
+                          );
+        if (view != MAP_FAILED)
+        {
+            // We walk it front to back exactly once...
+            madvise( view, (size_t)st.st_size, MADV_SEQUENTIAL );
+
+            m_data   = (const char *)view;
+            m_size   = (size_t)st.st_size;
+            m_mapped = true;
+            ::close( fd );
+            return true;
+        }
+    } // if it's a plain file worth mapping
+
+    bool ok = readAll( fd );
+    ::close( fd );
+    return ok;
+
+    #endif // _WIN32
+
+} // MappedFile::open()
+
+#ifndef   _WIN32
+/*---------------------------------------------------------------------------*
+ reserveSpace() :
+ Make fd size bytes of zeros with the blocks to hold them allocated, not
+ a sparse file that only finds out the disk is full when a page of the
+ map is written back.
+ *---------------------------------------------------------------------------*/
+static bool reserveSpace( int    fd
+                        , size_t size
+                        )
+{
+    #ifdef    __APPLE__
+    fstore_t store = { F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0 };
+
+    return fcntl( fd, F_PREALLOCATE, &store ) != -1
+        && ftruncate( fd, (off_t)size ) == 0;
+    #else
+    return posix_fallocate( fd, 0, (off_t)size ) == 0;
+    #endif // __APPLE__
+}
+#endif // _WIN32
+
+/*---------------------------------------------------------------------------*
+ openForWriting() :
+ Create filename, emptying it if it's already there, make it size bytes
+ of zeros and map all of it shared, so writes land in the file.  Nothing
+ an earlier file of that name held survives into the new one.  False if
+ the disk hasn't room for it.
+ *---------------------------------------------------------------------------*/
+bool MappedFile::openForWriting( const char * filename
+                               , size_t       size
+                               )
+{
+    close();
+
+    if (size == 0)
+    {
+        return false;
+    }
+
+    #ifdef    _WIN32
+
+    m_fileHandle = CreateFileA( filename
+                              , GENERIC_READ | GENERIC_WRITE
+                              , FILE_SHARE_READ
+                              , nullptr
+                              , CREATE_ALWAYS
+                              , FILE_ATTRIBUTE_NORMAL
+                              , nullptr
+                              );
+    if (m_fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = (LONGLONG)size;
+
+    if (  SetFilePointerEx( m_fileHandle, fileSize, nullptr, FILE_BEGIN )
+       && SetEndOfFile    ( m_fileHandle )
+       )
+    {
+        m_mapHandle = CreateFileMappingA( m_fileHandle
+                                        , nullptr
+                                        , PAGE_READWRITE
+                                        , (DWORD)( (uint64_t)size >> 32 )
+                                        , (DWORD)size
+                                        , nullptr
+                                        );
+        if (m_mapHandle != nullptr)
+        {
+            m_data = (const char *)MapViewOfFile( m_mapHandle
+                                                , FILE_MAP_WRITE
+                                                , 0
+                                                , 0
+                                                , 0
+                                                );
+            if (m_data != nullptr)
+            {
+                m_size     = size;
+                m_mapped   = true;
+                m_writable = true;
+                return true;
+            }
+            CloseHandle( m_mapHandle );
+            m_mapHandle = nullptr;
+        }
+    } // if it's the right size
+
+    CloseHandle( m_fileHandle );
+    m_fileHandle = INVALID_HANDLE_VALUE;
+    return false;
+
+    #else
+
+    int fd = ::open( filename, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    void * view = MAP_FAILED;
+    if (reserveSpace( fd, size ))
+    {
+        view = mmap( nullptr
+                   , size
+                   , PROT_READ | PROT_WRITE
+                   , MAP_SHARED
+                   , fd
+                   , 0
+                   );
+    }
+
+    if (view == MAP_FAILED)
+    {
+        ::close( fd );
+        return false;
+    }
+
+    m_fd       = fd;
+    m_data     = (const char *)view;
+    m_size     = size;
+    m_mapped   = true;
+    m_writable = true;
+    return true;
+
+    #endif // _WIN32
+
+} // MappedFile::openForWriting()
+
+/*---------------------------------------------------------------------------*
+ flush() :
+ Wait for everything written to a writable map to be on the disk, so it
+ can be renamed into place knowing a crash won't leave zeros there.
+ *---------------------------------------------------------------------------*/
+bool MappedFile::flush()
+{
+    if (!m_writable)
+    {
+        return false;
+    }
+
+    #ifdef    _WIN32
+    return FlushViewOfFile( m_data, 0 )
+        && FlushFileBuffers( m_fileHandle );
+    #else
+    return msync( (void *)m_data, m_size, MS_SYNC ) == 0
+        && fsync( m_fd ) == 0;
+    #endif // _WIN32
+
+} // MappedFile::flush()
+
+/*---------------------------------------------------------------------------*
+ readAll() :
+ Fallback for things mmap() won't touch.  Reads READ_BLOCK_SIZE at a time
+ into a buffer that doubles as needed.
+ *---------------------------------------------------------------------------*/
+bool MappedFile::readAll( int fd )
+{
+    size_t capacity = READ_BLOCK_SIZE;
+    size_t used     = 0;
+    char * buffer   = (char *)malloc( capacity );
+
+    if (buffer == nullptr)
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        if (capacity - used < READ_BLOCK_SIZE)
+        {
+            char * bigger = (char *)realloc( buffer, capacity * 2 );
+            if (bigger == nullptr)
+            {
+                free( buffer );
+                return false;
+            }
+            buffer    = bigger;
+            capacity *= 2;
+        }
+
+        #ifdef    _WIN32
+        int got = _read( fd, buffer + used, (unsigned int)READ_BLOCK_SIZE );
+        #else
+        ssize_t got = ::read( fd, buffer + used, READ_BLOCK_SIZE );
+        #endif // _WIN32
+
+        if (got < 0)
+        {
+            free( buffer );
+            return false;
+        }
+        if (got == 0)
+        {
+            break;
+        }
+        used += (size_t)got;
+    } // for each block
+
+    m_heap = buffer;
+    m_data = buffer;
+    m_size = used;
+    return true;
+
+} // MappedFile::readAll()
+
+void MappedFile::close()
+{
+    if (m_mapped)
+    {
+        #ifdef    _WIN32
+        UnmapViewOfFile( m_data );
+        CloseHandle( m_mapHandle );
+        CloseHandle( m_fileHandle );
+        m_mapHandle  = nullptr;
+        m_fileHandle = INVALID_HANDLE_VALUE;
+        #else
+        munmap( (void *)m_data, m_size );
+        if (m_fd >= 0)
+        {
+            ::close( m_fd );
+            m_fd = -1;
+        }
+        #endif // _WIN32
+    }
+
+    free( m_heap );
+
+    m_heap     = nullptr;
+    m_data     = nullptr;
+    m_size     = 0;
+    m_mapped   = false;
+    m_writable = false;
+
+} // MappedFile::close()
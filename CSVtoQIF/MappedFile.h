@@ -0,0 +1,58 @@
+/*===========================================================================*
+ MappedFile.h :
+ Read-only view of a whole input file.  Regular files are memory mapped so
+ the rest of the converter can hand out pointers straight into the page
+ cache.  Anything that can't be mapped (pipes, character devices, empty
+ files) is slurped into one heap buffer in big aligned blocks instead, so
+ callers never have to care which one they got.
+
+ openForWriting() is the other way round: it creates a file of zeros
+ (emptying any that was there) and maps it shared and writable, for the
+ on-disk tables that are built in place.  The disk space is set aside up
+ front, so a full disk is a false return rather than a SIGBUS part way
+ through filling it in, and flush() gets it all onto the disk.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool         open ( const char * filename );
+    bool         openForWriting( const char * filename
+                               , size_t       size
+                               );
+    bool         flush();
+    void         close();
+
+    const char * data () const { return m_data; }
+    char       * writableData() const { return m_writable ? (char *)m_data : nullptr; }
+    size_t       size () const { return m_size; }
+    bool         isMapped() const { return m_mapped; }
+
+private:
+    MappedFile           ( const MappedFile & );   // not copyable
+    MappedFile & operator=( const MappedFile & );
+
+    bool         readAll  ( int fd );
+
+    const char * m_data;
+    size_t       m_size;
+    bool         m_mapped;
+    bool         m_writable;
+    char       * m_heap;       // only used by the read() fallback
+
+    #ifdef    _WIN32
+    void       * m_fileHandle;
+    void       * m_mapHandle;
+    #else
+    int          m_fd;         // a writable map's, for flush()
+    #endif // _WIN32
+
+}; // class MappedFile
@@ -0,0 +1,373 @@
+/*===========================================================================*
+ OfxSink.cpp :
+ Writing Transactions as an OFX 2 investment statement.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "OfxSink.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "DedupIndex.h"
+#include "FixedPoint.h"
+#include "QifRows.h"
+
+// Stands in for a YYYYMMDD date until end() knows it.
+#define DATE_PLACEHOLDER       "00000000"
+
+const size_t DATE_LEN = sizeof( DATE_PLACEHOLDER ) - 1;
+
+static bool startsWith( const FieldView & field
+                      , const char      * prefix
+                      )
+{
+    size_t len = strlen( prefix );
+
+    return field.len >= len
+        && memcmp( field.ptr, prefix, len ) == 0;
+}
+
+static void formatDate( uint32_t yyyymmdd
+                      , char     dest[DATE_LEN + 1]
+                      )
+{
+    for (size_t i = DATE_LEN; i > 0; i--)
+    {
+        dest[i - 1] = (char)( '0' + yyyymmdd % 10 );
+        yyyymmdd   /= 10;
+    }
+    dest[DATE_LEN] = '\0';
+}
+
+// What kind of income a Div / Reinv* action is.
+static const char * incomeType( const FieldView & action )
+{
+    if (startsWith( action, "ReinvInt" ) || startsWith( action, "IntInc"  )) return "INTEREST";
+    if (startsWith( action, "ReinvLg"  ) || startsWith( action, "CGLong"  )) return "CGLONG";
+    if (startsWith( action, "ReinvSh"  ) || startsWith( action, "CGShort" )) return "CGSHORT";
+    if (startsWith( action, "ReinvDiv" ) || startsWith( action, "Div"     )) return "DIV";
+    return "MISC";
+}
+
+OfxSink::OfxSink( QifWriter         & writer
+                , const std::string & account
+                )
+    : m_writer ( writer )
+    , m_account( account )
+    , m_startAt( 0 )
+    , m_first  ( 0 )
+    , m_last   ( 0 )
+    , m_undated( 0 )
+{
+    m_endAt[0] = m_endAt[1] = m_endAt[2] = 0;
+}
+
+void OfxSink::tag( const char * text )
+{
+    m_writer.buffer().line( text, strlen( text ) );
+}
+
+// <name>text</name>, with text's & < and > escaped.
+void OfxSink::element( const char * name
+                     , const char * text
+                     , size_t       len
+                     )
+{
+    QifBuffer & out     = m_writer.buffer();
+    size_t      nameLen = strlen( name );
+    size_t      run     = 0;
+
+    out.append( "<", 1 );
+    out.append( name, nameLen );
+    out.append( ">", 1 );
+    for (size_t i = 0; i < len; i++)
+    {
+        const char * entity = text[i] == '&' ? "&amp;"
+                            : text[i] == '<' ? "&lt;"
+                            : text[i] == '>' ? "&gt;"
+                            : nullptr;
+        if (entity != nullptr)
+        {
+            out.append( text + run, i - run );
+            out.append( entity, strlen( entity ) );
+            run = i + 1;
+        }
+    }
+    out.append( text + run, len - run );
+    out.append( "</", 2 );
+    out.append( name, nameLen );
+    out.line  ( ">", 1 );
+}
+
+void OfxSink::element( const char      * name
+                     , const FieldView & field
+                     )
+{
+    if (!field.escaped)
+    {
+        element( name, field.ptr, field.len );
+        return;
+    }
+    m_scratch.resize( field.len );
+    element( name, &m_scratch[0], csvUnescape( field, &m_scratch[0] ) );
+}
+
+void OfxSink::number( const char * name
+                    , int64_t      value
+                    , int          scale
+                    )
+{
+    char   text[DECIMAL_STR_LEN];
+    size_t len = formatDecimal( value, scale, scale, text );
+
+    element( name, text, len );
+}
+
+void OfxSink::secID( uint64_t id )
+{
+    char text[17];
+
+    snprintf( text, sizeof( text ), "%016llX", (unsigned long long)id );
+    tag( "<SECID>" );
+    element( "UNIQUEID", text, 16 );
+    element( "UNIQUEIDTYPE", "CSVTOQIF", 8 );
+    tag( "</SECID>" );
+}
+
+// <name>DATE_PLACEHOLDER</name>; returns where the placeholder is, as an
+// offset into the buffer - which is the file offset writeAt() wants, as
+// begin() writes them all before the first flush.  writeAt() can patch
+// them after any number of flushes, but only in an uncompressed file that
+// isn't stdout.
+size_t OfxSink::placeholder( const char * name )
+{
+    QifBuffer & out     = m_writer.buffer();
+    size_t      nameLen = strlen( name );
+    size_t      at;
+
+    out.append( "<", 1 );
+    out.append( name, nameLen );
+    out.append( ">", 1 );
+    at = out.size();
+    out.append( DATE_PLACEHOLDER, DATE_LEN );
+    out.append( "</", 2 );
+    out.append( name, nameLen );
+    out.line  ( ">", 1 );
+    return at;
+}
+
+void OfxSink::begin( const HeaderMap & )
+{
+    tag( "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>" );
+    tag( "<?OFX OFXHEADER=\"200\" VERSION=\"220\" SECURITY=\"NONE\" OLDFILEUID=\"NONE\" NEWFILEUID=\"NONE\"?>" );
+    tag( "<OFX>" );
+    tag( "<SIGNONMSGSRSV1>" );
+    tag( "<SONRS>" );
+    tag( "<STATUS>" );
+    element( "CODE", "0", 1 );
+    element( "SEVERITY", "INFO", 4 );
+    tag( "</STATUS>" );
+    m_endAt[0] = placeholder( "DTSERVER" );
+    element( "LANGUAGE", "ENG", 3 );
+    tag( "</SONRS>" );
+    tag( "</SIGNONMSGSRSV1>" );
+    tag( "<INVSTMTMSGSRSV1>" );
+    tag( "<INVSTMTTRNRS>" );
+    element( "TRNUID", "0", 1 );
+    tag( "<STATUS>" );
+    element( "CODE", "0", 1 );
+    element( "SEVERITY", "INFO", 4 );
+    tag( "</STATUS>" );
+    tag( "<INVSTMTRS>" );
+    m_endAt[1] = placeholder( "DTASOF" );
+    element( "CURDEF", "USD", 3 );
+    tag( "<INVACCTFROM>" );
+    element( "BROKERID", "csvtoqif", 8 );
+    element( "ACCTID", m_account.data(), m_account.size() );
+    tag( "</INVACCTFROM>" );
+    tag( "<INVTRANLIST>" );
+    m_startAt  = placeholder( "DTSTART" );
+    m_endAt[2] = placeholder( "DTEND" );
+}
+
+void OfxSink::transaction( const Transaction & t )
+{
+    uint32_t date;
+
+    if (!parseDate( t.date.ptr, t.date.len, date ))
+    {
+        m_undated++;
+        return;
+    }
+    m_first = ( m_first == 0 || date < m_first ) ? date : m_first;
+    m_last  = date > m_last ? date : m_last;
+
+    // The fund, as the QIF names it.
+    std::string & fund = m_fund;
+    fund.assign( t.securityPrefix );
+    fund.resize( fund.size() + t.security.len );
+    fund.resize( fund.size() - t.security.len + csvUnescape( t.security, &fund[fund.size() - t.security.len] ) );
+
+    // Exactly as named - funds that differ only in case are different.
+    TransactionKey fundKey;
+    fundKey.add( fund.data(), fund.size() );
+
+    uint64_t id = fundKey.value();
+    if (m_seen.insert( fund ).second)
+    {
+        m_fundIDs  .push_back( id );
+        m_fundNames.push_back( fund );
+    }
+
+    int64_t amount = t.amount.value < 0 ? -t.amount.value : t.amount.value;
+    int64_t units  = t.units.value  < 0 ? -t.units.value  : t.units.value;
+    int64_t price  = t.price.value  < 0 ? -t.price.value  : t.price.value;
+    bool    buy;
+    bool    reinvest = startsWith( t.action, "Reinv" );
+    bool    income   = startsWith( t.action, "Div"     )
+                    || startsWith( t.action, "IntInc"  )
+                    || startsWith( t.action, "CGLong"  )
+                    || startsWith( t.action, "CGShort" );
+
+    if (startsWith( t.action, "Buy" ) || startsWith( t.action, "ShrsIn" ))
+    {
+        buy = true;
+    }
+    else if (startsWith( t.action, "Sell" ) || startsWith( t.action, "ShrsOut" ))
+    {
+        buy = false;
+    }
+    else
+    {
+        buy = t.amount.value >= 0;
+    }
+
+    uint64_t key      = transactionKey( t );
+    char     fitid[32];
+    size_t   fitidLen = (size_t)snprintf( fitid, sizeof( fitid ), "%016llX-%u", (unsigned long long)key, ++m_occurrences[key] );
+    char   dateText[DATE_LEN + 1];
+    formatDate( date, dateText );
+
+    const char * kind = reinvest ? "REINVEST"
+                      : income   ? "INCOME"
+                      : buy      ? "BUYMF"
+                      :            "SELLMF";
+    const char * inner = reinvest || income ? nullptr
+                       : buy                ? "INVBUY"
+                       :                      "INVSELL";
+
+    QifBuffer & out = m_writer.buffer();
+    out.append( "<", 1 );
+    out.append( kind, strlen( kind ) );
+    out.line  ( ">", 1 );
+    if (inner != nullptr)
+    {
+        out.append( "<", 1 );
+        out.append( inner, strlen( inner ) );
+        out.line  ( ">", 1 );
+    }
+
+    tag( "<INVTRAN>" );
+    element( "FITID", fitid, fitidLen );
+    element( "DTTRADE", dateText, DATE_LEN );
+    if (t.memo.len > 0)
+    {
+        element( "MEMO", t.memo );
+    }
+    tag( "</INVTRAN>" );
+    secID( id );
+
+    if (reinvest || income)
+    {
+        const char * type = incomeType( t.action );
+
+        element( "INCOMETYPE", type, strlen( type ) );
+        number( "TOTAL", reinvest ? -amount : amount, AMOUNT_SCALE );
+        element( "SUBACCTSEC", "OTHER", 5 );
+        if (reinvest)
+        {
+            number( "UNITS", units, QUANTITY_SCALE );
+            number( "UNITPRICE", price, PRICE_SCALE );
+        }
+        else
+        {
+            element( "SUBACCTFUND", "OTHER", 5 );
+        }
+    }
+    else
+    {
+        number( "UNITS", buy ? units : -units, QUANTITY_SCALE );
+        number( "UNITPRICE", price, PRICE_SCALE );
+        number( "TOTAL", buy ? -amount : amount, AMOUNT_SCALE );
+        element( "SUBACCTSEC", "OTHER", 5 );
+        element( "SUBACCTFUND", "OTHER", 5 );
+
+        out.append( "</", 2 );
+        out.append( inner, strlen( inner ) );
+        out.line  ( ">", 1 );
+        element( buy ? "BUYTYPE" : "SELLTYPE", buy ? "BUY" : "SELL", buy ? 3 : 4 );
+    }
+
+    out.append( "</", 2 );
+    out.append( kind, strlen( kind ) );
+    out.line  ( ">", 1 );
+
+    m_writer.flushIfFull();
+
+} // OfxSink::transaction()
+
+void OfxSink::end()
+{
+    tag( "</INVTRANLIST>" );
+    tag( "</INVSTMTRS>" );
+    tag( "</INVSTMTTRNRS>" );
+    tag( "</INVSTMTMSGSRSV1>" );
+
+    if (!m_fundIDs.empty())
+    {
+        tag( "<SECLISTMSGSRSV1>" );
+        tag( "<SECLIST>" );
+        for (size_t i = 0; i < m_fundIDs.size(); i++)
+        {
+            tag( "<MFINFO>" );
+            tag( "<SECINFO>" );
+            secID( m_fundIDs[i] );
+            element( "SECNAME", m_fundNames[i].data(), m_fundNames[i].size() );
+            tag( "</SECINFO>" );
+            tag( "</MFINFO>" );
+        }
+        tag( "</SECLIST>" );
+        tag( "</SECLISTMSGSRSV1>" );
+    }
+    tag( "</OFX>" );
+
+    // Nothing dated - say it's as of today.
+    if (m_first == 0)
+    {
+        time_t    now = time( nullptr );
+        struct tm today;
+
+        #ifdef    _WIN32
+        gmtime_s( &today, &now );
+        #else
+        gmtime_r( &now, &today );
+        #endif // _WIN32
+
+        m_first = m_last = (uint32_t)( ( today.tm_year + 1900 ) * 10000 + ( today.tm_mon + 1 ) * 100 + today.tm_mday );
+    }
+
+    char first[DATE_LEN + 1];
+    char last [DATE_LEN + 1];
+
+    formatDate( m_first, first );
+    formatDate( m_last,  last  );
+    m_writer.writeAt( m_startAt, first, DATE_LEN );
+    for (size_t at : m_endAt)
+    {
+        m_writer.writeAt( at, last, DATE_LEN );
+    }
+
+} // OfxSink::end()
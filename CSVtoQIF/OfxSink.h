@@ -0,0 +1,88 @@
+/*===========================================================================*
+ OfxSink.h :
+ A TransactionSink that writes an OFX 2 investment statement: the
+ transactions in an INVTRANLIST, then a SECLIST of every fund they name.
+
+ QIF actions map to OFX transactions by name - Buy* and ShrsIn to BUYMF,
+ Sell* and ShrsOut to SELLMF, Reinv* to REINVEST, Div, IntInc, CGLong and
+ CGShort to INCOME - and anything else to BUYMF or SELLMF by the sign of
+ the amount.  Funds have no CUSIP in the exports, so each gets a made up
+ UNIQUEID (a hash of its exact name) of type CSVTOQIF.
+
+ Quicken skips transactions whose FITID it has imported before, so a
+ FITID has to stay the same for the same transaction and differ for any
+ other, whichever file it turns up in.  It's the transaction's key (see
+ transactionKey()) and how many times that key has come up in the file
+ so far, since identical rows are still separate transactions.
+
+ The statement's date range comes before the transactions but isn't known
+ until they've all gone by, so it's written as a placeholder and filled in
+ by end().  Nothing but the list of funds and the count of each key is
+ kept in memory.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "QifWriter.h"
+#include "Transaction.h"
+
+#define OFX_EXTENSION          ".ofx"
+
+class OfxSink : public TransactionSink
+{
+public:
+    // account is what goes in the statement's ACCTID.
+    OfxSink( QifWriter         & writer
+           , const std::string & account
+           );
+
+    void begin      ( const HeaderMap & header ) override;
+    void transaction( const Transaction & transaction ) override;
+    void end        () override;
+
+    // Rows left out because there was no telling what day they were.
+    size_t undated  () const { return m_undated; }
+
+private:
+    OfxSink           ( const OfxSink & );      // not copyable
+    OfxSink & operator=( const OfxSink & );
+
+    void   tag        ( const char * text );
+    void   element    ( const char * name
+                      , const char * text
+                      , size_t       len
+                      );
+    void   element    ( const char      * name
+                      , const FieldView & field
+                      );
+    void   number     ( const char * name
+                      , int64_t      value
+                      , int          scale
+                      );
+    void   secID      ( uint64_t     id );
+    size_t placeholder( const char * name );
+
+    QifWriter                  & m_writer;
+    std::string                  m_account;
+    size_t                       m_startAt;     // offsets of the date placeholders
+    size_t                       m_endAt[3];
+    uint32_t                     m_first;       // YYYYMMDD, 0 before the first row
+    uint32_t                     m_last;
+    size_t                       m_undated;
+
+    std::unordered_map<uint64_t, uint32_t> m_occurrences;  // transaction key -> times seen
+    std::unordered_set<std::string>        m_seen;         // funds, by exact name
+    std::vector<uint64_t>        m_fundIDs;     // ...in the order they turned up
+    std::vector<std::string>     m_fundNames;
+    std::string                  m_fund;        // this row's, with the prefix
+    std::string                  m_scratch;     // for unescaping
+
+}; // class OfxSink
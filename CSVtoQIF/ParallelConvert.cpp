@@ -0,0 +1,208 @@
+/*===========================================================================*
+ ParallelConvert.cpp :
+ Chunking a single export at row boundaries and converting the chunks
+ concurrently with ordered output.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "ParallelConvert.h"
+#include "QifRows.h"
+
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+// Smallest chunk worth handing to a worker.
+const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// Chunks per thread.  More than one so a slow chunk doesn't leave the rest
+// of the pool idle at the end.
+const size_t CHUNKS_PER_THREAD = 4;
+
+static size_t countQuotes( const char * p
+                         , const char * end
+                         )
+{
+    size_t count = 0;
+
+    while (p < end)
+    {
+        const char * quote = (const char *)memchr( p, '"', (size_t)( end - p ) );
+        if (quote == nullptr)
+        {
+            break;
+        }
+        count++;
+        p = quote + 1;
+    }
+    return count;
+}
+
+std::vector<size_t> findChunkStarts( ThreadPool & pool
+                                   , const char * data
+                                   , size_t       begin
+                                   , size_t       size
+                                   , size_t       chunks
+                                   )
+{
+    std::vector<size_t> starts( 1, begin );
+    size_t              len = size - begin;
+
+    if (chunks < 2)
+    {
+        return starts;
+    }
+
+    // Quote count of each equal slice, in parallel.
+    std::vector<size_t> quotes( chunks );
+
+    for (size_t k = 0; k < chunks; k++)
+    {
+        pool.submit( [&, k]
+                     {
+                         quotes[k] = countQuotes( data + begin + len *   k       / chunks
+                                                , data + begin + len * ( k + 1 ) / chunks
+                                                );
+                     }
+                   );
+    }
+    pool.wait();
+
+    // Walk each slice boundary forward to the first newline outside quotes.
+    bool inQuotes = false;
+    for (size_t k = 1; k < chunks; k++)
+    {
+        inQuotes ^= ( quotes[k - 1] & 1 ) != 0;
+
+        const char * p     = data + begin + len * k / chunks;
+        const char * end   = data + size;
+        bool         state = inQuotes;
+
+        while (p < end)
+        {
+            if (*p == '"')
+            {
+                state = !state;
+            }
+            else if (  *p == '\n'
+                    && !state
+                    )
+            {
+                break;
+            }
+            p++;
+        }
+
+        size_t start = (size_t)( p - data ) + 1;
+        if (  start < size
+           && start > starts.back()
+           )
+        {
+            starts.push_back( start );
+        }
+    } // for each slice boundary
+
+    return starts;
+
+} // findChunkStarts()
+
+size_t convertParallel( const HeaderMap & header
+                      , const char      * data
+                      , size_t            begin
+                      , size_t            size
+                      , unsigned          threads
+                      , QifWriter       & writer
+                      , RowChecks       & checks
+                      )
+{
+    if (threads == 0)
+    {
+        threads = ThreadPool::defaultThreads();
+    }
+
+    size_t chunks = ( size - begin ) / MIN_CHUNK_BYTES;
+    if (chunks > threads * CHUNKS_PER_THREAD)
+    {
+        chunks = threads * CHUNKS_PER_THREAD;
+    }
+
+    ThreadPool          pool( threads );
+    std::vector<size_t> starts = findChunkStarts( pool, data, begin, size, chunks );
+
+    struct Chunk
+    {
+        QifBuffer out;
+        RowChecks checks;
+        size_t    rows;
+        bool      done;
+    };
+
+    std::vector<Chunk>      chunk( starts.size() );
+    std::mutex              lock;
+    std::condition_variable finished;
+    size_t                  submitted = 0;
+    size_t                  written   = 0;
+    size_t                  rowCount  = 0;
+
+    // Never get more than this many chunks ahead of the writer, so memory
+    // stays bounded by the window rather than the file.
+    size_t window = 2 * (size_t)threads;
+
+    while (written < chunk.size())
+    {
+        for (; submitted < chunk.size() && submitted < written + window; submitted++)
+        {
+            size_t k = submitted;
+
+            chunk[k].rows   = 0;
+            chunk[k].done   = false;
+            chunk[k].checks = checks.emptyCopy();
+
+            pool.submit( [&, k]
+                         {
+                             size_t    end = ( k + 1 < starts.size() ) ? starts[k + 1] : size;
+                             CsvReader reader( data + starts[k], end - starts[k] );
+
+                             chunk[k].out.reserve( end - starts[k] + ( end - starts[k] ) / 2 );
+                             size_t rows = renderRows( header, reader, chunk[k].out, chunk[k].checks );
+
+                             std::lock_guard<std::mutex> guard( lock );
+                             chunk[k].rows = rows;
+                             chunk[k].done = true;
+                             finished.notify_all();
+                         }
+                       );
+        }
+
+        // Wait for the next chunk in order, then take it and everything
+        // finished right behind it.
+        std::vector<const QifBuffer *> ready;
+        size_t                         next = written;
+        {
+            std::unique_lock<std::mutex> guard( lock );
+            finished.wait( guard, [&] { return chunk[written].done; } );
+
+            for (; next < submitted && chunk[next].done; next++)
+            {
+                ready.push_back( &chunk[next].out );
+            }
+        }
+
+        STATS_MARK( checks.stats, mark );
+        writer.writeBuffers( ready );
+        STATS_LAP( checks.stats, STAT_FLUSH, mark );
+
+        for (; written < next; written++)
+        {
+            rowCount += chunk[written].rows;
+            checks.add( chunk[written].checks );
+            chunk[written].out.release();
+        }
+    } // while there are chunks to write
+
+    pool.wait();
+    return rowCount;
+
+} // convertParallel()
@@ -0,0 +1,50 @@
+/*===========================================================================*
+ ParallelConvert.h :
+ Converting one big export on several threads.
+
+ The data rows are cut into chunks at row boundaries.  Quoted fields may
+ contain newlines, so a boundary is only a newline with an even number of
+ quotes before it - the same rule CsvReader uses.  Quote counts for each
+ slice of the file are taken in parallel and summed, so finding the
+ boundaries doesn't need a serial pass over the whole file.
+
+ Each chunk is rendered into its own QifBuffer on a ThreadPool worker and
+ the buffers are written in file order as they complete - every run of
+ finished chunks in one gathered write - so the output is byte-for-byte
+ what renderRows() would produce on one thread.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "HeaderMap.h"
+#include "QifRows.h"
+#include "QifWriter.h"
+#include "ThreadPool.h"
+
+// Files smaller than this aren't worth splitting.
+const size_t PARALLEL_MIN_BYTES = 4 << 20;
+
+// Offsets where chunks of roughly equal size start within data[begin, size).
+// The first is always begin; each later one is the start of a row.
+std::vector<size_t> findChunkStarts( ThreadPool & pool
+                                   , const char * data
+                                   , size_t       begin
+                                   , size_t       size
+                                   , size_t       chunks
+                                   );
+
+// Convert the rows in data[begin, size) on threads workers (0 = one per
+// core), writing the QIF transactions to writer in input order and adding
+// every chunk's findings to checks.  Returns the number of rows converted.
+size_t convertParallel( const HeaderMap & header
+                      , const char      * data
+                      , size_t            begin
+                      , size_t            size
+                      , unsigned          threads
+                      , QifWriter       & writer
+                      , RowChecks       & checks
+                      );
@@ -0,0 +1,226 @@
+/*===========================================================================*
+ PerfectHash.h :
+ Case insensitive perfect hashing of a fixed set of names, for lookups on
+ the per-row path: the header synonyms (HeaderMap.cpp) and the activity
+ types of the action rules (ActionRules.cpp).
+
+ A set of names is hashed once - by the compiler, if it's constexpr data -
+ into a displacement per bucket and a table of slots.  Looking a name up
+ is then one hash of the text, one bucket, one slot and one compare with
+ the name found there.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+constexpr char foldCase( char c )
+{
+    return ( c >= 'A' && c <= 'Z' ) ? (char)( c + 'a' - 'A' ) : c;
+}
+
+constexpr size_t textLength( const char * text )
+{
+    size_t len = 0;
+    while (text[len] != '\0')
+    {
+        len++;
+    }
+    return len;
+}
+
+// 64 bit FNV-1a of the case folded text.
+constexpr uint64_t foldedHash( const char * text
+                             , size_t       len
+                             )
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)foldCase( text[i] );
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Finish a hash off so its low bits are worth using.
+constexpr uint64_t mix( uint64_t hash )
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+constexpr size_t bucketOf( uint64_t hash
+                         , size_t   bucketCount
+                         )
+{
+    return (size_t)mix( hash ) & ( bucketCount - 1 );
+}
+
+constexpr size_t slotOf( uint64_t hash
+                       , uint32_t displacement
+                       , size_t   slotCount
+                       )
+{
+    return (size_t)mix( hash + displacement * 0x9E3779B97F4A7C15ULL ) & ( slotCount - 1 );
+}
+
+constexpr size_t powerOf2AtLeast( size_t n )
+{
+    size_t power = 1;
+    while (power < n)
+    {
+        power <<= 1;
+    }
+    return power;
+}
+
+// Roughly four names to a bucket, and a table at most half full.
+constexpr size_t bucketsFor( size_t count ) { return powerOf2AtLeast( ( count + 3 ) / 4 ); }
+constexpr size_t slotsFor  ( size_t count ) { return powerOf2AtLeast( count * 2 ); }
+
+const uint32_t MAX_DISPLACEMENT = 1 << 16;
+
+// Marks a bucket's displacement as still holding its size, not yet placed.
+const uint32_t UNPLACED         = 0x80000000;
+
+/*---------------------------------------------------------------------------*
+ buildPerfectHash() :
+ Hash and displace.  Names are split into buckets by hash, then each
+ bucket, biggest first, gets the smallest displacement that lands all of
+ its names in empty slots.  A lookup is then one hash of the text, one
+ bucket, one slot and one compare.
+
+ constexpr so the compiler does the built in table; profiles go through
+ the same code when they're loaded.  False if some bucket won't place,
+ which takes two names that fold to the same text.
+ *---------------------------------------------------------------------------*/
+constexpr bool buildPerfectHash( const uint64_t * hashes
+                               , size_t           count
+                               , uint32_t       * displacement
+                               , size_t           bucketCount
+                               , int32_t        * slot
+                               , size_t           slotCount
+                               )
+{
+    size_t biggest = 0;
+
+    for (size_t s = 0; s < slotCount; s++)
+    {
+        slot[s] = -1;
+    }
+    for (size_t b = 0; b < bucketCount; b++)
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            size += bucketOf( hashes[i], bucketCount ) == b ? 1 : 0;
+        }
+        displacement[b] = UNPLACED | (uint32_t)size;
+        biggest         = size > biggest ? size : biggest;
+    }
+
+    for (size_t size = biggest; size > 0; size--)
+    {
+        for (size_t b = 0; b < bucketCount; b++)
+        {
+            if (displacement[b] != ( UNPLACED | (uint32_t)size ))
+            {
+                continue;
+            }
+
+            uint32_t d = 1;
+            for (; d < MAX_DISPLACEMENT; d++)
+            {
+                bool fits = true;
+                for (size_t i = 0; i < count && fits; i++)
+                {
+                    if (bucketOf( hashes[i], bucketCount ) == b)
+                    {
+                        size_t s = slotOf( hashes[i], d, slotCount );
+                        if (slot[s] >= 0)
+                        {
+                            fits = false;
+                        }
+                        else
+                        {
+                            slot[s] = (int32_t)i;
+                        }
+                    }
+                } // for each name in the bucket
+
+                if (fits)
+                {
+                    break;
+                }
+
+                // Take back the ones that did fit and try the next one.
+                for (size_t i = 0; i < count; i++)
+                {
+                    if (bucketOf( hashes[i], bucketCount ) == b)
+                    {
+                        size_t s = slotOf( hashes[i], d, slotCount );
+                        if (slot[s] == (int32_t)i)
+                        {
+                            slot[s] = -1;
+                        }
+                    }
+                }
+            } // for each displacement
+
+            if (d == MAX_DISPLACEMENT)
+            {
+                return false;
+            }
+            displacement[b] = d;
+        } // for each bucket this size
+    } // for each bucket size, biggest first
+
+    for (size_t b = 0; b < bucketCount; b++)
+    {
+        if (displacement[b] == UNPLACED)     // empty
+        {
+            displacement[b] = 0;
+        }
+    }
+    return true;
+
+} // buildPerfectHash()
+
+// The index of the only name text could be (-1 if none), for
+// nameIs() to confirm.
+inline int32_t perfectHashSlot( uint64_t         hash
+                              , const uint32_t * displacement
+                              , size_t           bucketCount
+                              , const int32_t  * slot
+                              , size_t           slotCount
+                              )
+{
+    return slot[slotOf( hash, displacement[bucketOf( hash, bucketCount )], slotCount )];
+}
+
+/*---------------------------------------------------------------------------*
+ nameIs() :
+ Case insensitive compare of a (non NUL terminated) field to a name.
+ *---------------------------------------------------------------------------*/
+inline bool nameIs( const char * text
+                  , size_t       len
+                  , const char * name
+                  )
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (  name[i] == '\0'
+           || foldCase( text[i] ) != foldCase( name[i] )
+           )
+        {
+            return false;
+        }
+    }
+    return name[len] == '\0';
+}
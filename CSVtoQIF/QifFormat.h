@@ -0,0 +1,107 @@
+/*===========================================================================*
+ QifFormat.h :
+ QIF field codes and the handful of magic strings the converter knows about
+ (State Farm activity types, the actions and transfer account it derives).
+
+ *===========================================================================*/
+
+#pragma once
+
+const int MEMO_STR_LEN    = 32;
+
+// Line ending a text mode FILE * would have written.
+#ifdef    _WIN32
+#define QIF_EOL                "\r\n"
+#else
+#define QIF_EOL                "\n"
+#endif // _WIN32
+
+#define HEADER_LINE            "!Type:Invst"
+#define END_TRANSACTION        "^"
+#define IMPORT_ALL_TXFR        "!Option:AllXfr"
+#define ACTIVITY_BEFORE_TAX    "Before-Tax"
+#define ACTIVITY_COMPANY_MATCH "Company Match"
+#define ACTIVITY_CONTRIBUTIONS "Nonelective Contributions"
+#define ACTIVITY_WITHDRAWLS    "Withdrawals"
+#define SF_PREPEND             "SF "
+#define ACTION_SELLX           "SellX"
+#define ACTION_BUYX            "BuyX"
+#define ACTION_BUY             "Buy"
+#define CASH_TSFR_ACCT         "Cash"
+#define SECURITY_LINE          "!Type:Security"
+#define PRICES_LINE            "!Type:Prices"
+#define SECURITY_TYPE_FUND     "Mutual Fund"
+
+#define FIELD_ID_IGNORE     'i'
+#define FIELD_ID_DATE       'D'
+#define FIELD_ID_ACTION     'N'
+#define FIELD_ID_SECURITY   'Y'
+#define FIELD_ID_PRICE      'I'
+#define FIELD_ID_QUANTITY   'Q'
+#define FIELD_ID_AMOUNT     'T'
+#define FIELD_ID_CLEARED    'C'
+#define FIELD_ID_MEMO       'M'
+#define FIELD_ID_COMMISSION 'O'
+#define FIELD_ID_TXFR_ACCT  'L'
+#define FIELD_ID_TXFR_AMNT  '$'
+
+// In a !Type:Security entry.
+#define FIELD_ID_SEC_NAME   'N'
+#define FIELD_ID_SEC_TYPE   'T'
+/*
+Items for Investment Accounts
+
+Field 	Indicator Explanation
+D 	Date
+N 	Action
+Y 	Security
+I 	Price
+Q 	Quantity (number of shares or split ratio)
+T 	Transaction amount
+C 	Cleared status
+P 	Text in the first line for transfers and reminders
+M 	Memo
+O 	Commission
+L 	Account for the transfer
+$ 	Amount transferred
+^ 	End of the entry
+
+Column headers from State Farm...
+i   VALUATION DATE   (ignore)
+D   POSTING DATE     Date
+M   ACTIVITY TYPE  * Memo
+i   PLAN             "State Farm 401(k) Savings Plan" s/b "State Farm 401(k)" (ignore)
+i   ACCOUNT          (Same as ACTIVITY TYPE (ignore))
+Y   FUND             Security Name (Prepend "SF ")
+T   AMOUNT         * Amount
+I   FUND NAV/PRICE   Price
+Q   FUND UNITS       Quantity
+N   (derived)        Action  ( BuyX if T > 0 and M=Before-Tax, SellX T < 0)
+O   (derived)        Commission (0 if not found)
+C   (derived)        Cleared Status (X if not found)
+L   (derived)        Account for the transfer (cash if M=Before-Tax)
+$   (derived)        Amount transferred (=T if M=Before-Tax)
+
+Investment Example
+
+Transaction Item 	Comment (not in file)
+!Type:Invst 	Header line
+D8/25/93 	Date
+NShrsIn 	Action (optional)
+Yibm4 	Security
+I11.260 	Price
+Q88.81 	Quantity
+CX 	Cleared Status
+T1,000.00 	Amount
+MOpening 	Balance Memo
+^ 	End of the transaction
+D8/25/93 	Date
+NBuyX 	Action
+Yibm4 	Security
+I11.030 	Price
+Q9.066 	Quantity
+T100.00 	Amount
+MEst. price as of 8/25/93 	Memo
+L[CHECKING] 	Account for transfer
+$100.00 	Amount transferred
+^ 	End of the transaction*/
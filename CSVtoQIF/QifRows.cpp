@@ -0,0 +1,430 @@
+/*===========================================================================*
+ QifRows.cpp :
+ Per-row conversion: the column dispatch and the derived field rules that
+ used to be the body of main()'s read loop, and writing the result as QIF.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "QifRows.h"
+
+#include <string.h>
+
+#include "ActionRules.h"
+#include "FixedPoint.h"
+
+static inline void setText( FieldView  & field
+                          , const char * text
+                          , size_t       len
+                          )
+{
+    field.ptr     = text;
+    field.len     = len;
+    field.escaped = false;
+}
+
+/*---------------------------------------------------------------------------*
+ parseNumber() :
+ parseDecimal() a column, counting it in checks if it's there but isn't a
+ number.  True if d holds a value.
+ *---------------------------------------------------------------------------*/
+static bool parseNumber( const FieldView & field
+                       , int               scale
+                       , Decimal         & d
+                       , RowChecks       & checks
+                       )
+{
+    DecimalStatus status = parseDecimal( field.ptr, field.len, scale, d );
+
+    if (  status == DECIMAL_INVALID
+       || status == DECIMAL_OVERFLOW
+       )
+    {
+        checks.badNumbers++;
+    }
+    return status == DECIMAL_OK;
+}
+
+/*---------------------------------------------------------------------------*
+ reformat() :
+ If a number column parsed but isn't plain digits, write it out again into
+ storage and point its line there.  1,234.50 / $12.00 / (3.25) - Quicken
+ wants plain digits.
+ *---------------------------------------------------------------------------*/
+static void reformat( TransactionLine * line
+                    , bool              parsed
+                    , const Decimal   & d
+                    , int               scale
+                    , char            * storage
+                    )
+{
+    if (  parsed
+       && !d.plain
+       )
+    {
+        setText( line->text, storage, formatDecimal( d.value, scale, d.digits, storage ) );
+    }
+}
+
+static inline void addLine( TransactionLine * & line
+                          , char                fieldID
+                          , const char        * text
+                          , size_t              len
+                          )
+{
+    line->fieldID   = fieldID;
+    line->prefix    = "";
+    line->prefixLen = 0;
+    setText( line->text, text, len );
+    line++;
+}
+
+// N, O, C, L and $.
+const size_t DERIVED_LINES = 5;
+
+/*---------------------------------------------------------------------------*
+ transactionKey() :
+ Posting date, security (with its prefix), amount, units and memo.  A
+ number that didn't parse goes in as it was exported, which is what its
+ line shows when it didn't.
+ *---------------------------------------------------------------------------*/
+uint64_t transactionKey( const Transaction & t )
+{
+    TransactionKey key;
+
+    key.add( t.date.ptr, t.date.len );
+    if (*t.securityPrefix != '\0')
+    {
+        key.add( t.securityPrefix, strlen( t.securityPrefix ) );
+    }
+    key.add( t.security.ptr, t.security.len );
+    if (t.hasAmount) key.add( t.amount.value );
+    else             key.add( t.amountLine.ptr, t.amountLine.len );
+    if (t.hasUnits)  key.add( t.units.value );
+    else             key.add( t.unitsLine.ptr, t.unitsLine.len );
+    key.add( t.memo.ptr, t.memo.len );
+
+    return key.value();
+
+} // transactionKey()
+
+// Lines are filled in where they sit rather than built up in temporaries
+// and copied there, which was a measurable part of the time per row.
+bool makeTransaction( const HeaderMap              & header
+                    , const std::vector<FieldView> & fields
+                    , Transaction                  & t
+                    , RowChecks                    & checks
+                    )
+{
+    static const FieldView EMPTY = { "", 0, false };
+
+    const char      * fieldID    = header.fieldID.data();
+    const char      * prefix     = header.prePendSF ? SF_PREPEND : "";
+    size_t            prefixLen  = header.prePendSF ? sizeof( SF_PREPEND ) - 1 : 0;
+    Decimal           zero       = { 0, 0, true };
+
+    STATS_COUNT( checks.stats, STAT_ROWS_READ );
+
+    t.date           = EMPTY;
+    t.security       = EMPTY;
+    t.securityPrefix = prefix;
+    t.memo           = EMPTY;
+    t.action         = EMPTY;
+    t.commission     = EMPTY;
+    t.cleared        = EMPTY;
+    t.txfrAcct       = EMPTY;
+    t.txfrAmount     = EMPTY;
+    t.amount         = zero;
+    t.price          = zero;
+    t.units          = zero;
+    t.hasAmount      = false;
+    t.hasPrice       = false;
+    t.hasUnits       = false;
+    t.amountLine     = EMPTY;
+    t.priceLine      = EMPTY;
+    t.unitsLine      = EMPTY;
+
+    // A line per column at most, and the derived ones.
+    if (t.lines.size() < (size_t)header.columnCount + DERIVED_LINES)
+    {
+        t.lines.resize( (size_t)header.columnCount + DERIVED_LINES );
+    }
+
+    TransactionLine * line    = t.lines.data();
+    const FieldView * column  = fields.data();
+    size_t            columns = fields.size() < (size_t)header.columnCount ? fields.size() : (size_t)header.columnCount;
+
+    for (size_t i = 0; i < columns; i++)
+    {
+        const FieldView & field = column[i];
+        TransactionLine * added = line;
+
+        if (  fieldID[i] != FIELD_ID_IGNORE
+           && field.len  >  0
+           )
+        {
+            line->fieldID   = fieldID[i];
+            line->prefix    = "";
+            line->prefixLen = 0;
+            line->text      = field;
+            line++;
+        }
+
+        switch(fieldID[i])
+        {
+        case FIELD_ID_DATE:
+            t.date = field;
+            break;
+
+        case FIELD_ID_SECURITY:
+            t.security = field;
+            if (added != line)
+            {
+                added->prefix    = prefix;
+                added->prefixLen = prefixLen;
+            }
+            break;
+
+        case FIELD_ID_ACTION:
+            t.action = field;
+            break;
+
+        case FIELD_ID_AMOUNT:
+            if (field.len >= (size_t)MEMO_STR_LEN)
+            {
+                STATS_COUNT( checks.stats, STAT_LONG_FIELDS );
+            }
+            t.hasAmount = parseNumber( field, AMOUNT_SCALE, t.amount, checks );
+            if (added != line)
+            {
+                reformat( added, t.hasAmount, t.amount, AMOUNT_SCALE, t.amountText );
+                t.amountLine = added->text;
+            }
+            else
+            {
+                t.amountLine = EMPTY;
+            }
+            break;
+
+        case FIELD_ID_PRICE:
+            t.hasPrice = parseNumber( field, PRICE_SCALE, t.price, checks );
+            if (added != line)
+            {
+                reformat( added, t.hasPrice, t.price, PRICE_SCALE, t.priceText );
+                t.priceLine = added->text;
+            }
+            else
+            {
+                t.priceLine = EMPTY;
+            }
+            break;
+
+        case FIELD_ID_QUANTITY:
+            t.hasUnits = parseNumber( field, QUANTITY_SCALE, t.units, checks );
+            if (added != line)
+            {
+                reformat( added, t.hasUnits, t.units, QUANTITY_SCALE, t.unitsText );
+                t.unitsLine = added->text;
+            }
+            else
+            {
+                t.unitsLine = EMPTY;
+            }
+            break;
+
+        case FIELD_ID_COMMISSION:
+            t.commission = field;
+            break;
+
+        case FIELD_ID_CLEARED:
+            t.cleared = field;
+            break;
+
+        case FIELD_ID_TXFR_ACCT:
+            t.txfrAcct = field;
+            break;
+
+        case FIELD_ID_TXFR_AMNT:
+            t.txfrAmount = field;
+            break;
+
+        case FIELD_ID_MEMO:
+            t.memo = field;
+            if (field.len >= (size_t)MEMO_STR_LEN)
+            {
+                STATS_COUNT( checks.stats, STAT_LONG_FIELDS );
+            }
+            break;
+        default:
+            break;
+        } // switch fieldID
+    } // for each column
+
+    // Units at the quoted price should come to the amount, give or take
+    // the rounding each was quoted with.
+    if (  t.hasAmount
+       && t.hasPrice
+       && t.hasUnits
+       && !priceTimesQuantityMatches( t.price, t.units, t.amount )
+       )
+    {
+        checks.priceMismatches++;
+    }
+
+    // What the activity type and the sign of the amount make of the row
+    // (see ActionRules.h)...
+    const ActionRule & rule = findActionRule( t.memo, t.amount.value < 0 );
+
+    // Deal with derived columns...
+
+    // FIELD_ID_ACTION
+    if(!header.actionFound)
+    {
+        setText( t.action, rule.action, rule.actionLen );
+        if (rule.statCounter >= 0)
+        {
+            STATS_COUNT( checks.stats, rule.statCounter );
+        }
+        addLine( line, FIELD_ID_ACTION, t.action.ptr, t.action.len );
+    } // if !actionFound
+
+    // I think commision is a required field...
+    // FIELD_ID_COMMISSION
+    if(!header.commissionFound)
+    {
+        addLine( line, FIELD_ID_COMMISSION, "0.0", sizeof( "0.0" ) - 1 );
+        t.commission = line[-1].text;
+    }
+
+    // Mark 'em all cleared...
+    // FIELD_ID_CLEARED
+    if(!header.clearedFound)
+    {
+        addLine( line, FIELD_ID_CLEARED, "X", sizeof( "X" ) - 1 );
+        t.cleared = line[-1].text;
+    }
+
+    // Deal with cash transfers...
+    // FIELD_ID_TXFR_ACCT
+    // FIELD_ID_TXFR_AMNT
+    if (rule.txfrAcct != nullptr)
+    {
+        if (  !header.txfrAcctFound
+           || !header.txfrAmtFound
+           )
+        {
+            STATS_COUNT( checks.stats, STAT_TRANSFERS );
+        }
+        if(!header.txfrAcctFound)
+        {
+            addLine( line, FIELD_ID_TXFR_ACCT, rule.txfrAcct, rule.txfrAcctLen );
+            t.txfrAcct = line[-1].text;
+        }
+        if(!header.txfrAmtFound)
+        {
+            addLine( line, FIELD_ID_TXFR_AMNT, t.amountLine.ptr, t.amountLine.len );
+            line[-1].text.escaped = t.amountLine.escaped;
+            t.txfrAmount = line[-1].text;
+        }
+    } // if this needs a transfer account
+
+    t.lineCount = (size_t)( line - t.lines.data() );
+
+    // Written before?  Then leave it out.
+    if (checks.dedup != nullptr)
+    {
+        uint64_t value = transactionKey( t );
+        if (checks.dedup->contains( value ))
+        {
+            checks.duplicates++;
+            if (!checks.skipDuplicates)
+            {
+                STATS_COUNT( checks.stats, STAT_ROWS_EMITTED );
+            }
+            return !checks.skipDuplicates;
+        }
+        checks.newKeys.push_back( value );
+    } // if deduplicating
+
+    STATS_COUNT( checks.stats, STAT_ROWS_EMITTED );
+    return true;
+
+} // makeTransaction()
+
+void writeTransaction( const Transaction & transaction
+                     , QifBuffer         & out
+                     )
+{
+    for (size_t i = 0; i < transaction.lineCount; i++)
+    {
+        const TransactionLine & line = transaction.lines[i];
+
+        if (  line.prefixLen == 0
+           && !line.text.escaped
+           )
+        {
+            out.field( line.fieldID, line.text.ptr, line.text.len );
+        }
+        else
+        {
+            out.field( line.fieldID, line.prefix, line.prefixLen, line.text );
+        }
+    }
+    out.line( END_TRANSACTION, sizeof( END_TRANSACTION ) - 1 );
+}
+
+size_t renderRows( const HeaderMap & header
+                 , CsvReader       & reader
+                 , QifBuffer       & out
+                 , RowChecks       & checks
+                 )
+{
+    std::vector<FieldView> fields;
+    Transaction            transaction;
+    size_t                 rowCount = 0;
+
+    STATS_MARK( checks.stats, mark );
+
+    while (reader.nextRow( fields ))
+    {
+        STATS_LAP( checks.stats, STAT_PARSE, mark );
+        if (makeTransaction( header, fields, transaction, checks ))
+        {
+            STATS_LAP( checks.stats, STAT_DERIVE, mark );
+            writeTransaction( transaction, out );
+            STATS_LAP( checks.stats, STAT_EMIT, mark );
+        }
+        else
+        {
+            STATS_LAP( checks.stats, STAT_DERIVE, mark );
+        }
+        rowCount++;
+    }
+    return rowCount;
+}
+
+/*---------------------------------------------------------------------------*
+ QifSink
+ *---------------------------------------------------------------------------*/
+void QifSink::begin( const HeaderMap & )
+{
+    m_writer.buffer().line( HEADER_LINE, sizeof( HEADER_LINE ) - 1 );
+}
+
+void QifSink::transaction( const Transaction & transaction )
+{
+    if (  m_stats == nullptr
+       || !m_stats->timing
+       )
+    {
+        writeTransaction( transaction, m_writer.buffer() );
+        m_writer.flushIfFull();
+        return;
+    }
+
+    STATS_MARK( *m_stats, mark );
+    writeTransaction( transaction, m_writer.buffer() );
+    STATS_LAP( *m_stats, STAT_EMIT, mark );
+    m_writer.flushIfFull();
+    STATS_LAP( *m_stats, STAT_FLUSH, mark );
+}
@@ -0,0 +1,111 @@
+/*===========================================================================*
+ QifRows.h :
+ Turning CSV data rows into transactions, and transactions into QIF.
+
+ makeTransaction() applies the column mapping and the derived field rules
+ (action, commission, cleared, the cash transfer - see ActionRules.h) to a
+ row.  The QIF side renders into a QifBuffer, so chunks of one file can be
+ rendered on different threads and written out in order afterwards (see
+ ParallelConvert.h).
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "CsvReader.h"
+#include "DedupIndex.h"
+#include "HeaderMap.h"
+#include "QifWriter.h"
+#include "Stats.h"
+#include "Transaction.h"
+
+// What makeTransaction() found wrong with the numbers, counted over rows,
+// (if dedup is set) which rows were written before, and the --stats
+// counters and timers.
+struct RowChecks
+{
+    size_t                badNumbers;       // amount, price or units that isn't a number
+    size_t                priceMismatches;  // price x units too far from the amount
+    size_t                duplicates;       // rows dedup already had
+
+    const DedupIndex    * dedup;
+    bool                  skipDuplicates;   // or just count them
+    std::vector<uint64_t> newKeys;          // dedup keys of the rows written
+    ConvertStats          stats;
+
+    RowChecks() : badNumbers( 0 ), priceMismatches( 0 ), duplicates( 0 ), dedup( nullptr ), skipDuplicates( true ) {}
+
+    // No counts yet, but the same dedup settings - for another chunk.
+    RowChecks emptyCopy() const
+    {
+        RowChecks copy;
+        copy.dedup          = dedup;
+        copy.skipDuplicates = skipDuplicates;
+        copy.stats.timing   = stats.timing;
+        return copy;
+    }
+
+    // Fold in the next chunk's findings.
+    void add( const RowChecks & other )
+    {
+        badNumbers      += other.badNumbers;
+        priceMismatches += other.priceMismatches;
+        duplicates      += other.duplicates;
+        newKeys.insert( newKeys.end(), other.newKeys.begin(), other.newKeys.end() );
+        stats.add( other.stats );
+    }
+};
+
+// Turn one data row into transaction.  False if it's a duplicate that
+// should be left out (see RowChecks::skipDuplicates).
+bool   makeTransaction ( const HeaderMap              & header
+                       , const std::vector<FieldView> & fields
+                       , Transaction                  & transaction
+                       , RowChecks                    & checks
+                       );
+
+// What a transaction is known by from one export or run to the next: the
+// key DedupIndex keeps (see TransactionKey), and OFX FITIDs are made from.
+uint64_t transactionKey( const Transaction & transaction );
+
+// Append transaction, as QIF, to out.
+void   writeTransaction( const Transaction & transaction
+                       , QifBuffer         & out
+                       );
+
+// Render every row the reader has left into out.  Returns the row count.
+size_t renderRows( const HeaderMap & header
+                 , CsvReader       & reader
+                 , QifBuffer       & out
+                 , RowChecks       & checks
+                 );
+
+/*---------------------------------------------------------------------------*
+ QifSink :
+ A TransactionSink that writes a QIF file: the !Type line, then each
+ transaction through writer, which it flushes as the buffer fills.  With
+ stats, that time goes to STAT_EMIT and STAT_FLUSH.
+ *---------------------------------------------------------------------------*/
+class QifSink : public TransactionSink
+{
+public:
+    QifSink( QifWriter    & writer
+           , ConvertStats * stats = nullptr
+           )
+        : m_writer( writer )
+        , m_stats ( stats )
+    {
+    }
+
+    void begin      ( const HeaderMap & header ) override;
+    void transaction( const Transaction & transaction ) override;
+
+private:
+    QifWriter    & m_writer;
+    ConvertStats * m_stats;
+
+}; // class QifSink
@@ -0,0 +1,453 @@
+/*===========================================================================*
+ QifWriter.cpp :
+ Buffer management and the file descriptor side of QIF output.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "QifWriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <atomic>
+#include <filesystem>
+#include <new>
+#include <system_error>
+
+#ifdef    _WIN32
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif // _WIN32
+
+/*---------------------------------------------------------------------------*
+ QifBuffer
+ *---------------------------------------------------------------------------*/
+QifBuffer::QifBuffer()
+    : m_data    ( nullptr )
+    , m_size    ( 0 )
+    , m_capacity( 0 )
+{
+}
+
+QifBuffer::~QifBuffer()
+{
+    free( m_data );
+}
+
+void QifBuffer::reserve( size_t capacity )
+{
+    if (capacity > m_capacity)
+    {
+        char * data = (char *)realloc( m_data, capacity );
+        if (data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        m_data     = data;
+        m_capacity = capacity;
+    }
+}
+
+void QifBuffer::release()
+{
+    free( m_data );
+    m_data     = nullptr;
+    m_size     = 0;
+    m_capacity = 0;
+}
+
+void QifBuffer::grow( size_t needed )
+{
+    size_t capacity = m_capacity ? m_capacity * 2 : 4096;
+
+    while (capacity < needed)
+    {
+        capacity *= 2;
+    }
+    reserve( capacity );
+}
+
+void QifBuffer::field( char              fieldID
+                     , const char      * prefix
+                     , size_t            prefixLen
+                     , const FieldView & value
+                     )
+{
+    char * p = claim( 1 + prefixLen + value.len + QIF_EOL_LEN );
+
+    *p++ = fieldID;
+    memcpy( p, prefix, prefixLen );
+    p += prefixLen;
+
+    if (value.escaped)
+    {
+        // Claimed room for the raw text; give back what collapsing saved.
+        size_t len = csvUnescape( value, p );
+        m_size -= value.len - len;
+        p      += len;
+    }
+    else
+    {
+        memcpy( p, value.ptr, value.len );
+        p += value.len;
+    }
+
+    memcpy( p, QIF_EOL, QIF_EOL_LEN );
+
+} // QifBuffer::field()
+
+/*---------------------------------------------------------------------------*
+ QifWriter
+ *---------------------------------------------------------------------------*/
+QifWriter::QifWriter()
+    : m_fd    ( -1 )
+    , m_ownsFd( false )
+    , m_failed( false )
+{
+}
+
+static int takeStdout()
+{
+    fflush( stdout );
+
+    #ifdef    _WIN32
+    int fd = _dup( 1 );
+    _dup2( 2, 1 );
+    _setmode( fd, _O_BINARY );
+    #else
+    int fd = dup( 1 );
+    dup2( 2, 1 );
+    #endif // _WIN32
+
+    return fd;
+}
+
+/*---------------------------------------------------------------------------*
+ claimStdout() :
+ A descriptor for what stdout was, with stdout itself pointed at stderr
+ from the first call on, so nothing else printf()s into the QIF.
+ *---------------------------------------------------------------------------*/
+int claimStdout()
+{
+    static int fd = takeStdout();
+
+    return fd;
+}
+
+/*---------------------------------------------------------------------------*
+ temporaryName() :
+ <filename>.<pid>-<n>.tmp - a name no other writer, in this process or
+ another, is using, even for the same filename.
+ *---------------------------------------------------------------------------*/
+static std::string temporaryName( const std::string & filename )
+{
+    static std::atomic<unsigned> next( 0 );
+
+    #ifdef    _WIN32
+    unsigned pid = (unsigned)_getpid();
+    #else
+    unsigned pid = (unsigned)getpid();
+    #endif // _WIN32
+
+    return filename + "." + std::to_string( pid ) + "-" + std::to_string( next++ ) + ".tmp";
+}
+
+QifWriter::~QifWriter()
+{
+    // Never closed - an atomic file's unfinished.
+    m_failed = m_failed || !m_temporary.empty();
+    close();
+}
+
+bool QifWriter::open( const char * filename
+                    , bool         atomic
+                    , Compression  compression
+                    )
+{
+    close();
+
+    bool toStdout = strcmp( filename, STANDARD_STREAM ) == 0;
+
+    m_filename  = filename;
+    m_temporary = atomic && !toStdout ? temporaryName( m_filename ) : std::string();
+    if (!m_temporary.empty())
+    {
+        filename = m_temporary.c_str();
+    }
+
+    m_compressor.reset( Compressor::create( compression ) );
+    if (  compression != COMPRESSION_NONE
+       && !m_compressor
+       )
+    {
+        m_temporary.clear();
+        return false;                   // not built in
+    }
+
+    if (toStdout)
+    {
+        m_fd = claimStdout();
+    }
+    else
+    {
+        #ifdef    _WIN32
+        m_fd = _open( filename
+                    , _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY
+                    , _S_IREAD | _S_IWRITE
+                    );
+        #else
+        m_fd = ::open( filename
+                     , O_WRONLY | O_CREAT | O_TRUNC
+                     , 0666
+                     );
+        #endif // _WIN32
+    }
+
+    m_ownsFd = !toStdout;
+    m_failed = false;
+    m_buffer.reserve( QIF_FLUSH_SIZE + QIF_FLUSH_SIZE / 4 );
+
+    return m_fd >= 0;
+}
+
+bool QifWriter::close()
+{
+    if (m_fd < 0)
+    {
+        return !m_failed;
+    }
+
+    flush();
+    if (m_compressor)
+    {
+        m_failed = !m_compressor->finish( m_compressed ) || m_failed;
+        writeRaw( m_compressed.data(), m_compressed.size() );
+        m_compressor.reset();
+        m_compressed.clear();
+    }
+
+    if (m_ownsFd)                       // stdout stays open
+    {
+        #ifdef    _WIN32
+        if (_close( m_fd ) != 0)
+        #else
+        if (::close( m_fd ) != 0)
+        #endif // _WIN32
+        {
+            m_failed = true;
+        }
+    }
+    m_fd = -1;
+
+    if (!m_temporary.empty())
+    {
+        std::error_code error;
+        if (!m_failed)
+        {
+            std::filesystem::rename( m_temporary, m_filename, error );
+            m_failed = (bool)error;
+        }
+        if (m_failed)
+        {
+            std::filesystem::remove( m_temporary, error );
+        }
+        m_temporary.clear();
+    }
+
+    m_buffer.release();
+    return !m_failed;
+
+} // QifWriter::close()
+
+/*---------------------------------------------------------------------------*
+ abandon() :
+ Something else went wrong, so what's been written mustn't be taken for
+ the whole file: close it as if writing it had failed, which leaves
+ nothing under filename if it's atomic.
+ *---------------------------------------------------------------------------*/
+void QifWriter::abandon()
+{
+    m_failed = m_fd >= 0 || m_failed;
+    close();
+}
+
+void QifWriter::writeAll( const char * data
+                        , size_t       len
+                        )
+{
+    if (!m_compressor)
+    {
+        writeRaw( data, len );
+        return;
+    }
+    if (  !m_failed
+       && !m_compressor->write( data, len, m_compressed )
+       )
+    {
+        m_failed = true;
+    }
+    writeRaw( m_compressed.data(), m_compressed.size() );
+    m_compressed.clear();
+}
+
+void QifWriter::writeRaw( const char * data
+                        , size_t       len
+                        )
+{
+    while (  len > 0
+          && !m_failed
+          )
+    {
+        #ifdef    _WIN32
+        int chunk = len > 0x40000000 ? 0x40000000 : (int)len;
+        int wrote = _write( m_fd, data, (unsigned int)chunk );
+        #else
+        ssize_t wrote = ::write( m_fd, data, len );
+        #endif // _WIN32
+
+        if (wrote <= 0)
+        {
+            m_failed = true;
+            break;
+        }
+        data += wrote;
+        len  -= (size_t)wrote;
+    }
+}
+
+void QifWriter::flush()
+{
+    writeAll( m_buffer.data(), m_buffer.size() );
+    m_buffer.clear();
+}
+
+void QifWriter::write( const void * data
+                      , size_t       len
+                      )
+{
+    flush();
+    writeAll( (const char *)data, len );
+}
+
+void QifWriter::writeAt( size_t       offset
+                       , const char * data
+                       , size_t       len
+                       )
+{
+    flush();
+    if (  m_compressor
+       || !m_ownsFd
+       )
+    {
+        m_failed = true;                // can't go back
+    }
+    if (m_failed)
+    {
+        return;
+    }
+
+    #ifdef    _WIN32
+    __int64 end = _lseeki64( m_fd, 0, SEEK_END );
+    if (  end < 0
+       || _lseeki64( m_fd, (__int64)offset, SEEK_SET ) < 0
+       )
+    {
+        m_failed = true;
+        return;
+    }
+    writeRaw( data, len );
+    if (_lseeki64( m_fd, end, SEEK_SET ) < 0)
+    {
+        m_failed = true;
+    }
+    #else
+    while (len > 0)
+    {
+        ssize_t wrote = ::pwrite( m_fd, data, len, (off_t)offset );
+
+        if (wrote <= 0)
+        {
+            m_failed = true;
+            break;
+        }
+        data   += wrote;
+        len    -= (size_t)wrote;
+        offset += (size_t)wrote;
+    }
+    #endif // _WIN32
+
+} // QifWriter::writeAt()
+
+void QifWriter::writeBuffers( const std::vector<const QifBuffer *> & buffers )
+{
+    flush();
+
+    #ifdef    _WIN32
+    for (const QifBuffer * buffer : buffers)
+    {
+        writeAll( buffer->data(), buffer->size() );
+    }
+    #else
+    if (m_compressor)
+    {
+        for (const QifBuffer * buffer : buffers)
+        {
+            writeAll( buffer->data(), buffer->size() );
+        }
+        return;
+    }
+
+    #ifdef    IOV_MAX
+    const size_t maxIov = IOV_MAX;
+    #else
+    const size_t maxIov = 16;
+    #endif // IOV_MAX
+
+    size_t next = 0;
+    while (  next < buffers.size()
+          && !m_failed
+          )
+    {
+        struct iovec iov[64];
+        size_t       count = 0;
+
+        for (; next < buffers.size() && count < maxIov && count < 64; next++)
+        {
+            if (buffers[next]->size() == 0)
+            {
+                continue;
+            }
+            iov[count].iov_base = (void *)buffers[next]->data();
+            iov[count].iov_len  = buffers[next]->size();
+            count++;
+        }
+
+        ssize_t wrote = count ? ::writev( m_fd, iov, (int)count ) : 0;
+        if (wrote < 0)
+        {
+            m_failed = true;
+            break;
+        }
+
+        // Short write - finish whatever's left of this batch the slow way.
+        size_t done = (size_t)wrote;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (done >= iov[i].iov_len)
+            {
+                done -= iov[i].iov_len;
+                continue;
+            }
+            writeRaw( (const char *)iov[i].iov_base + done, iov[i].iov_len - done );
+            done = 0;
+        }
+    } // while there are buffers left
+    #endif // _WIN32
+
+} // QifWriter::writeBuffers()
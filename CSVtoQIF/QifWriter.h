@@ -0,0 +1,201 @@
+/*===========================================================================*
+ QifWriter.h :
+ QIF output without stdio.
+
+ QifBuffer is a growable byte buffer with just enough knowledge of QIF to
+ append "<field code><text><EOL>" lines: no format strings, no locale, no
+ locking.  QifWriter owns the output file descriptor and a QifBuffer, and
+ writes the buffer out in QIF_FLUSH_SIZE pieces.  Several finished buffers
+ can also be written with one gathered write (writev() where there is one),
+ which is how ParallelConvert emits its chunks.
+
+ Lines end in QIF_EOL, which is what the text mode FILE * used to produce,
+ so the bytes on disk are the same as before.
+
+ An atomic QifWriter writes to a temporary file of its own next to it
+ (<filename>.<pid>-<n>.tmp) and only renames it over filename once close()
+ has written every byte, so whatever picks up the file - Quicken, or a
+ script waiting for it - never sees half of one, and two writers can't
+ write into the same temporary file.
+ Destroying it without a close(), or calling abandon(), throws the
+ temporary file away.
+
+ A QifWriter can also compress what it writes (see Compression.h), and
+ write to stdout for "-" - in which case everything printf() says goes to
+ stderr instead, so the QIF is all there is on stdout.  Neither can go
+ back and writeAt().
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Compression.h"
+#include "CsvReader.h"
+#include "QifFormat.h"
+
+// Once a buffer gets this big it's worth writing out.
+const size_t QIF_FLUSH_SIZE = 1 << 20;
+
+const size_t QIF_EOL_LEN = sizeof( QIF_EOL ) - 1;
+
+class QifBuffer
+{
+public:
+    QifBuffer();
+    ~QifBuffer();
+
+    const char * data    () const { return m_data; }
+    size_t       size    () const { return m_size; }
+    void         clear   ()       { m_size = 0; }
+    void         truncate( size_t size ) { m_size = size; }   // size <= size()
+    void         reserve ( size_t capacity );
+    void         release ();      // clear() and give the memory back
+
+    // <fieldID><text><EOL>
+    void field( char         fieldID
+              , const char * text
+              , size_t       len
+              );
+
+    // <fieldID><prefix><field's text, "" collapsed><EOL>
+    void field( char              fieldID
+              , const char      * prefix
+              , size_t            prefixLen
+              , const FieldView & value
+              );
+
+    // <text><EOL>
+    void line ( const char * text
+              , size_t       len
+              );
+
+    // <text>, as is - for output that isn't QIF (see OfxSink.h).
+    void append( const char * text
+               , size_t       len
+               )
+    {
+        memcpy( claim( len ), text, len );
+    }
+
+private:
+    QifBuffer           ( const QifBuffer & );    // not copyable
+    QifBuffer & operator=( const QifBuffer & );
+
+    // Make room for len more bytes and return where they go.
+    char * claim( size_t len )
+    {
+        if (m_size + len > m_capacity)
+        {
+            grow( m_size + len );
+        }
+        char * p = m_data + m_size;
+        m_size += len;
+        return p;
+    }
+
+    void   grow ( size_t needed );
+
+    char * m_data;
+    size_t m_size;
+    size_t m_capacity;
+
+}; // class QifBuffer
+
+inline void QifBuffer::field( char         fieldID
+                            , const char * text
+                            , size_t       len
+                            )
+{
+    char * p = claim( 1 + len + QIF_EOL_LEN );
+
+    *p++ = fieldID;
+    memcpy( p, text, len );
+    memcpy( p + len, QIF_EOL, QIF_EOL_LEN );
+}
+
+inline void QifBuffer::line( const char * text
+                           , size_t       len
+                           )
+{
+    char * p = claim( len + QIF_EOL_LEN );
+
+    memcpy( p, text, len );
+    memcpy( p + len, QIF_EOL, QIF_EOL_LEN );
+}
+
+// A descriptor for what stdout was; from the first call on, stdout itself
+// is stderr, so nothing else printf()s into the QIF.
+int claimStdout();
+
+class QifWriter
+{
+public:
+    QifWriter();
+    ~QifWriter();
+
+    bool        open   ( const char * filename
+                       , bool         atomic      = false
+                       , Compression  compression = COMPRESSION_NONE
+                       );
+    bool        close  ();          // flush, close; false if anything failed
+    void        abandon();          // close, and keep none of it if atomic
+
+    QifBuffer & buffer () { return m_buffer; }
+
+    // Write the buffer out if it's past QIF_FLUSH_SIZE.
+    void        flushIfFull()
+    {
+        if (m_buffer.size() >= QIF_FLUSH_SIZE)
+        {
+            flush();
+        }
+    }
+    void        flush  ();
+
+    // Flush, then write each of buffers in order with as few calls as the
+    // platform allows.
+    void        writeBuffers( const std::vector<const QifBuffer *> & buffers );
+
+    // Flush, then write data straight out rather than copying it into the
+    // buffer first - for big blocks of it.
+    void        write  ( const void * data
+                       , size_t       len
+                       );
+
+    // Flush, then overwrite len bytes at offset from the start of the file
+    // with data, for something that wasn't known when it was first written.
+    // Later writes still go on the end.
+    void        writeAt( size_t       offset
+                       , const char * data
+                       , size_t       len
+                       );
+
+    bool        failed () const { return m_failed; }
+
+private:
+    QifWriter           ( const QifWriter & );    // not copyable
+    QifWriter & operator=( const QifWriter & );
+
+    void        writeAll( const char * data
+                        , size_t       len
+                        );
+    void        writeRaw( const char * data
+                        , size_t       len
+                        );
+
+    int         m_fd;
+    bool        m_ownsFd;           // not stdout
+    bool        m_failed;
+    QifBuffer   m_buffer;
+    std::string m_filename;         // with m_temporary, if atomic
+    std::string m_temporary;
+    std::unique_ptr<Compressor> m_compressor;
+    std::vector<char>           m_compressed;   // on its way to m_fd
+
+}; // class QifWriter
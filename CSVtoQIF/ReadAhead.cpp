@@ -0,0 +1,111 @@
+/*===========================================================================*
+ ReadAhead.cpp :
+ The reader thread and the ring it fills.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "ReadAhead.h"
+
+ReadAhead::ReadAhead( InputStream & input )
+    : m_input   ( input )
+    , m_chunks  ( READ_AHEAD_CHUNKS )
+    , m_lens    ( READ_AHEAD_CHUNKS, 0 )
+    , m_first   ( 0 )
+    , m_filled  ( 0 )
+    , m_holding ( false )
+    , m_ended   ( false )
+    , m_stopping( false )
+{
+    for (std::vector<char> & chunk : m_chunks)
+    {
+        chunk.resize( READ_AHEAD_CHUNK );
+    }
+    m_thread = std::thread( &ReadAhead::readLoop, this );
+}
+
+ReadAhead::~ReadAhead()
+{
+    {
+        std::lock_guard<std::mutex> guard( m_lock );
+        m_stopping = true;
+    }
+    m_writable.notify_all();
+    m_thread.join();
+}
+
+void ReadAhead::readLoop()
+{
+    for (;;)
+    {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> guard( m_lock );
+
+            // The held chunk still counts as filled, so it's never reused
+            // while the converter has it.
+            m_writable.wait( guard, [this] { return m_stopping || m_filled < m_chunks.size(); } );
+            if (m_stopping)
+            {
+                return;
+            }
+            slot = ( m_first + m_filled ) % m_chunks.size();
+        }
+
+        // Fill it right up - fewer, bigger feed()s.
+        std::vector<char> & chunk = m_chunks[slot];
+        size_t              len   = 0;
+        size_t              got   = 1;
+
+        while (  len < chunk.size()
+              && got > 0
+              )
+        {
+            got  = m_input.read( chunk.data() + len, chunk.size() - len );
+            len += got;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard( m_lock );
+
+            if (len > 0)
+            {
+                m_lens[slot] = len;
+                m_filled++;
+            }
+            m_ended = got == 0;
+        }
+        m_readable.notify_one();
+
+        if (got == 0)
+        {
+            return;
+        }
+    } // for each chunk
+
+} // ReadAhead::readLoop()
+
+const char * ReadAhead::next( size_t & len )
+{
+    std::unique_lock<std::mutex> guard( m_lock );
+
+    if (m_holding)
+    {
+        m_first   = ( m_first + 1 ) % m_chunks.size();
+        m_filled--;
+        m_holding = false;
+        m_writable.notify_one();
+    }
+
+    m_readable.wait( guard, [this] { return m_filled > 0 || m_ended; } );
+    if (m_filled == 0)
+    {
+        len = 0;
+        return nullptr;
+    }
+
+    m_holding = true;
+    len       = m_lens[m_first];
+    return m_chunks[m_first].data();
+
+} // ReadAhead::next()
@@ -0,0 +1,59 @@
+/*===========================================================================*
+ ReadAhead.h :
+ Reads (and decompresses) an InputStream on a thread of its own, into a
+ ring of READ_AHEAD_CHUNKS chunks, so the converter can get on with one
+ chunk while the next is being read.  The reader stops when the ring's
+ full and the converter waits when it's empty, so memory is bounded by
+ the ring however big the export is.
+
+ next() hands out one chunk at a time and takes back the one before; what
+ it returns is good until the next call.  Chunks split rows anywhere,
+ which Converter::feed() doesn't mind.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Compression.h"
+
+const size_t READ_AHEAD_CHUNK  = 1 << 20;
+const size_t READ_AHEAD_CHUNKS = 8;
+
+class ReadAhead
+{
+public:
+    // Starts reading input straight away.
+    explicit ReadAhead( InputStream & input );
+    ~ReadAhead();
+
+    // The next piece of the input, nullptr once it's all been handed out
+    // (or reading it failed - see InputStream::error()).
+    const char * next( size_t & len );
+
+private:
+    ReadAhead           ( const ReadAhead & );  // not copyable
+    ReadAhead & operator=( const ReadAhead & );
+
+    void         readLoop();
+
+    InputStream                    & m_input;
+    std::vector<std::vector<char> >  m_chunks;
+    std::vector<size_t>              m_lens;
+    size_t                           m_first;       // oldest filled chunk
+    size_t                           m_filled;      // chunks from m_first on
+    bool                             m_holding;     // next() handed out m_first
+    bool                             m_ended;       // the reader's done
+    bool                             m_stopping;
+
+    std::mutex                       m_lock;
+    std::condition_variable          m_readable;    // a chunk filled, or m_ended
+    std::condition_variable          m_writable;    // a chunk freed, or m_stopping
+    std::thread                      m_thread;
+
+}; // class ReadAhead
@@ -0,0 +1,190 @@
+/*===========================================================================*
+ SecuritySink.cpp :
+ Interning fund names, keeping a price per fund and day, and writing them
+ out as QIF lists.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "SecuritySink.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+#include "CsvReader.h"
+#include "FixedPoint.h"
+#include "PerfectHash.h"
+#include "QifFormat.h"
+
+const size_t SYMBOL_MIN_SLOTS = 64;
+
+SymbolTable::SymbolTable()
+    : m_starts( 1, 0 )
+    , m_slots ( SYMBOL_MIN_SLOTS, 0 )
+{
+}
+
+uint32_t SymbolTable::intern( const char * name
+                            , size_t       len
+                            )
+{
+    uint64_t hash = mix( foldedHash( name, len ) );
+    size_t   mask = m_slots.size() - 1;
+
+    for (size_t slot = (size_t)hash & mask; ; slot = ( slot + 1 ) & mask)
+    {
+        uint32_t found = m_slots[slot];
+
+        if (found == 0)
+        {
+            uint32_t id = (uint32_t)size();
+
+            m_text.append( name, len );
+            m_starts.push_back( m_text.size() );
+            m_hashes.push_back( hash );
+            m_slots[slot] = id + 1;
+
+            // No more than half full.
+            if (size() * 2 > m_slots.size())
+            {
+                rehash( m_slots.size() * 2 );
+            }
+            return id;
+        }
+        if (  m_hashes[found - 1] == hash
+           && nameLen( found - 1 ) == len
+           && memcmp( this->name( found - 1 ), name, len ) == 0
+           )
+        {
+            return found - 1;
+        }
+    }
+
+} // SymbolTable::intern()
+
+void SymbolTable::rehash( size_t slotCount )
+{
+    size_t mask = slotCount - 1;
+
+    m_slots.assign( slotCount, 0 );
+    for (uint32_t id = 0; id < (uint32_t)size(); id++)
+    {
+        size_t slot = (size_t)m_hashes[id] & mask;
+
+        while (m_slots[slot] != 0)
+        {
+            slot = ( slot + 1 ) & mask;
+        }
+        m_slots[slot] = id + 1;
+    }
+}
+
+SecuritySink::SecuritySink( QifWriter & writer )
+    : m_writer   ( writer )
+    , m_conflicts( 0 )
+{
+}
+
+void SecuritySink::transaction( const Transaction & t )
+{
+    if (t.security.len == 0)
+    {
+        return;
+    }
+
+    // The fund, as the QIF names it.
+    std::string & fund = m_fund;
+    fund.assign( t.securityPrefix );
+    fund.resize( fund.size() + t.security.len );
+    fund.resize( fund.size() - t.security.len + csvUnescape( t.security, &fund[fund.size() - t.security.len] ) );
+
+    uint32_t id = m_symbols.intern( fund.data(), fund.size() );
+    uint32_t date;
+
+    if (  !t.hasPrice
+       || t.price.value <= 0
+       || !parseDate( t.date.ptr, t.date.len, date )
+       )
+    {
+        return;
+    }
+
+    Price price = { t.price.value, t.price.digits };
+    std::pair<std::unordered_map<uint64_t, Price>::iterator, bool> added
+        = m_prices.emplace( (uint64_t)id << 32 | date, price );
+
+    if (  !added.second
+       && added.first->second.value != price.value
+       )
+    {
+        m_conflicts++;
+    }
+
+} // SecuritySink::transaction()
+
+/*---------------------------------------------------------------------------*
+ end() :
+ !Type:Security                     !Type:Prices
+ N<fund>                            "<fund>",<price>,"MM/DD/YYYY"
+ TMutual Fund                       ^
+ ^
+ *---------------------------------------------------------------------------*/
+void SecuritySink::end()
+{
+    QifBuffer & out = m_writer.buffer();
+
+    if (m_symbols.size() == 0)
+    {
+        return;
+    }
+
+    out.line( SECURITY_LINE, sizeof( SECURITY_LINE ) - 1 );
+    for (uint32_t id = 0; id < (uint32_t)m_symbols.size(); id++)
+    {
+        out.field( FIELD_ID_SEC_NAME, m_symbols.name( id ), m_symbols.nameLen( id ) );
+        out.field( FIELD_ID_SEC_TYPE, SECURITY_TYPE_FUND, sizeof( SECURITY_TYPE_FUND ) - 1 );
+        out.line ( END_TRANSACTION, sizeof( END_TRANSACTION ) - 1 );
+        m_writer.flushIfFull();
+    }
+
+    if (m_prices.empty())
+    {
+        return;
+    }
+
+    // By fund id, then date.
+    std::vector<std::pair<uint64_t, Price> > prices( m_prices.begin(), m_prices.end() );
+    std::sort( prices.begin()
+             , prices.end()
+             , []( const std::pair<uint64_t, Price> & a, const std::pair<uint64_t, Price> & b ) { return a.first < b.first; }
+             );
+
+    out.line( PRICES_LINE, sizeof( PRICES_LINE ) - 1 );
+    for (const std::pair<uint64_t, Price> & entry : prices)
+    {
+        uint32_t id     = (uint32_t)( entry.first >> 32 );
+        uint32_t date   = (uint32_t)entry.first;
+        int      digits = entry.second.digits < PRICE_SCALE ? entry.second.digits : PRICE_SCALE;
+        char     price[DECIMAL_STR_LEN];
+        char     when [sizeof( "MM/DD/YYYY" )];
+
+        snprintf( when, sizeof( when ), "%02u/%02u/%04u", date / 100 % 100, date % 100, date / 10000 % 10000 );
+
+        // A " in the name would end the quotes early.
+        m_line.assign( 1, '"' );
+        m_line.append( m_symbols.name( id ), m_symbols.nameLen( id ) );
+        std::replace( m_line.begin() + 1, m_line.end(), '"', '\'' );
+        m_line += "\",";
+        m_line.append( price, formatDecimal( entry.second.value, PRICE_SCALE, digits, price ) );
+        m_line += ",\"";
+        m_line += when;
+        m_line += '"';
+
+        out.line( m_line.data(), m_line.size() );
+        out.line( END_TRANSACTION, sizeof( END_TRANSACTION ) - 1 );
+        m_writer.flushIfFull();
+    }
+
+} // SecuritySink::end()
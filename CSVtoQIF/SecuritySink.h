@@ -0,0 +1,105 @@
+/*===========================================================================*
+ SecuritySink.h :
+ A TransactionSink that writes the security list and price history
+ Quicken needs to value the holdings the transactions build up: a
+ !Type:Security entry for every fund, then a !Type:Prices entry for each
+ fund and day, from the FUND NAV/PRICE column.
+
+ Fund names are interned as they go by, into a SymbolTable - each name
+ once, end to end in one string - and a day's price is kept against the
+ fund's id and the date, so memory grows with funds x days however many
+ rows there are.  The first price for a fund and day is the one that's
+ kept; conflicts() counts the rows that said something else.  Rows
+ without a price, or whose date doesn't parse (see parseDate()), add
+ their fund to the list but no price.
+
+ Everything's written by end(), funds in the order they turned up and
+ each fund's prices in date order.  The writer can be the QIF file's own,
+ so the lists follow the transactions, or a file of their own.  The
+ exports have no ticker symbols, so prices name the fund the way the
+ transactions do.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "QifWriter.h"
+#include "Transaction.h"
+
+#define SECURITIES_EXTENSION   ".prices.qif"
+
+// Where --securities puts the lists.
+enum SecurityList
+{
+    SECURITIES_OFF,
+    SECURITIES_QIF,         // at the end of the QIF file
+    SECURITIES_FILE         // in <name>SECURITIES_EXTENSION
+};
+
+/*---------------------------------------------------------------------------*
+ SymbolTable :
+ Each distinct name once, numbered from 0 in the order they turned up.
+ Open addressed, so a lookup is a hash, a probe or two and a compare.
+ *---------------------------------------------------------------------------*/
+class SymbolTable
+{
+public:
+    SymbolTable();
+
+    // name's id, adding it if it's new.
+    uint32_t     intern ( const char * name
+                        , size_t       len
+                        );
+
+    size_t       size   () const { return m_starts.size() - 1; }
+    const char * name   ( uint32_t id ) const { return m_text.data() + m_starts[id]; }
+    size_t       nameLen( uint32_t id ) const { return m_starts[id + 1] - m_starts[id]; }
+
+private:
+    void         rehash ( size_t slotCount );
+
+    std::string           m_text;       // every name, end to end
+    std::vector<size_t>   m_starts;     // name i is m_text[m_starts[i], m_starts[i + 1])
+    std::vector<uint64_t> m_hashes;     // name i's
+    std::vector<uint32_t> m_slots;      // id + 1, 0 for empty; a power of 2 long
+
+}; // class SymbolTable
+
+class SecuritySink : public TransactionSink
+{
+public:
+    explicit SecuritySink( QifWriter & writer );
+
+    void transaction( const Transaction & transaction ) override;
+    void end        () override;
+
+    size_t securities() const { return m_symbols.size(); }
+    size_t prices    () const { return m_prices.size(); }
+
+    // Rows whose price for their fund and day wasn't the one kept.
+    size_t conflicts () const { return m_conflicts; }
+
+private:
+    SecuritySink           ( const SecuritySink & );   // not copyable
+    SecuritySink & operator=( const SecuritySink & );
+
+    struct Price
+    {
+        int64_t value;                  // PRICE_SCALE
+        int     digits;                 // as quoted
+    };
+
+    QifWriter                           & m_writer;
+    SymbolTable                           m_symbols;
+    std::unordered_map<uint64_t, Price>   m_prices;     // fund id << 32 | YYYYMMDD
+    size_t                                m_conflicts;
+    std::string                           m_fund;       // this row's, with the prefix
+    std::string                           m_line;
+
+}; // class SecuritySink
@@ -0,0 +1,774 @@
+/*===========================================================================*
+ SortSink.cpp :
+ Holding transactions as records, sorting them, spilling sorted runs to
+ temporary files and merging them back.
+
+ A run file is a series of records, each a uint32_t byte count and then:
+
+     uint32_t   day
+     uint64_t   row                 where it was in the export
+     SortRecord                     text IDs index the strings below
+     SortLine   [lineCount]
+     uint32_t   stringCount
+     uint32_t   length[stringCount] len << 1 | escaped
+     char       text  []
+
+ - every string a record needs, once, so it reads back on its own.  Run
+ files are tmpfile()s: they go away when they're closed, or if we crash.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "SortSink.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "FixedPoint.h"
+#include "PerfectHash.h"
+#include "QifFormat.h"
+
+// TRANSACTION_TEXTS[TEXT_AMOUNT_LINE + i] is NUMBERS[i]'s line.
+static Decimal Transaction::* const NUMBERS[3] = { &Transaction::amount,     &Transaction::price,     &Transaction::units     };
+static bool    Transaction::* const HAS    [3] = { &Transaction::hasAmount,  &Transaction::hasPrice,  &Transaction::hasUnits  };
+static char  ( Transaction::* const STORAGE[3] )[DECIMAL_STR_LEN]
+                                               = { &Transaction::amountText, &Transaction::priceText, &Transaction::unitsText };
+static const int                    SCALE  [3] = { AMOUNT_SCALE,             PRICE_SCALE,             QUANTITY_SCALE          };
+
+const size_t FIRST_SLOTS     = 1024;
+
+const size_t RUN_BUFFER_SIZE = 64 * 1024;
+
+/*---------------------------------------------------------------------------*
+ compareText() :
+ Byte order, shorter first on a tie - the same for the in-memory sort and
+ the merge, which only sees the text.
+ *---------------------------------------------------------------------------*/
+static int compareText( const FieldView & a
+                      , const FieldView & b
+                      )
+{
+    int order = memcmp( a.ptr, b.ptr, a.len < b.len ? a.len : b.len );
+
+    if (order != 0)    return order;
+    if (a.len < b.len) return -1;
+    return a.len > b.len ? 1 : 0;
+}
+
+static inline bool sameView( const FieldView & a
+                           , const FieldView & b
+                           )
+{
+    return a.ptr     == b.ptr
+        && a.len     == b.len
+        && a.escaped == b.escaped;
+}
+
+/*---------------------------------------------------------------------------*
+ toRecord() :
+ The record and lines for t, with each piece of text the ID id() gives it
+ - or, for a number line formatDecimal() would write just the same,
+ SORT_NUMBER_TEXT.  Text that's where a field already pointed (the lines,
+ the transfer amount) gets the field's ID without asking id() again.
+ *---------------------------------------------------------------------------*/
+template <typename IdFn>
+static void toRecord( const Transaction & t
+                    , uint32_t            day
+                    , SortRecord        & record
+                    , SortLine          * lines
+                    , IdFn                id
+                    )
+{
+    static const size_t ORDER[TEXT_COUNT] =
+    {
+        TEXT_AMOUNT_LINE, TEXT_PRICE_LINE, TEXT_UNITS_LINE,
+        TEXT_DATE, TEXT_SECURITY, TEXT_MEMO, TEXT_ACTION, TEXT_COMMISSION, TEXT_CLEARED, TEXT_TXFR_ACCT, TEXT_TXFR_AMOUNT
+    };
+
+    memset( &record, 0, sizeof( record ) );
+    for (size_t i = 0; i < 3; i++)
+    {
+        const FieldView & text = t.*TRANSACTION_TEXTS[TEXT_AMOUNT_LINE + i];
+        const Decimal   & d    = t.*NUMBERS[i];
+        char              formatted[DECIMAL_STR_LEN];
+
+        if (  t.*HAS[i]
+           && !text.escaped
+           && formatDecimal( d.value, SCALE[i], d.digits, formatted ) == text.len
+           && memcmp( formatted, text.ptr, text.len ) == 0
+           )
+        {
+            record.text[TEXT_AMOUNT_LINE + i] = SORT_NUMBER_TEXT + (uint32_t)i;
+        }
+        else
+        {
+            record.text[TEXT_AMOUNT_LINE + i] = id( text );
+        }
+    }
+    for (size_t n = 3; n < TEXT_COUNT; n++)
+    {
+        const FieldView & text  = t.*TRANSACTION_TEXTS[ORDER[n]];
+        size_t            known = 0;
+
+        while (known < n && !sameView( t.*TRANSACTION_TEXTS[ORDER[known]], text ))
+        {
+            known++;
+        }
+        record.text[ORDER[n]] = known < n ? record.text[ORDER[known]] : id( text );
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        const Decimal & d = t.*NUMBERS[i];
+
+        record.value [i] = d.value;
+        record.digits[i] = (uint8_t)( d.digits < 0 ? 0 : d.digits > 255 ? 255 : d.digits );
+        if (t.*HAS[i]) record.flags |= SORT_HAS_AMOUNT   << i;
+        if (d.plain)   record.flags |= SORT_PLAIN_AMOUNT << i;
+    }
+    if (t.securityPrefix[0] != '\0')
+    {
+        record.flags |= SORT_PREFIXED;
+    }
+    record.day       = day;
+    record.lineCount = (uint16_t)t.lineCount;
+
+    for (size_t i = 0; i < t.lineCount; i++)
+    {
+        const FieldView & text  = t.lines[i].text;
+        size_t            field = 0;
+
+        while (field < TEXT_COUNT && !sameView( t.*TRANSACTION_TEXTS[field], text ))
+        {
+            field++;
+        }
+        lines[i].text     = field < TEXT_COUNT ? record.text[field] : id( text );
+        lines[i].fieldID  = t.lines[i].fieldID;
+        lines[i].prefixed = t.lines[i].prefixLen > 0 ? 1 : 0;
+        lines[i].unused   = 0;
+    }
+}
+
+/*---------------------------------------------------------------------------*
+ fromRecord() :
+ toRecord() backwards, string() turning IDs back into text.
+ *---------------------------------------------------------------------------*/
+template <typename StringFn>
+static void fromRecord( const SortRecord & record
+                      , const SortLine   * lines
+                      , Transaction      & t
+                      , StringFn           string
+                      )
+{
+    FieldView numberText[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        Decimal & d = t.*NUMBERS[i];
+
+        d.value   = record.value[i];
+        d.digits  = record.digits[i];
+        d.plain   = ( record.flags & ( SORT_PLAIN_AMOUNT << i ) ) != 0;
+        t.*HAS[i] = ( record.flags & ( SORT_HAS_AMOUNT   << i ) ) != 0;
+
+        if (record.text[TEXT_AMOUNT_LINE + i] == SORT_NUMBER_TEXT + (uint32_t)i)
+        {
+            numberText[i].ptr     = t.*STORAGE[i];
+            numberText[i].len     = formatDecimal( d.value, SCALE[i], d.digits, t.*STORAGE[i] );
+            numberText[i].escaped = false;
+        }
+    }
+
+    auto text = [&]( uint32_t id )
+    {
+        return id >= SORT_NUMBER_TEXT ? numberText[id - SORT_NUMBER_TEXT] : string( id );
+    };
+
+    for (size_t i = 0; i < TEXT_COUNT; i++)
+    {
+        t.*TRANSACTION_TEXTS[i] = text( record.text[i] );
+    }
+    t.securityPrefix = ( record.flags & SORT_PREFIXED ) ? SF_PREPEND : "";
+
+    if (t.lines.size() < record.lineCount)
+    {
+        t.lines.resize( record.lineCount );
+    }
+    for (size_t i = 0; i < record.lineCount; i++)
+    {
+        TransactionLine & line = t.lines[i];
+
+        line.fieldID   = lines[i].fieldID;
+        line.prefix    = lines[i].prefixed ? SF_PREPEND : "";
+        line.prefixLen = lines[i].prefixed ? sizeof( SF_PREPEND ) - 1 : 0;
+        line.text      = text( lines[i].text );
+    }
+    t.lineCount = record.lineCount;
+}
+
+// What writeRecord() builds each record in, kept from one to the next.
+struct RunScratch
+{
+    std::vector<FieldView> strings;
+    std::vector<SortLine>  lines;
+    std::string            bytes;
+};
+
+/*---------------------------------------------------------------------------*
+ writeRecord() :
+ Append t to a run file.  False if the write failed.
+ *---------------------------------------------------------------------------*/
+static bool writeRecord( FILE              * file
+                       , const Transaction & t
+                       , uint32_t            day
+                       , uint64_t            row
+                       , RunScratch        & scratch
+                       )
+{
+    // The record's own strings; the same text (usually the same pointer,
+    // since lines point where the fields do) is only stored once.
+    std::vector<FieldView> & strings   = scratch.strings;
+    std::vector<SortLine>  & lines     = scratch.lines;
+    uint32_t                 textBytes = 0;
+    SortRecord               record;
+
+    strings.clear();
+    lines.resize( t.lineCount );
+
+    toRecord( t, day, record, lines.data(), [&]( const FieldView & text )
+    {
+        for (size_t i = 0; i < strings.size(); i++)
+        {
+            if (  strings[i].escaped == text.escaped
+               && compareText( strings[i], text ) == 0
+               )
+            {
+                return (uint32_t)i;
+            }
+        }
+        strings.push_back( text );
+        textBytes += (uint32_t)text.len;
+        return (uint32_t)( strings.size() - 1 );
+    } );
+
+    uint32_t count = (uint32_t)strings.size();
+
+    uint32_t size = (uint32_t)( sizeof( day ) + sizeof( row ) + sizeof( record )
+                              + lines.size() * sizeof( SortLine )
+                              + sizeof( count ) + count * sizeof( uint32_t )
+                              + textBytes );
+
+    std::string & bytes = scratch.bytes;
+
+    bytes.clear();
+    bytes.append( (const char *)&size,   sizeof( size ) );
+    bytes.append( (const char *)&day,    sizeof( day ) );
+    bytes.append( (const char *)&row,    sizeof( row ) );
+    bytes.append( (const char *)&record, sizeof( record ) );
+    bytes.append( (const char *)lines.data(), lines.size() * sizeof( SortLine ) );
+    bytes.append( (const char *)&count,  sizeof( count ) );
+    for (const FieldView & text : strings)
+    {
+        uint32_t length = (uint32_t)text.len << 1 | ( text.escaped ? 1 : 0 );
+        bytes.append( (const char *)&length, sizeof( length ) );
+    }
+    for (const FieldView & text : strings)
+    {
+        bytes.append( text.ptr, text.len );
+    }
+    return fwrite( bytes.data(), 1, bytes.size(), file ) == bytes.size();
+
+} // writeRecord()
+
+static FILE * openRun()
+{
+    FILE * file = tmpfile();
+
+    if (file != nullptr)
+    {
+        setvbuf( file, nullptr, _IOFBF, RUN_BUFFER_SIZE );
+    }
+    return file;
+}
+
+/*---------------------------------------------------------------------------*
+ SortRun :
+ One run file being read back, a record at a time.  transaction points
+ into buffer until the next next().
+ *---------------------------------------------------------------------------*/
+class SortRun
+{
+public:
+    SortRun( FILE * file )
+        : m_file( file )
+        , day   ( 0 )
+        , row   ( 0 )
+        , bad   ( false )
+    {
+        rewind( m_file );
+    }
+    ~SortRun() { fclose( m_file ); }
+
+    // The next record; false at the end, or (bad) if it won't read.
+    bool next()
+    {
+        uint32_t size;
+
+        if (fread( &size, sizeof( size ), 1, m_file ) != 1)
+        {
+            bad = ferror( m_file ) != 0;
+            return false;
+        }
+        m_buffer.resize( size );
+        if (  size < sizeof( day ) + sizeof( row ) + sizeof( SortRecord ) + sizeof( uint32_t )
+           || fread( m_buffer.data(), 1, size, m_file ) != size
+           )
+        {
+            bad = true;
+            return false;
+        }
+
+        const char * p = m_buffer.data();
+        SortRecord   record;
+        uint32_t     count;
+
+        memcpy( &day,    p, sizeof( day ) );        p += sizeof( day );
+        memcpy( &row,    p, sizeof( row ) );        p += sizeof( row );
+        memcpy( &record, p, sizeof( record ) );     p += sizeof( record );
+
+        m_lines.resize( record.lineCount );
+        memcpy( m_lines.data(), p, record.lineCount * sizeof( SortLine ) );
+        p += record.lineCount * sizeof( SortLine );
+        memcpy( &count, p, sizeof( count ) );       p += sizeof( count );
+
+        const char * text = p + count * sizeof( uint32_t );
+        m_strings.resize( count );
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t length;
+            memcpy( &length, p, sizeof( length ) ); p += sizeof( length );
+
+            m_strings[i].ptr     = text;
+            m_strings[i].len     = length >> 1;
+            m_strings[i].escaped = ( length & 1 ) != 0;
+            text += m_strings[i].len;
+        }
+
+        fromRecord( record, m_lines.data(), transaction, [&]( uint32_t id ) -> FieldView
+        {
+            static const FieldView EMPTY = { "", 0, false };
+            return id < m_strings.size() ? m_strings[id] : EMPTY;
+        } );
+        return true;
+    }
+
+private:
+    SortRun           ( const SortRun & );      // not copyable
+    SortRun & operator=( const SortRun & );
+
+    FILE                   * m_file;
+    std::vector<char>        m_buffer;
+    std::vector<SortLine>    m_lines;
+    std::vector<FieldView>   m_strings;
+
+public:
+    Transaction              transaction;
+    uint32_t                 day;
+    uint64_t                 row;
+    bool                     bad;
+
+}; // class SortRun
+
+/*---------------------------------------------------------------------------*
+ SortSink
+ *---------------------------------------------------------------------------*/
+SortSink::SortSink( TransactionSink & next
+                  , size_t            memory
+                  , ConvertStats    * stats
+                  )
+    : m_next    ( next )
+    , m_memory  ( memory != 0 ? memory : SORT_DEFAULT_MEMORY )
+    , m_stats   ( stats != nullptr ? stats : &m_noStats )
+    , m_held    ( 0 )
+    , m_firstRow( 0 )
+    , m_spilled ( 0 )
+    , m_rows    ( 0 )
+    , m_maxLines( 0 )
+{
+    Entry empty = { 0, 0, 0, false };
+    m_entries.push_back( empty );
+}
+
+SortSink::~SortSink()
+{
+}
+
+uint32_t SortSink::intern( const FieldView & text )
+{
+    if (text.len == 0)
+    {
+        return 0;
+    }
+    if (m_entries.size() * 2 >= m_slots.size())
+    {
+        rehash( m_slots.empty() ? FIRST_SLOTS : m_slots.size() * 2 );
+    }
+
+    // Case folded, which only costs a few more compares.
+    uint32_t hash = (uint32_t)mix( foldedHash( text.ptr, text.len ) + ( text.escaped ? 1 : 0 ) );
+    size_t   mask = m_slots.size() - 1;
+
+    for (size_t slot = hash & mask; ; slot = ( slot + 1 ) & mask)
+    {
+        uint32_t id = m_slots[slot];
+
+        if (id == 0)
+        {
+            Entry entry = { m_text.size(), (uint32_t)text.len, hash, text.escaped };
+
+            id = (uint32_t)m_entries.size();
+            m_text.append( text.ptr, text.len );
+            m_entries.push_back( entry );
+            m_slots[slot] = id;
+            m_held += text.len + sizeof( Entry );
+            return id;
+        }
+
+        const Entry & entry = m_entries[id];
+        if (  entry.hash    == hash
+           && entry.len     == text.len
+           && entry.escaped == text.escaped
+           && memcmp( m_text.data() + entry.offset, text.ptr, text.len ) == 0
+           )
+        {
+            return id;
+        }
+    }
+
+} // SortSink::intern()
+
+void SortSink::rehash( size_t slots )
+{
+    size_t mask = slots - 1;
+
+    m_held += ( slots - m_slots.size() ) * sizeof( uint32_t );
+    m_slots.assign( slots, 0 );
+    for (uint32_t id = 1; id < m_entries.size(); id++)
+    {
+        size_t slot = m_entries[id].hash & mask;
+        while (m_slots[slot] != 0)
+        {
+            slot = ( slot + 1 ) & mask;
+        }
+        m_slots[slot] = id;
+    }
+}
+
+FieldView SortSink::string( uint32_t id ) const
+{
+    const Entry & entry = m_entries[id];
+    FieldView     text  = { m_text.data() + entry.offset, entry.len, entry.escaped };
+
+    return text;
+}
+
+void SortSink::begin( const HeaderMap & header )
+{
+    m_next.begin( header );
+}
+
+void SortSink::transaction( const Transaction & t )
+{
+    if (!m_error.empty())
+    {
+        return;
+    }
+
+    STATS_MARK( *m_stats, mark );
+
+    uint32_t day;
+    if (!parseDate( t.date.ptr, t.date.len, day ))
+    {
+        day = SORT_UNDATED;
+    }
+
+    SortRecord record;
+    size_t     firstLine = m_lines.size();
+
+    m_lines.resize( firstLine + t.lineCount );
+    toRecord( t, day, record, m_lines.data() + firstLine, [this]( const FieldView & text )
+    {
+        return intern( text );
+    } );
+    record.firstLine = (uint32_t)firstLine;
+    m_records.push_back( record );
+    m_rows++;
+
+    if (t.lineCount > m_maxLines)
+    {
+        m_maxLines = t.lineCount;
+    }
+    m_held += sizeof( SortRecord ) + sizeof( Key ) + t.lineCount * sizeof( SortLine );
+
+    if (  m_held >= m_memory
+       || m_lines.size() >= 0xFFFF0000u
+       )
+    {
+        spill();
+    }
+    STATS_LAP( *m_stats, STAT_SORT, mark );
+
+} // SortSink::transaction()
+
+/*---------------------------------------------------------------------------*
+ sortHeld() :
+ m_keys, in order, for the records held.  Securities are ranked by name
+ first, so sorting the keys never looks at a string.
+ *---------------------------------------------------------------------------*/
+void SortSink::sortHeld()
+{
+    std::vector<uint32_t> securities;
+    std::vector<uint32_t> rank( m_entries.size(), 0 );
+    std::vector<bool>     seen( m_entries.size(), false );
+
+    for (const SortRecord & record : m_records)
+    {
+        uint32_t id = record.text[TEXT_SECURITY];
+        if (!seen[id])
+        {
+            seen[id] = true;
+            securities.push_back( id );
+        }
+    }
+    std::sort( securities.begin(), securities.end(), [this]( uint32_t a, uint32_t b )
+    {
+        return compareText( string( a ), string( b ) ) < 0;
+    } );
+    for (size_t i = 1; i < securities.size(); i++)
+    {
+        // The same name, escaped and not, ranks the same.
+        bool same = compareText( string( securities[i - 1] ), string( securities[i] ) ) == 0;
+        rank[securities[i]] = rank[securities[i - 1]] + ( same ? 0 : 1 );
+    }
+
+    m_keys.resize( m_records.size() );
+    for (size_t i = 0; i < m_records.size(); i++)
+    {
+        m_keys[i].day      = m_records[i].day;
+        m_keys[i].security = rank[m_records[i].text[TEXT_SECURITY]];
+        m_keys[i].record   = (uint32_t)i;
+    }
+    std::sort( m_keys.begin(), m_keys.end(), []( const Key & a, const Key & b )
+    {
+        if (a.day      != b.day)      return a.day      < b.day;
+        if (a.security != b.security) return a.security < b.security;
+        return a.record < b.record;
+    } );
+}
+
+void SortSink::load( const SortRecord & record
+                   , Transaction      & t
+                   ) const
+{
+    fromRecord( record, m_lines.data() + record.firstLine, t, [this]( uint32_t id )
+    {
+        return string( id );
+    } );
+}
+
+/*---------------------------------------------------------------------------*
+ spill() :
+ Sort what's held into a new run file and let it all go.
+ *---------------------------------------------------------------------------*/
+bool SortSink::spill()
+{
+    FILE * file = openRun();
+
+    if (file == nullptr)
+    {
+        m_error = "ERROR: Can't create a temporary file to sort in.\n";
+        return false;
+    }
+
+    sortHeld();
+
+    Transaction t;
+    RunScratch  scratch;
+    bool        written = true;
+
+    t.lines.resize( m_maxLines );
+    for (size_t i = 0; written && i < m_keys.size(); i++)
+    {
+        const SortRecord & record = m_records[m_keys[i].record];
+
+        load( record, t );
+        written = writeRecord( file, t, record.day, m_firstRow + m_keys[i].record, scratch );
+    }
+    written = written && fflush( file ) == 0;
+
+    m_runs.push_back( std::unique_ptr<SortRun>( new SortRun( file ) ) );
+    m_spilled++;
+    STATS_COUNT( *m_stats, STAT_SORT_RUNS );
+
+    m_firstRow += m_records.size();
+    m_records.clear();
+    m_lines  .clear();
+    m_keys   .clear();
+    m_entries.resize( 1 );
+    m_text   .clear();
+    m_slots  .assign( m_slots.size(), 0 );
+    m_held = m_slots.size() * sizeof( uint32_t );
+
+    if (!written)
+    {
+        m_error = "ERROR: Can't write a temporary file to sort in...\n...disk full?\n";
+    }
+    return written;
+
+} // SortSink::spill()
+
+/*---------------------------------------------------------------------------*
+ merge() :
+ Merge m_runs[first, first + count) into sink, or if there's no sink, into
+ a new run at the end of m_runs.
+ *---------------------------------------------------------------------------*/
+bool SortSink::merge( size_t            first
+                    , size_t            count
+                    , TransactionSink * sink
+                    )
+{
+    std::vector<std::unique_ptr<SortRun> > inputs;
+    std::vector<SortRun *>                 heap;
+
+    for (size_t i = first; i < first + count; i++)
+    {
+        inputs.push_back( std::move( m_runs[i] ) );
+    }
+    m_runs.erase( m_runs.begin() + first, m_runs.begin() + first + count );
+
+    FILE * file = nullptr;
+    if (sink == nullptr)
+    {
+        file = openRun();
+        if (file == nullptr)
+        {
+            m_error = "ERROR: Can't create a temporary file to sort in.\n";
+            return false;
+        }
+    }
+
+    // A heap on the run that's next - so the one that's latest goes down.
+    auto later = []( const SortRun * a, const SortRun * b )
+    {
+        if (a->day != b->day)
+        {
+            return a->day > b->day;
+        }
+        int order = compareText( a->transaction.security, b->transaction.security );
+        if (order != 0)
+        {
+            return order > 0;
+        }
+        return a->row > b->row;
+    };
+
+    for (std::unique_ptr<SortRun> & run : inputs)
+    {
+        if (run->next())
+        {
+            heap.push_back( run.get() );
+        }
+    }
+    std::make_heap( heap.begin(), heap.end(), later );
+
+    RunScratch scratch;
+    bool       written = true;
+
+    STATS_MARK( *m_stats, mark );
+    while (!heap.empty())
+    {
+        std::pop_heap( heap.begin(), heap.end(), later );
+        SortRun * run = heap.back();
+
+        if (sink != nullptr)
+        {
+            // Whatever the next sink does, it times itself.
+            STATS_LAP( *m_stats, STAT_SORT, mark );
+            sink->transaction( run->transaction );
+            STATS_RESTART( *m_stats, mark );
+        }
+        else if (written)
+        {
+            written = writeRecord( file, run->transaction, run->day, run->row, scratch );
+        }
+
+        if (run->next())
+        {
+            std::push_heap( heap.begin(), heap.end(), later );
+        }
+        else
+        {
+            heap.pop_back();
+        }
+    }
+    STATS_LAP( *m_stats, STAT_SORT, mark );
+
+    for (const std::unique_ptr<SortRun> & run : inputs)
+    {
+        if (run->bad)
+        {
+            m_error = "ERROR: Can't read back a temporary file sorted in.\n";
+        }
+    }
+    if (file != nullptr)
+    {
+        if (!written || fflush( file ) != 0)
+        {
+            m_error = "ERROR: Can't write a temporary file to sort in...\n...disk full?\n";
+        }
+        m_runs.push_back( std::unique_ptr<SortRun>( new SortRun( file ) ) );
+    }
+    return m_error.empty();
+
+} // SortSink::merge()
+
+void SortSink::end()
+{
+    if (m_spilled == 0)
+    {
+        // It all fit.
+        STATS_MARK( *m_stats, mark );
+        sortHeld();
+        STATS_LAP( *m_stats, STAT_SORT, mark );
+
+        Transaction t;
+        t.lines.resize( m_maxLines );
+        for (const Key & key : m_keys)
+        {
+            load( m_records[key.record], t );
+            STATS_LAP( *m_stats, STAT_SORT, mark );
+            m_next.transaction( t );
+            STATS_RESTART( *m_stats, mark );
+        }
+    }
+    else if (m_error.empty())
+    {
+        if (!m_records.empty())
+        {
+            spill();
+        }
+        while (  m_error.empty()
+              && m_runs.size() > SORT_MERGE_WAYS
+              )
+        {
+            merge( 0, SORT_MERGE_WAYS, nullptr );
+        }
+        if (m_error.empty())
+        {
+            merge( 0, m_runs.size(), &m_next );
+        }
+    }
+    m_runs.clear();
+    m_next.end();
+
+} // SortSink::end()
@@ -0,0 +1,152 @@
+/*===========================================================================*
+ SortSink.h :
+ A TransactionSink that puts transactions in order - by posting date, then
+ security, then where they were in the export - before handing them on.
+ Custodians write newest first, or every fund's rows in turn; Quicken
+ imports faster, and works out cost basis more reliably, when the rows
+ come oldest first with each day's funds together.
+
+ Rows are held as fixed size SortRecords in an arena, every piece of
+ text in them an ID into one table of interned strings - so the dates,
+ funds and activity types every row repeats are stored once - and the
+ numbers as fixed point, their text only kept if formatDecimal() wouldn't
+ write it the same.  The sort itself only moves 12 byte keys.
+
+ When what's held passes the memory budget it's sorted and spilled to a
+ temporary run file.  At the end the runs are merged, SORT_MERGE_WAYS at
+ a time, and the result goes on to the next sink.  An export that fits
+ the budget never touches the disk.
+
+ A row whose date doesn't parse (see parseDate()) sorts after all the
+ dated ones, in the order it came.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Stats.h"
+#include "Transaction.h"
+
+const size_t SORT_DEFAULT_MEMORY = 256 << 20;
+
+// Most runs read at once by a merge pass.
+const size_t SORT_MERGE_WAYS     = 64;
+
+// Sorts after every real date.
+const uint32_t SORT_UNDATED      = 0xFFFFFFFF;
+
+// A string ID meaning the amount (+ 1 the price, + 2 the units) just as
+// formatDecimal() writes it, so the text isn't kept.
+const uint32_t SORT_NUMBER_TEXT  = 0xFFFFFFF0;
+
+enum SortFlag
+{
+    SORT_HAS_AMOUNT   = 0x01,           // << 0, 1, 2 for price and units
+    SORT_PLAIN_AMOUNT = 0x08,           // << 0, 1, 2 likewise
+    SORT_PREFIXED     = 0x40            // the security gets SF_PREPEND
+};
+
+struct SortRecord
+{
+    int64_t  value[3];                  // amount, price, units
+    uint32_t text[TEXT_COUNT];          // string IDs, by TransactionText
+    uint32_t day;                       // YYYYMMDD, SORT_UNDATED if not
+    uint32_t firstLine;                 // into the line arena
+    uint16_t lineCount;
+    uint8_t  digits[3];
+    uint8_t  flags;                     // SORT_HAS_AMOUNT...
+};
+
+struct SortLine
+{
+    uint32_t text;                      // string ID
+    char     fieldID;
+    uint8_t  prefixed;                  // gets the security prefix
+    uint16_t unused;
+};
+
+class SortRun;
+
+class SortSink : public TransactionSink
+{
+public:
+    // next gets everything, in order, from end(); memory is about the
+    // most the rows waiting to be sorted may take before they're spilled
+    // (0 for SORT_DEFAULT_MEMORY).
+    SortSink( TransactionSink & next
+            , size_t            memory = SORT_DEFAULT_MEMORY
+            , ConvertStats    * stats  = nullptr
+            );
+    ~SortSink();
+
+    void begin      ( const HeaderMap & header ) override;
+    void transaction( const Transaction & transaction ) override;
+    void end        () override;
+
+    // Run files spilled, 0 if it all fit in memory.
+    size_t              runs () const { return m_spilled; }
+
+    // Empty unless a run file couldn't be written or read back, in which
+    // case next didn't get every row.
+    const std::string & error() const { return m_error; }
+
+private:
+    SortSink           ( const SortSink & );     // not copyable
+    SortSink & operator=( const SortSink & );
+
+    uint32_t intern   ( const FieldView & text );
+    void     rehash   ( size_t slots );
+    FieldView string  ( uint32_t id ) const;
+    void     sortHeld ();
+    void     load     ( const SortRecord & record
+                      , Transaction      & transaction
+                      ) const;
+    bool     spill    ();
+    bool     merge    ( size_t            first
+                      , size_t            count
+                      , TransactionSink * sink
+                      );
+
+    struct Key
+    {
+        uint32_t day;
+        uint32_t security;              // rank of the name among those held
+        uint32_t record;                // also the order they came in
+    };
+
+    struct Entry                        // an interned string
+    {
+        size_t   offset;                // into m_text
+        uint32_t len;
+        uint32_t hash;
+        bool     escaped;
+    };
+
+    TransactionSink                         & m_next;
+    size_t                                    m_memory;
+    ConvertStats                              m_noStats;       // if there's no m_stats
+    ConvertStats                            * m_stats;
+    std::string                               m_error;
+
+    // What's held since the last spill.
+    std::vector<SortRecord>                   m_records;
+    std::vector<SortLine>                     m_lines;
+    std::vector<Key>                          m_keys;
+    std::vector<Entry>                        m_entries;       // 0 is ""
+    std::string                               m_text;
+    std::vector<uint32_t>                     m_slots;         // entry IDs by hash, 0 if free
+    size_t                                    m_held;          // bytes, roughly
+    uint64_t                                  m_firstRow;      // of m_records[0]
+
+    std::vector<std::unique_ptr<SortRun> >    m_runs;          // not yet merged
+    size_t                                    m_spilled;
+    uint64_t                                  m_rows;
+    size_t                                    m_maxLines;
+
+}; // class SortSink
@@ -0,0 +1,176 @@
+/*===========================================================================*
+ Stats.cpp :
+ The clock behind the phase timers, and the --stats report.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "Stats.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "QifFormat.h"
+
+// Labels for the text report, then keys for the JSON one.
+static const char * COUNTER_LABEL[STAT_COUNTER_COUNT] =
+{
+    "rows read",
+    "rows emitted",
+    "BuyX",
+    "Buy",
+    "SellX",
+    "transfers",
+    "long fields",
+    "ignored columns",
+    "sort runs",
+    "aggregated in",
+    "aggregated out"
+};
+
+static const char * COUNTER_KEY[STAT_COUNTER_COUNT] =
+{
+    "rows_read",
+    "rows_emitted",
+    "action_buyx",
+    "action_buy",
+    "action_sellx",
+    "transfers",
+    "long_fields",
+    "ignored_columns",
+    "sort_runs",
+    "aggregate_in",
+    "aggregate_out"
+};
+
+static const char * PHASE_NAME[STAT_PHASE_COUNT] =
+{
+    "open",
+    "header",
+    "parse",
+    "derive",
+    "emit",
+    "flush",
+    "sort",
+    "aggregate"
+};
+
+uint64_t statsNow()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void append( std::string & out
+                  , const char  * format
+                  , ...
+                  )
+{
+    char    text[256];
+    va_list args;
+
+    va_start( args, format );
+    int len = vsnprintf( text, sizeof( text ), format, args );
+    va_end( args );
+
+    if (len > 0)
+    {
+        out.append( text, (size_t)len < sizeof( text ) ? (size_t)len : sizeof( text ) - 1 );
+    }
+}
+
+static void appendJsonString( std::string       & out
+                            , const std::string & text
+                            )
+{
+    out += '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            append( out, "\\u%04x", (unsigned)c );
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string formatStats( const ConvertStats & stats
+                       , StatsFormat          format
+                       , const std::string  & what
+                       , size_t               bytes
+                       , double               seconds
+                       )
+{
+    double      safe    = seconds > 0.0 ? seconds : 1e-9;
+    double      rowRate = stats.counts[STAT_ROWS_READ] / safe;
+    double      mbRate  = bytes / 1048576.0 / safe;
+    std::string out;
+
+    if (format == STATS_JSON)
+    {
+        out += "{\"stats\":";
+        appendJsonString( out, what );
+        append( out, ",\"compiled_in\":%s", STATS_COMPILED_IN ? "true" : "false" );
+        append( out, ",\"seconds\":%.6f,\"bytes\":%zu,\"rows_per_sec\":%.0f,\"mb_per_sec\":%.3f"
+              , seconds
+              , bytes
+              , rowRate
+              , mbRate
+              );
+        for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+        {
+            append( out, ",\"%s\":%llu", COUNTER_KEY[i], (unsigned long long)stats.counts[i] );
+        }
+        if (stats.counts[STAT_AGGREGATE_OUT] > 0)
+        {
+            append( out, ",\"aggregate_ratio\":%.3f", (double)stats.counts[STAT_AGGREGATE_IN] / stats.counts[STAT_AGGREGATE_OUT] );
+        }
+        out += ",\"phase_seconds\":{";
+        for (int i = 0; i < STAT_PHASE_COUNT; i++)
+        {
+            append( out, "%s\"%s\":%.6f", i > 0 ? "," : "", PHASE_NAME[i], stats.nanos[i] / 1e9 );
+        }
+        out += "}}\n";
+        return out;
+    } // if JSON
+
+    append( out, "Stats for %s:\n", what.c_str() );
+    if (!STATS_COMPILED_IN)
+    {
+        append( out, "  %.3f sec, %.1f MB/sec\n", seconds, mbRate );
+        out += "  (built without CSVTOQIF_STATS - no counters or timers)\n";
+        return out;
+    }
+    append( out, "  %.3f sec, %.0f rows/sec, %.1f MB/sec\n", seconds, rowRate, mbRate );
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+    {
+        append( out, "  %-16s %12llu", COUNTER_LABEL[i], (unsigned long long)stats.counts[i] );
+        if (i == STAT_LONG_FIELDS)
+        {
+            append( out, "  (over %d chars)", MEMO_STR_LEN - 1 );
+        }
+        if (  i == STAT_AGGREGATE_OUT
+           && stats.counts[i] > 0
+           )
+        {
+            append( out, "  (%.2f:1)", (double)stats.counts[STAT_AGGREGATE_IN] / stats.counts[i] );
+        }
+        out += '\n';
+    }
+    for (int i = 0; i < STAT_PHASE_COUNT; i++)
+    {
+        append( out, "  %-16s %12.3f sec\n", PHASE_NAME[i], stats.nanos[i] / 1e9 );
+    }
+    return out;
+
+} // formatStats()
@@ -0,0 +1,138 @@
+/*===========================================================================*
+ Stats.h :
+ The counters and phase timers behind --stats.
+
+ Everything on the per-row path goes through the STATS_ macros below, and
+ they're only there if CSVTOQIF_STATS is defined (the project and the CMake
+ build both define it; cmake -DCSVTOQIF_STATS=OFF doesn't).  Without it
+ they compile to nothing and --stats reports that it has nothing to say.
+
+ With it, counters are plain increments into the ConvertStats the row
+ belongs to (RowChecks carries one per file or chunk), and the timers only
+ read the clock when ConvertStats::timing is set, which it is only for
+ --stats runs.  A parallel conversion adds up the time spent on every
+ thread, so phase times can come to more than the elapsed time.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+enum StatCounter
+{
+    STAT_ROWS_READ,             // data rows, header not included
+    STAT_ROWS_EMITTED,          // ...that made it into the QIF file
+    STAT_ACTION_BUYX,           // derived actions
+    STAT_ACTION_BUY,
+    STAT_ACTION_SELLX,
+    STAT_TRANSFERS,             // rows that got a derived L or $ line
+    STAT_LONG_FIELDS,           // memos and amounts MEMO_STR_LEN would have cut short
+    STAT_IGNORED_COLUMNS,       // header columns mapped to FIELD_ID_IGNORE
+    STAT_SORT_RUNS,             // sorted runs spilled to disk (see SortSink.h)
+    STAT_AGGREGATE_IN,          // rows into --aggregate (see AggregateSink.h)
+    STAT_AGGREGATE_OUT,         // ...and the transactions they came to
+
+    STAT_COUNTER_COUNT
+};
+
+enum StatPhase
+{
+    STAT_OPEN,                  // opening the CSV and QIF files
+    STAT_HEADER,                // mapping the header row
+    STAT_PARSE,                 // splitting rows into fields
+    STAT_DERIVE,                // makeTransaction()
+    STAT_EMIT,                  // rendering QIF
+    STAT_FLUSH,                 // writing it to the file
+    STAT_SORT,                  // holding, sorting and merging rows, with --sort
+    STAT_AGGREGATE,             // grouping and adding up rows, with --aggregate
+
+    STAT_PHASE_COUNT
+};
+
+enum StatsFormat
+{
+    STATS_OFF,
+    STATS_TEXT,
+    STATS_JSON
+};
+
+#ifdef    CSVTOQIF_STATS
+const bool STATS_COMPILED_IN = true;
+#else
+const bool STATS_COMPILED_IN = false;
+#endif // CSVTOQIF_STATS
+
+struct ConvertStats
+{
+    uint64_t counts[STAT_COUNTER_COUNT];
+    uint64_t nanos [STAT_PHASE_COUNT];
+    bool     timing;                    // run the phase timers
+
+    ConvertStats() : timing( false )
+    {
+        for (int i = 0; i < STAT_COUNTER_COUNT; i++) counts[i] = 0;
+        for (int i = 0; i < STAT_PHASE_COUNT;   i++) nanos[i]  = 0;
+    }
+
+    void add( const ConvertStats & other )
+    {
+        for (int i = 0; i < STAT_COUNTER_COUNT; i++) counts[i] += other.counts[i];
+        for (int i = 0; i < STAT_PHASE_COUNT;   i++) nanos[i]  += other.nanos[i];
+    }
+};
+
+// Nanoseconds on the steady clock.
+uint64_t statsNow();
+
+// Charge the time since mark to phase and move mark up to now.
+inline void statsLap( ConvertStats & stats
+                    , StatPhase      phase
+                    , uint64_t     & mark
+                    )
+{
+    if (stats.timing)
+    {
+        uint64_t now = statsNow();
+        stats.nanos[phase] += now - mark;
+        mark = now;
+    }
+}
+
+// Move mark up to now without charging anything - time that something
+// else accounts for.
+inline void statsRestart( ConvertStats & stats
+                        , uint64_t     & mark
+                        )
+{
+    if (stats.timing)
+    {
+        mark = statsNow();
+    }
+}
+
+#ifdef    CSVTOQIF_STATS
+#define STATS_COUNT( stats, counter )       ( (stats).counts[counter]++ )
+#define STATS_ADD( stats, counter, n )      ( (stats).counts[counter] += (n) )
+#define STATS_MARK( stats, mark )           uint64_t mark = (stats).timing ? statsNow() : 0
+#define STATS_LAP( stats, phase, mark )     statsLap( (stats), (phase), (mark) )
+#define STATS_RESTART( stats, mark )        statsRestart( (stats), (mark) )
+#else
+#define STATS_COUNT( stats, counter )       ( (void)0 )
+#define STATS_ADD( stats, counter, n )      ( (void)0 )
+#define STATS_MARK( stats, mark )           ( (void)0 )
+#define STATS_LAP( stats, phase, mark )     ( (void)0 )
+#define STATS_RESTART( stats, mark )        ( (void)0 )
+#endif // CSVTOQIF_STATS
+
+// The --stats report for what, text or JSON.  The JSON is one line, so a
+// scheduler can pick it out of the rest of the output; rows/sec and
+// MB/sec come from seconds and bytes.
+std::string formatStats( const ConvertStats & stats
+                       , StatsFormat          format
+                       , const std::string  & what
+                       , size_t               bytes
+                       , double               seconds
+                       );
@@ -0,0 +1,155 @@
+/*===========================================================================*
+ ThreadPool.cpp :
+ Work-stealing pool implementation.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+// Which worker (if any) the current thread is, so submit() from inside a
+// task can push onto its own deque.
+static thread_local ThreadPool * currentPool   = nullptr;
+static thread_local unsigned     currentWorker = 0;
+
+unsigned ThreadPool::defaultThreads()
+{
+    unsigned threads = std::thread::hardware_concurrency();
+
+    return threads > 0 ? threads : 1;
+}
+
+ThreadPool::ThreadPool( unsigned threads )
+    : m_queued    ( 0 )
+    , m_pending   ( 0 )
+    , m_stopping  ( false )
+    , m_nextWorker( 0 )
+{
+    if (threads == 0)
+    {
+        threads = defaultThreads();
+    }
+
+    for (unsigned i = 0; i < threads; i++)
+    {
+        m_workers.push_back( std::unique_ptr<Worker>( new Worker ) );
+    }
+    for (unsigned i = 0; i < threads; i++)
+    {
+        m_threads.push_back( std::thread( &ThreadPool::workerLoop, this, i ) );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> guard( m_sleepLock );
+        m_stopping = true;
+    }
+    m_wakeUp.notify_all();
+
+    for (std::thread & thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit( Task task )
+{
+    unsigned index = ( currentPool == this )
+                   ? currentWorker
+                   : m_nextWorker++ % (unsigned)m_workers.size();
+
+    {
+        std::lock_guard<std::mutex> guard( m_sleepLock );
+        m_pending++;
+    }
+    {
+        std::lock_guard<std::mutex> guard( m_workers[index]->lock );
+        m_workers[index]->tasks.push_front( std::move( task ) );
+    }
+    {
+        std::lock_guard<std::mutex> guard( m_sleepLock );
+        m_queued++;
+    }
+    m_wakeUp.notify_one();
+
+} // ThreadPool::submit()
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard( m_sleepLock );
+
+    m_allDone.wait( guard, [this] { return m_pending == 0; } );
+}
+
+/*---------------------------------------------------------------------------*
+ takeTask() :
+ Newest task from our own deque, else the oldest from anyone else's.
+ *---------------------------------------------------------------------------*/
+bool ThreadPool::takeTask( unsigned index
+                         , Task   & task
+                         )
+{
+    unsigned count = (unsigned)m_workers.size();
+
+    for (unsigned n = 0; n < count; n++)
+    {
+        Worker & victim = *m_workers[( index + n ) % count];
+        std::lock_guard<std::mutex> guard( victim.lock );
+
+        if (!victim.tasks.empty())
+        {
+            if (n == 0)
+            {
+                task = std::move( victim.tasks.front() );
+                victim.tasks.pop_front();
+            }
+            else
+            {
+                task = std::move( victim.tasks.back() );
+                victim.tasks.pop_back();
+            }
+            m_queued--;
+            return true;
+        }
+    } // for each deque, starting with ours
+
+    return false;
+
+} // ThreadPool::takeTask()
+
+void ThreadPool::workerLoop( unsigned index )
+{
+    currentPool   = this;
+    currentWorker = index;
+
+    for (;;)
+    {
+        Task task;
+
+        if (takeTask( index, task ))
+        {
+            task();
+
+            std::lock_guard<std::mutex> guard( m_sleepLock );
+            if (--m_pending == 0)
+            {
+                m_allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard( m_sleepLock );
+        m_wakeUp.wait( guard, [this] { return m_stopping || m_queued > 0; } );
+        if (  m_stopping
+           && m_queued == 0
+           )
+        {
+            return;
+        }
+    } // forever
+
+} // ThreadPool::workerLoop()
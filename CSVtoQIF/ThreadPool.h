@@ -0,0 +1,68 @@
+/*===========================================================================*
+ ThreadPool.h :
+ Small work-stealing thread pool.
+
+ Every worker owns a deque.  Tasks submitted from outside the pool are
+ dealt round robin across the deques; tasks submitted by a running task go
+ on that worker's own deque.  A worker takes its newest task first (it's
+ the one most likely still in cache) and, when it runs dry, steals the
+ oldest task from the back of somebody else's deque.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    // threads == 0 means one per hardware thread.
+    explicit ThreadPool( unsigned threads = 0 );
+    ~ThreadPool();
+
+    void     submit( Task task );
+
+    // Block until every task submitted so far has finished.
+    void     wait  ();
+
+    unsigned size  () const { return (unsigned)m_threads.size(); }
+
+    static unsigned defaultThreads();
+
+private:
+    ThreadPool           ( const ThreadPool & );   // not copyable
+    ThreadPool & operator=( const ThreadPool & );
+
+    struct Worker
+    {
+        std::mutex       lock;
+        std::deque<Task> tasks;
+    };
+
+    void     workerLoop( unsigned index );
+    bool     takeTask  ( unsigned index
+                       , Task   & task
+                       );
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::vector<std::thread>              m_threads;
+
+    std::mutex              m_sleepLock;
+    std::condition_variable m_wakeUp;      // a task was queued, or stopping
+    std::condition_variable m_allDone;     // m_pending hit zero
+    std::atomic<long>       m_queued;      // sitting in a deque
+    long                    m_pending;     // queued or running (m_sleepLock)
+    bool                    m_stopping;    // (m_sleepLock)
+    std::atomic<unsigned>   m_nextWorker;  // round robin for outside submits
+
+}; // class ThreadPool
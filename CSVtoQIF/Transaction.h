@@ -0,0 +1,160 @@
+/*===========================================================================*
+ Transaction.h :
+ One converted row, as a record rather than as QIF text, and the interface
+ of whatever receives them.
+
+ A Transaction has both views of the row: the typed one (dates and names
+ as exported, amounts, prices and units as fixed point, the action that
+ was exported or derived) for code that wants to do its own thing with
+ it, and lines - the QIF fields in the order they're written - for code
+ that just wants the QIF.
+
+ Everything in it points into the CSV data being converted or into the
+ Transaction itself, so it's only good until the sink returns.  Copy what
+ you want to keep.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "CsvReader.h"
+#include "FixedPoint.h"
+#include "HeaderMap.h"
+
+/*---------------------------------------------------------------------------*
+ TransactionLine :
+ <fieldID><prefix><text> - one line of the QIF transaction.
+ *---------------------------------------------------------------------------*/
+struct TransactionLine
+{
+    char         fieldID;
+    const char * prefix;            // SF_PREPEND, or ""
+    size_t       prefixLen;
+    FieldView    text;
+};
+
+struct Transaction
+{
+    FieldView    date;
+    FieldView    security;          // without the prefix
+    const char * securityPrefix;    // SF_PREPEND, or ""
+    FieldView    memo;              // the activity type, for State Farm
+    FieldView    action;            // exported, or derived (see ActionRules.h)
+    FieldView    commission;        // exported, or derived
+    FieldView    cleared;           // exported, or derived
+    FieldView    txfrAcct;          // exported, derived, or empty for no transfer
+    FieldView    txfrAmount;
+
+    // The numbers, if there were any and they parsed; value is scaled by
+    // AMOUNT_SCALE, PRICE_SCALE and QUANTITY_SCALE.
+    Decimal      amount;
+    Decimal      price;
+    Decimal      units;
+    bool         hasAmount;
+    bool         hasPrice;
+    bool         hasUnits;
+
+    // The number columns as they're written: as exported if that was plain
+    // digits (or wouldn't parse), reformatted if not, empty if missing.
+    FieldView    amountLine;
+    FieldView    priceLine;
+    FieldView    unitsLine;
+
+    // lines[0, lineCount); there's room in lines for every column of the
+    // export plus the derived fields, so it's only sized once.
+    std::vector<TransactionLine> lines;
+    size_t       lineCount;
+
+    // Storage for the text lines needs that isn't in the CSV data.
+    char         amountText[DECIMAL_STR_LEN];
+    char         priceText [DECIMAL_STR_LEN];
+    char         unitsText [DECIMAL_STR_LEN];
+
+    Transaction() : lineCount( 0 ) {}
+
+private:
+    Transaction           ( const Transaction & );  // lines point into it
+    Transaction & operator=( const Transaction & );
+
+}; // struct Transaction
+
+// The text fields of a Transaction, for code that treats them all alike.
+enum TransactionText
+{
+    TEXT_DATE,
+    TEXT_SECURITY,
+    TEXT_MEMO,
+    TEXT_ACTION,
+    TEXT_COMMISSION,
+    TEXT_CLEARED,
+    TEXT_TXFR_ACCT,
+    TEXT_TXFR_AMOUNT,
+    TEXT_AMOUNT_LINE,
+    TEXT_PRICE_LINE,
+    TEXT_UNITS_LINE,
+
+    TEXT_COUNT
+};
+
+inline FieldView Transaction::* const TRANSACTION_TEXTS[TEXT_COUNT] =
+{
+    &Transaction::date,
+    &Transaction::security,
+    &Transaction::memo,
+    &Transaction::action,
+    &Transaction::commission,
+    &Transaction::cleared,
+    &Transaction::txfrAcct,
+    &Transaction::txfrAmount,
+    &Transaction::amountLine,
+    &Transaction::priceLine,
+    &Transaction::unitsLine
+};
+
+/*---------------------------------------------------------------------------*
+ TransactionSink :
+ Where a Converter sends what it makes of an export.  begin() gets the
+ header once it's been mapped, then there's a transaction() for every row
+ (less any left out as duplicates) and end() once the input's finished.
+ *---------------------------------------------------------------------------*/
+class TransactionSink
+{
+public:
+    virtual ~TransactionSink() {}
+
+    virtual void begin      ( const HeaderMap & ) {}
+    virtual void transaction( const Transaction & transaction ) = 0;
+    virtual void end        () {}
+
+}; // class TransactionSink
+
+/*---------------------------------------------------------------------------*
+ FanOutSink :
+ Hands everything to each of a set of sinks in turn, so one parse of an
+ export can feed several outputs.
+ *---------------------------------------------------------------------------*/
+class FanOutSink : public TransactionSink
+{
+public:
+    void add( TransactionSink & sink ) { m_sinks.push_back( &sink ); }
+
+    void begin( const HeaderMap & header ) override
+    {
+        for (TransactionSink * sink : m_sinks) sink->begin( header );
+    }
+    void transaction( const Transaction & transaction ) override
+    {
+        for (TransactionSink * sink : m_sinks) sink->transaction( transaction );
+    }
+    void end() override
+    {
+        for (TransactionSink * sink : m_sinks) sink->end();
+    }
+
+private:
+    std::vector<TransactionSink *> m_sinks;
+
+}; // class FanOutSink
@@ -0,0 +1,703 @@
+/*===========================================================================*
+ WatchConvert.cpp :
+ Noticing exports land, waiting for them to settle, converting them, and
+ the status report.
+
+ *===========================================================================*/
+
+#include "stdafx.h"
+#include "WatchConvert.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+
+#ifdef    __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // __linux__
+
+#include "DedupIndex.h"
+#include "HeaderMap.h"
+#include "ThreadPool.h"
+
+namespace fs = std::filesystem;
+
+typedef std::chrono::steady_clock Clock;
+
+// How often to look for finished conversions while there are some.
+const unsigned WATCH_BUSY_MS = 50;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop( int )
+{
+    stopRequested = 1;
+}
+
+static double millisSince( Clock::time_point then )
+{
+    return std::chrono::duration<double, std::milli>( Clock::now() - then ).count();
+}
+
+/*---------------------------------------------------------------------------*
+ Version :
+ What a file looked like when it was last looked at.
+ *---------------------------------------------------------------------------*/
+struct Version
+{
+    uintmax_t          size;
+    fs::file_time_type written;
+
+    bool operator==( const Version & other ) const
+    {
+        return size    == other.size
+            && written == other.written;
+    }
+    bool operator!=( const Version & other ) const { return !( *this == other ); }
+};
+
+// False if the file isn't there (any more).
+static bool versionOf( const std::string & path
+                     , Version           & version
+                     )
+{
+    std::error_code error;
+
+    version.size = fs::file_size( path, error );
+    if (!error)
+    {
+        version.written = fs::last_write_time( path, error );
+    }
+    return !error;
+}
+
+/*---------------------------------------------------------------------------*
+ DirectoryWatch :
+ Says which exports in the watched directories might have changed.
+ *---------------------------------------------------------------------------*/
+class DirectoryWatch
+{
+public:
+    DirectoryWatch();
+    ~DirectoryWatch();
+
+    bool add ( const std::string & dir
+             , std::string       & error
+             );
+
+    // Wait up to timeoutMs for something to happen; changed gets every
+    // export it might have happened to (all of them, if it can't tell).
+    void wait( unsigned                   timeoutMs
+             , std::vector<std::string> & changed
+             );
+
+    // Every export in the watched directories.
+    void list( std::vector<std::string> & files ) const;
+
+private:
+    DirectoryWatch           ( const DirectoryWatch & );   // not copyable
+    DirectoryWatch & operator=( const DirectoryWatch & );
+
+    std::vector<std::string>   m_dirs;
+
+    #ifdef    __linux__
+    int                        m_fd;        // inotify
+    std::map<int, std::string> m_watched;   // watch descriptor -> directory
+    #endif // __linux__
+
+}; // class DirectoryWatch
+
+DirectoryWatch::DirectoryWatch()
+{
+    #ifdef    __linux__
+    m_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    #endif // __linux__
+}
+
+DirectoryWatch::~DirectoryWatch()
+{
+    #ifdef    __linux__
+    if (m_fd >= 0)
+    {
+        close( m_fd );
+    }
+    #endif // __linux__
+}
+
+bool DirectoryWatch::add( const std::string & dir
+                        , std::string       & error
+                        )
+{
+    std::error_code notThere;
+    if (!fs::is_directory( dir, notThere ))
+    {
+        error = "ERROR: Can't watch...\n" + dir + "\n...it isn't a directory.\n";
+        return false;
+    }
+
+    #ifdef    __linux__
+    int watch = m_fd < 0 ? -1
+                         : inotify_add_watch( m_fd
+                                            , dir.c_str()
+                                            , IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO
+                                            );
+    if (watch < 0)
+    {
+        error = "ERROR: Can't watch...\n" + dir + "\n..." + strerror( errno ) + "\n";
+        return false;
+    }
+    m_watched[watch] = dir;
+    #endif // __linux__
+
+    m_dirs.push_back( dir );
+    return true;
+}
+
+void DirectoryWatch::list( std::vector<std::string> & files ) const
+{
+    for (const std::string & dir : m_dirs)
+    {
+        std::error_code error;
+
+        for (fs::directory_iterator it( dir, error ), end; !error && it != end; it.increment( error ))
+        {
+            if (  isExportFile( it->path().filename().string() )
+               && it->is_regular_file( error )
+               )
+            {
+                files.push_back( it->path().string() );
+            }
+        }
+    }
+}
+
+void DirectoryWatch::wait( unsigned                   timeoutMs
+                         , std::vector<std::string> & changed
+                         )
+{
+    #ifdef    __linux__
+    struct pollfd ready = { m_fd, POLLIN, 0 };
+
+    if (poll( &ready, 1, (int)timeoutMs ) <= 0)
+    {
+        return;                         // nothing, or a signal
+    }
+
+    alignas( struct inotify_event ) char events[64 * 1024];
+    ssize_t                              len;
+
+    while ((len = read( m_fd, events, sizeof( events ) )) > 0)
+    {
+        for (char * p = events; p < events + len; )
+        {
+            const struct inotify_event * event = (const struct inotify_event *)p;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                list( changed );        // lost track - look at everything
+            }
+            else if (  event->len > 0
+                    && isExportFile( event->name )
+                    )
+            {
+                changed.push_back( ( fs::path( m_watched[event->wd] ) / event->name ).string() );
+            }
+            p += sizeof( struct inotify_event ) + event->len;
+        }
+    }
+    #else
+    std::this_thread::sleep_for( std::chrono::milliseconds( std::min( timeoutMs, WATCH_POLL_MS ) ) );
+    list( changed );
+    #endif // __linux__
+
+} // DirectoryWatch::wait()
+
+/*---------------------------------------------------------------------------*
+ LatencyWindow :
+ The last WATCH_LATENCY_WINDOW latencies, and percentiles of them.
+ *---------------------------------------------------------------------------*/
+class LatencyWindow
+{
+public:
+    LatencyWindow() : m_next( 0 ) {}
+
+    void add( double ms )
+    {
+        if (m_samples.size() < WATCH_LATENCY_WINDOW)
+        {
+            m_samples.push_back( ms );
+        }
+        else
+        {
+            m_samples[m_next] = ms;
+            m_next            = ( m_next + 1 ) % WATCH_LATENCY_WINDOW;
+        }
+    }
+
+    // Nearest rank; 0 before there's anything.
+    double percentile( double percent ) const
+    {
+        if (m_samples.empty())
+        {
+            return 0.0;
+        }
+
+        std::vector<double> sorted( m_samples );
+        size_t              rank = (size_t)( percent / 100.0 * sorted.size() + 0.999999 );
+
+        rank = rank == 0 ? 0 : std::min( rank, sorted.size() ) - 1;
+        std::nth_element( sorted.begin(), sorted.begin() + rank, sorted.end() );
+        return sorted[rank];
+    }
+
+    size_t size() const { return m_samples.size(); }
+
+private:
+    std::vector<double> m_samples;
+    size_t              m_next;         // oldest, once it's full
+
+}; // class LatencyWindow
+
+/*---------------------------------------------------------------------------*
+ Spool :
+ Where every export the watch knows about stands.  Only the watching
+ thread touches it, apart from finished, which the workers add to.
+ *---------------------------------------------------------------------------*/
+struct Pending                          // noticed, not handed to a worker yet
+{
+    Version           version;
+    Clock::time_point noticed;          // for the latency
+    Clock::time_point changed;          // when version last moved
+    bool              settled;          // in Spool::waiting
+};
+
+struct Finished
+{
+    std::string   path;
+    Version       version;              // what was converted
+    double        latencyMs;
+    ConvertResult result;
+};
+
+struct Spool
+{
+    std::map<std::string, Pending> pending;
+    std::deque<std::string>        waiting;         // settled, in order
+    std::map<std::string, Version> converted;       // last version converted
+    std::set<std::string>          handedOut;       // to the pool
+    OutputClaims                   claims;          // QIF file -> export
+    std::atomic<unsigned>          running;         // of handedOut
+
+    std::mutex                     finishedLock;
+    std::vector<Finished>          finished;
+
+    size_t                         succeeded;
+    size_t                         failed;
+    size_t                         rows;
+    size_t                         bytes;
+    ConvertStats                   stats;
+    LatencyWindow                  latency;
+
+    Spool() : running( 0 ), succeeded( 0 ), failed( 0 ), rows( 0 ), bytes( 0 ) {}
+
+    void   notice ( const std::string & path
+                  , Clock::time_point   now
+                  );
+    void   settle ( Clock::time_point   now
+                  , unsigned            settleMs
+                  );
+    size_t settling() const { return pending.size() - waiting.size(); }
+
+}; // struct Spool
+
+// path might have changed.
+void Spool::notice( const std::string & path
+                  , Clock::time_point   now
+                  )
+{
+    Version version;
+
+    if (!versionOf( path, version ))
+    {
+        claims.release( path );
+
+        std::deque<std::string>::iterator queued = std::find( waiting.begin(), waiting.end(), path );
+        if (queued != waiting.end())
+        {
+            waiting.erase( queued );
+        }
+        pending.erase( path );          // gone before it was converted
+        return;
+    }
+
+    std::map<std::string, Pending>::iterator it = pending.find( path );
+    if (it == pending.end())
+    {
+        std::map<std::string, Version>::const_iterator done = converted.find( path );
+        if (  done == converted.end()
+           || done->second != version
+           )
+        {
+            Pending fresh = { version, now, now, false };
+            pending.emplace( path, fresh );
+        }
+        return;
+    }
+
+    Pending & file = it->second;
+    if (file.version != version)
+    {
+        file.version = version;
+        file.changed = now;
+        if (file.settled)
+        {
+            file.settled = false;
+            waiting.erase( std::find( waiting.begin(), waiting.end(), path ) );
+        }
+    }
+
+} // Spool::notice()
+
+// Move what's been still for settleMs to waiting.
+void Spool::settle( Clock::time_point now
+                  , unsigned          settleMs
+                  )
+{
+    std::chrono::milliseconds settleTime( settleMs );
+
+    for (std::map<std::string, Pending>::iterator it = pending.begin(); it != pending.end(); )
+    {
+        Pending & file = it->second;
+        Version   version;
+
+        if (  file.settled
+           || now - file.changed < settleTime
+           || handedOut.count( it->first ) > 0         // again once that's done
+           )
+        {
+            ++it;
+            continue;
+        }
+
+        if (!versionOf( it->first, version ))
+        {
+            it = pending.erase( it );
+            continue;
+        }
+        if (version != file.version)
+        {
+            file.version = version;
+            file.changed = now;
+        }
+        else
+        {
+            file.settled = true;
+            waiting.push_back( it->first );
+        }
+        ++it;
+    }
+
+} // Spool::settle()
+
+static void printStatus( const Spool & spool
+                       , StatsFormat   format
+                       )
+{
+    size_t queued = spool.handedOut.size() - spool.running;
+
+    if (format == STATS_JSON)
+    {
+        printf( "{\"watch\":\"status\",\"queue_depth\":%zu,\"settling\":%zu,\"waiting\":%zu,\"converting\":%u"
+                ",\"converted\":%zu,\"failed\":%zu,\"latency_ms\":{\"samples\":%zu,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}}\n"
+              , spool.settling() + spool.waiting.size() + queued
+              , spool.settling()
+              , spool.waiting.size() + queued
+              , (unsigned)spool.running
+              , spool.succeeded
+              , spool.failed
+              , spool.latency.size()
+              , spool.latency.percentile( 50 )
+              , spool.latency.percentile( 90 )
+              , spool.latency.percentile( 99 )
+              , spool.latency.percentile( 100 )
+              );
+    }
+    else
+    {
+        printf( "Watch: %zu converted, %zu failed; queue %zu (%zu settling, %zu waiting, %u converting); "
+                "latency p50 %.0f, p90 %.0f, p99 %.0f, max %.0f ms\n"
+              , spool.succeeded
+              , spool.failed
+              , spool.settling() + spool.waiting.size() + queued
+              , spool.settling()
+              , spool.waiting.size() + queued
+              , (unsigned)spool.running
+              , spool.latency.percentile( 50 )
+              , spool.latency.percentile( 90 )
+              , spool.latency.percentile( 99 )
+              , spool.latency.percentile( 100 )
+              );
+    }
+    fflush( stdout );
+
+} // printStatus()
+
+// Report what the workers have finished since last time.
+static void collect( Spool & spool )
+{
+    std::vector<Finished> finished;
+    {
+        std::lock_guard<std::mutex> guard( spool.finishedLock );
+        finished.swap( spool.finished );
+    }
+
+    for (Finished & done : finished)
+    {
+        ConvertResult & result = done.result;
+
+        spool.handedOut.erase( done.path );
+        spool.converted[done.path] = done.version;
+
+        if (result.error.empty())
+        {
+            spool.succeeded++;
+            spool.rows  += result.rows;
+            spool.bytes += result.bytes;
+            spool.stats.add( result.stats );
+            spool.latency.add( done.latencyMs );
+
+            printf( "%s: %zu rows in %.3f sec, %.0f ms after it landed\n"
+                  , done.path.c_str()
+                  , result.rows
+                  , result.seconds
+                  , done.latencyMs
+                  );
+            printWarnings( result );
+        }
+        else
+        {
+            spool.failed++;
+            printf( "%s", result.error.c_str() );
+        }
+    }
+    if (!finished.empty())
+    {
+        fflush( stdout );
+    }
+
+} // collect()
+
+int runWatch( const std::vector<std::string> & dirs
+            , unsigned                         jobs
+            , const ConvertOptions           & options
+            , const WatchOptions             & watch
+            , ConvertFn                        convert
+            )
+{
+    Clock::time_point startTime = Clock::now();
+    DirectoryWatch    watcher;
+    Spool             spool;
+    std::string       error;
+
+    for (const std::string & dir : dirs)
+    {
+        if (!watcher.add( dir, error ))
+        {
+            printf( "%s", error.c_str() );
+            return 1;
+        }
+    }
+
+    // Whatever landed while nobody was watching.  What's already there
+    // claims its QIF file in name order, so x.csv keeps x.qif from
+    // x.csv.gz from one run to the next.
+    std::vector<std::string> changed;
+    watcher.list( changed );
+    std::sort( changed.begin(), changed.end() );
+    for (const std::string & path : changed)
+    {
+        Version         version;
+        fs::path        qif = qifName( path, options );
+        std::error_code notThere;
+
+        if (  spool.claims.claim( path, options ).empty()
+           && versionOf( path, version )
+           && fs::last_write_time( qif, notThere ) >= version.written
+           && !notThere
+           )
+        {
+            spool.converted[path] = version;
+        }
+        else
+        {
+            spool.notice( path, startTime );
+        }
+    }
+
+    ConvertOptions fileOptions = options;
+
+    fileOptions.verbose = false;
+    fileOptions.threads = 1;
+
+    // With a dedup index, one at a time in the order they settled, so each
+    // leaves out what the ones before it wrote (see DedupIndex.h); a big
+    // one still splits across jobs threads.
+    if (options.dedup != nullptr)
+    {
+        fileOptions.threads = jobs;
+    }
+
+    stopRequested = 0;
+    signal( SIGINT,  requestStop );
+    signal( SIGTERM, requestStop );
+
+    {
+        ThreadPool        pool( jobs );
+        size_t            limit      = options.dedup != nullptr ? 1 : pool.size() * WATCH_QUEUE_PER_THREAD;
+        Clock::time_point nextStatus = startTime + std::chrono::seconds( watch.statusSeconds );
+
+        printf( "Watching %zu director(ies) on %u thread(s); exports convert %u ms after they stop changing\n"
+              , dirs.size()
+              , pool.size()
+              , watch.settleMs
+              );
+        fflush( stdout );
+
+        while (!stopRequested)
+        {
+            Clock::time_point now = Clock::now();
+
+            spool.settle( now, watch.settleMs );
+
+            while (  !spool.waiting.empty()
+                  && spool.handedOut.size() < limit
+                  )
+            {
+                std::string path = spool.waiting.front();
+                Pending     file = spool.pending[path];
+
+                spool.waiting.pop_front();
+                spool.pending.erase( path );
+                spool.handedOut.insert( path );
+
+                // Another export already has its QIF file.
+                std::string clash = spool.claims.claim( path, fileOptions );
+                if (!clash.empty())
+                {
+                    Finished done;
+
+                    done.path               = path;
+                    done.version            = file.version;
+                    done.latencyMs          = millisSince( file.noticed );
+                    done.result.csvFilename = path;
+                    done.result.error       = clash;
+
+                    std::lock_guard<std::mutex> guard( spool.finishedLock );
+                    spool.finished.push_back( std::move( done ) );
+                    continue;
+                }
+
+                pool.submit( [&spool, &fileOptions, convert, path, file]
+                             {
+                                 Finished done;
+
+                                 spool.running++;
+                                 done.path               = path;
+                                 done.version            = file.version;
+                                 done.result.csvFilename = path;
+                                 convert( path.c_str(), fileOptions, done.result );
+                                 done.latencyMs          = millisSince( file.noticed );
+                                 spool.running--;
+
+                                 std::lock_guard<std::mutex> guard( spool.finishedLock );
+                                 spool.finished.push_back( std::move( done ) );
+                             }
+                           );
+            }
+
+            collect( spool );
+
+            // Lookups see staged keys already, so the dedup index file only
+            // needs them once there's nothing left to convert.
+            if (  options.dedup != nullptr
+               && spool.handedOut.empty()
+               && spool.pending.empty()
+               && !options.dedup->commit( error )
+               )
+            {
+                printf( "%s", error.c_str() );
+            }
+
+            if (  watch.statusSeconds > 0
+               && now >= nextStatus
+               )
+            {
+                printStatus( spool, options.stats );
+                nextStatus = now + std::chrono::seconds( watch.statusSeconds );
+            }
+
+            // Sleep until something could be ready.
+            unsigned timeoutMs = spool.handedOut.empty() ? WATCH_POLL_MS : WATCH_BUSY_MS;
+            for (const std::pair<const std::string, Pending> & file : spool.pending)
+            {
+                if (!file.second.settled)
+                {
+                    long long wait = watch.settleMs - std::chrono::duration_cast<std::chrono::milliseconds>( now - file.second.changed ).count();
+                    timeoutMs = (unsigned)std::max( 1LL, std::min( (long long)timeoutMs, wait ) );
+                }
+            }
+
+            changed.clear();
+            watcher.wait( timeoutMs, changed );
+            now = Clock::now();
+            for (const std::string & path : changed)
+            {
+                spool.notice( path, now );
+            }
+        } // until told to stop
+
+        pool.wait();
+    }
+
+    signal( SIGINT,  SIG_DFL );
+    signal( SIGTERM, SIG_DFL );
+
+    collect( spool );
+    if (  options.dedup != nullptr
+       && !options.dedup->commit( error )
+       )
+    {
+        printf( "%s", error.c_str() );
+    }
+
+    double elapsed = std::chrono::duration<double>( Clock::now() - startTime ).count();
+
+    printf( "Stopped after %.0f sec: %zu file(s) converted, %zu rows, %.1f MB\n"
+          , elapsed
+          , spool.succeeded
+          , spool.rows
+          , spool.bytes / 1048576.0
+          );
+    printStatus( spool, options.stats );
+    if (options.stats != STATS_OFF)
+    {
+        std::string what = std::to_string( spool.succeeded ) + " file(s) watched";
+        printf( "%s", formatStats( spool.stats, options.stats, what, spool.bytes, elapsed ).c_str() );
+    }
+
+    return (int)spool.failed;
+
+} // runWatch()
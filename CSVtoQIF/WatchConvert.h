@@ -0,0 +1,69 @@
+/*===========================================================================*
+ WatchConvert.h :
+ Converting exports as they land in spool directories, for as long as the
+ process runs.  Header profiles and action rules are loaded once, by main(),
+ and stay loaded; each new or changed export (.csv, or .csv.gz or .csv.zst
+ - see isExportFile()) directly inside a watched directory is converted
+ next to itself, the same as a batch run would.  An export whose QIF file
+ another one already has (x.csv.gz next to x.csv) fails instead - see
+ OutputClaims.
+
+ Changes are noticed with inotify on Linux and by listing the directories
+ every WATCH_POLL_MS everywhere else.  Either way a file isn't converted
+ until its size and time stamp have stayed put for the settle time, since
+ an export being copied in looks like a file that's there.  Settled files
+ go to a ThreadPool of jobs workers, no more than WATCH_QUEUE_PER_THREAD
+ per worker at a time; the rest wait their turn in the order they
+ settled.  With a dedup index they go one at a time instead, so each
+ leaves out what the ones before it wrote (see DedupIndex.h).  Output is
+ written atomically (see QifWriter.h).
+
+ When it starts, every export without a QIF file at least as new as it is
+ converted first.  A file changed again while it's converting is converted
+ again once it settles.
+
+ Every statusSeconds (and when it stops) a status line reports the queue -
+ files settling, waiting and converting - and the latency, from a file
+ being noticed to its QIF being in place, at the 50th, 90th and 99th
+ percentiles of the last WATCH_LATENCY_WINDOW files; --stats=json makes it
+ one line of JSON.  Ctrl+C or SIGTERM stops it once the conversions
+ already under way are done.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "BatchConvert.h"
+
+const unsigned WATCH_DEFAULT_SETTLE_MS      = 2000;
+const unsigned WATCH_DEFAULT_STATUS_SECONDS = 60;
+
+// How often directories are listed where there's no inotify.
+const unsigned WATCH_POLL_MS                = 500;
+
+// Files handed to the pool ahead of the workers getting to them.
+const unsigned WATCH_QUEUE_PER_THREAD       = 2;
+
+// Conversions the latency percentiles are taken over.
+const size_t   WATCH_LATENCY_WINDOW         = 1024;
+
+struct WatchOptions
+{
+    unsigned settleMs;              // quiet time before a file's converted
+    unsigned statusSeconds;         // between status lines, 0 for none
+
+    WatchOptions() : settleMs( WATCH_DEFAULT_SETTLE_MS ), statusSeconds( WATCH_DEFAULT_STATUS_SECONDS ) {}
+};
+
+// Watch dirs and convert what lands in them on jobs threads (0 = one per
+// core), each file as options says, until the process is told to stop.
+// Returns the number of conversions that failed.
+int runWatch( const std::vector<std::string> & dirs
+            , unsigned                         jobs
+            , const ConvertOptions           & options
+            , const WatchOptions             & watch
+            , ConvertFn                        convert
+            );
@@ -0,0 +1,307 @@
+/*===========================================================================*
+ ConvertBench.cpp :
+ End to end benchmark of the converter, a phase at a time, over a real
+ export or a synthetic one made on the spot (see SyntheticExport.h).
+
+     read          map the export and touch every page of it
+     tokenize      split it into rows and fields (CsvReader)
+     transactions  ...and make a Transaction of every row (Converter)
+     qif           ...and write the QIF file (Converter + QifSink)
+     parallel      the same on every core (convertParallel())
+
+ Each phase reports its time, rows/sec and MB/sec of CSV, and the peak
+ resident set size while it ran (where the OS lets us reset the peak;
+ otherwise the process peak so far).
+
+ Usage: ConvertBench [SIZE | export.csv] [--mix B,M,W] [--threads N]
+
+   SIZE defaults to 256M; a generated export and the QIF files are
+   written to the current directory and deleted afterwards.
+
+ `cmake --build build --target bench` runs it with the defaults.
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef    _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment( lib, "psapi.lib" )
+#else
+#include <sys/resource.h>
+#endif // _WIN32
+
+#include "Converter.h"
+#include "CsvReader.h"
+#include "MappedFile.h"
+#include "ParallelConvert.h"
+#include "QifRows.h"
+#include "QifWriter.h"
+#include "SyntheticExport.h"
+#include "ThreadPool.h"
+
+#define BENCH_CSV              "ConvertBench.csv"
+#define BENCH_QIF              "ConvertBench.qif"
+
+/*---------------------------------------------------------------------------*
+ Peak resident set size.  Linux can be told to start counting again
+ (/proc/self/clear_refs), so there each phase gets its own peak.
+ *---------------------------------------------------------------------------*/
+static bool resetPeakRss()
+{
+    #ifdef    _WIN32
+    return false;
+    #else
+    FILE * refs = fopen( "/proc/self/clear_refs", "w" );
+    if (refs == nullptr)
+    {
+        return false;
+    }
+    bool ok = fputs( "5", refs ) >= 0;
+    return fclose( refs ) == 0 && ok;
+    #endif // _WIN32
+}
+
+static double peakRssMB()
+{
+    #ifdef    _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) );
+    return counters.PeakWorkingSetSize / 1048576.0;
+    #else
+    FILE * status = fopen( "/proc/self/status", "r" );
+    if (status != nullptr)
+    {
+        char line[256];
+        while (fgets( line, sizeof( line ), status ) != nullptr)
+        {
+            unsigned long kb;
+            if (sscanf( line, "VmHWM: %lu kB", &kb ) == 1)
+            {
+                fclose( status );
+                return kb / 1024.0;
+            }
+        }
+        fclose( status );
+    }
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    #ifdef    __APPLE__
+    return usage.ru_maxrss / 1048576.0;
+    #else
+    return usage.ru_maxrss / 1024.0;
+    #endif // __APPLE__
+    #endif // _WIN32
+}
+
+/*---------------------------------------------------------------------------*
+ CountingSink :
+ Takes the transactions and does nothing with them but count.
+ *---------------------------------------------------------------------------*/
+class CountingSink : public TransactionSink
+{
+public:
+    CountingSink() : transactions( 0 ) {}
+
+    void transaction( const Transaction & ) override { transactions++; }
+
+    size_t transactions;
+};
+
+/*---------------------------------------------------------------------------*
+ Phase :
+ Times whatever happens between its construction and report().
+ *---------------------------------------------------------------------------*/
+class Phase
+{
+public:
+    Phase( const char * name )
+        : m_name ( name )
+        , m_start( std::chrono::steady_clock::now() )
+    {
+        m_ownPeak = resetPeakRss();
+    }
+
+    double report( size_t rows
+                 , size_t bytes
+                 )
+    {
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - m_start ).count();
+        double safe    = seconds > 0.0 ? seconds : 1e-9;
+
+        printf( "%-14s %9.3f sec %14.0f rows/sec %9.1f MB/sec %9.1f MB peak%s\n"
+              , m_name
+              , seconds
+              , rows / safe
+              , bytes / 1048576.0 / safe
+              , peakRssMB()
+              , m_ownPeak ? "" : " (process)"
+              );
+        return seconds;
+    }
+
+private:
+    const char *                          m_name;
+    std::chrono::steady_clock::time_point m_start;
+    bool                                  m_ownPeak;
+};
+
+int main( int   argc
+        , char *argv[]
+        )
+{
+    std::string csvFilename;
+    uint64_t    bytes   = 256 << 20;
+    ExportMix   mix     = DEFAULT_MIX;
+    unsigned    threads = ThreadPool::defaultThreads();
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (  strcmp( argv[arg], "--mix" ) == 0
+           && arg + 1 < argc
+           )
+        {
+            if (!parseMix( argv[++arg], mix ))
+            {
+                printf( "ERROR: --mix wants BEFORE,MATCH,WITHDRAWALS\n" );
+                return 1;
+            }
+        }
+        else if (  strcmp( argv[arg], "--threads" ) == 0
+                && arg + 1 < argc
+                )
+        {
+            threads = (unsigned)atoi( argv[++arg] );
+        }
+        else if (!parseSize( argv[arg], bytes ))
+        {
+            csvFilename = argv[arg];
+        }
+    } // for each argument
+
+    bool generated = csvFilename.empty();
+
+    if (generated)
+    {
+        csvFilename = BENCH_CSV;
+
+        Phase    phase( "generate" );
+        uint64_t generatedRows = 0;
+        if (!writeSyntheticExport( BENCH_CSV, bytes, mix, 1, &generatedRows ))
+        {
+            printf( "ERROR: Can't write output file...\n%s\n...disk full?\n", BENCH_CSV );
+            return 1;
+        }
+        phase.report( (size_t)generatedRows, (size_t)bytes );
+    }
+
+    MappedFile csv;
+    size_t     rows = 0;
+
+    // read
+    {
+        Phase phase( "read" );
+        if (!csv.open( csvFilename.c_str() ))
+        {
+            printf( "ERROR: Input file...\n%s\n...not found\n", csvFilename.c_str() );
+            return 1;
+        }
+
+        volatile unsigned char sink = 0;
+        for (size_t offset = 0; offset < csv.size(); offset += 4096)
+        {
+            sink ^= (unsigned char)csv.data()[offset];
+        }
+        phase.report( 0, csv.size() );
+    }
+
+    printf( "%s: %.1f MB\n", csvFilename.c_str(), csv.size() / 1048576.0 );
+
+    // tokenize
+    {
+        Phase                  phase( "tokenize" );
+        CsvReader              reader( csv.data(), csv.size() );
+        std::vector<FieldView> fields;
+
+        while (reader.nextRow( fields ))
+        {
+            rows++;
+        }
+        rows = rows > 0 ? rows - 1 : 0;         // not the header
+        phase.report( rows, csv.size() );
+    }
+
+    // transactions
+    {
+        Phase        phase( "transactions" );
+        CountingSink sink;
+        Converter    converter( sink );
+
+        converter.feed( csv.data(), csv.size() );
+        converter.finish();
+        phase.report( converter.rows(), csv.size() );
+    }
+
+    // qif
+    {
+        Phase     phase( "qif" );
+        QifWriter writer;
+        if (!writer.open( BENCH_QIF ))
+        {
+            printf( "ERROR: Can't open output file...\n%s\n...for some reason.\n", BENCH_QIF );
+            return 1;
+        }
+
+        QifSink   sink( writer );
+        Converter converter( sink );
+
+        converter.feed( csv.data(), csv.size() );
+        converter.finish();
+        writer.close();
+        phase.report( converter.rows(), csv.size() );
+    }
+
+    // parallel
+    if (threads != 1)
+    {
+        char name[32];
+        snprintf( name, sizeof( name ), "parallel x%u", threads );
+
+        Phase                  phase( name );
+        CsvReader              reader( csv.data(), csv.size() );
+        std::vector<FieldView> fields;
+        HeaderMap              header;
+        RowChecks              checks;
+        QifWriter              writer;
+
+        reader.nextRow( fields );
+        mapHeader( fields, header );
+
+        if (!writer.open( BENCH_QIF ))
+        {
+            printf( "ERROR: Can't open output file...\n%s\n...for some reason.\n", BENCH_QIF );
+            return 1;
+        }
+        writer.buffer().line( HEADER_LINE, sizeof( HEADER_LINE ) - 1 );
+
+        size_t converted = convertParallel( header, csv.data(), reader.offset(), csv.size(), threads, writer, checks );
+        writer.close();
+        phase.report( converted, csv.size() );
+    } // if more than one thread
+
+    csv.close();
+    remove( BENCH_QIF );
+    if (generated)
+    {
+        remove( BENCH_CSV );
+    }
+
+    return 0;
+
+} // main()
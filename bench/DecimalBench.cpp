@@ -0,0 +1,130 @@
+/*===========================================================================*
+ DecimalBench.cpp :
+ parseDecimal() against what renderRow() used to do with amounts - copy
+ the field into a buffer and strtof() it - over the amount, price and unit
+ columns of a synthetic State Farm export.  Then sums every amount both
+ ways to show what float does to a balance.
+
+ Build (from this directory)...
+   cl /O2 /EHsc /std:c++17 /I..\CSVtoQIF DecimalBench.cpp ..\CSVtoQIF\FixedPoint.cpp
+   g++ -O2 -std=c++17 -I../CSVtoQIF DecimalBench.cpp ../CSVtoQIF/FixedPoint.cpp
+
+ Usage: DecimalBench [rows, default 2000000]
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "FixedPoint.h"
+
+struct Number
+{
+    size_t offset;
+    size_t len;
+    int    scale;
+};
+
+static double elapsed( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+int main( int argc, char * argv[] )
+{
+    size_t rows = argc > 1 ? (size_t)atol( argv[1] ) : 2000000;
+
+    // Amount, price and units for each row, as text, the way exports
+    // write them.
+    std::string         text;
+    std::vector<Number> numbers;
+    unsigned            seed = 12345;
+    char                field[64];
+
+    numbers.reserve( rows * 3 );
+    for (size_t row = 0; row < rows; row++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int    cents = 100 + ( seed >> 4 ) % 500000;
+        double price = 10.0 + ( seed >> 12 ) % 200000 / 1000.0;
+
+        int lens[3];
+        lens[0] = snprintf( field, sizeof( field ), "%s%d.%02d", ( seed >> 30 ) ? "" : "-", cents / 100, cents % 100 );
+        text.append( field, (size_t)lens[0] );
+        lens[1] = snprintf( field, sizeof( field ), "%.4f", price );
+        text.append( field, (size_t)lens[1] );
+        lens[2] = snprintf( field, sizeof( field ), "%.6f", cents / 100.0 / price );
+        text.append( field, (size_t)lens[2] );
+
+        size_t end = text.size();
+        numbers.push_back( { end - lens[2] - lens[1] - lens[0], (size_t)lens[0], AMOUNT_SCALE   } );
+        numbers.push_back( { end - lens[2] - lens[1]          , (size_t)lens[1], PRICE_SCALE    } );
+        numbers.push_back( { end - lens[2]                    , (size_t)lens[2], QUANTITY_SCALE } );
+    }
+
+    printf( "%zu numbers, %.1f MB of text\n", numbers.size(), text.size() / 1048576.0 );
+
+    // The old way: copy out, terminate, strtof().
+    auto   start      = std::chrono::steady_clock::now();
+    double floatTotal = 0.0;
+    float  floatSum   = 0.0f;
+    for (const Number & n : numbers)
+    {
+        char copy[32];
+        size_t len = n.len < sizeof( copy ) - 1 ? n.len : sizeof( copy ) - 1;
+        memcpy( copy, text.data() + n.offset, len );
+        copy[len] = '\0';
+
+        float value = strtof( copy, nullptr );
+        floatTotal += value;
+        if (n.scale == AMOUNT_SCALE)
+        {
+            floatSum += value;
+        }
+    }
+    double floatSecs = elapsed( start );
+
+    // The new way.
+    start = std::chrono::steady_clock::now();
+    int64_t fixedTotal = 0;
+    int64_t fixedSum   = 0;
+    for (const Number & n : numbers)
+    {
+        Decimal d;
+        parseDecimal( text.data() + n.offset, n.len, n.scale, d );
+        fixedTotal += d.value;
+        if (n.scale == AMOUNT_SCALE)
+        {
+            fixedSum += d.value;
+        }
+    }
+    double fixedSecs = elapsed( start );
+
+    printf( "strtof        %8.3f sec %8.1f M numbers/sec   (checksum %g)\n"
+          , floatSecs
+          , numbers.size() / floatSecs / 1e6
+          , floatTotal
+          );
+    printf( "parseDecimal  %8.3f sec %8.1f M numbers/sec   (checksum %lld)\n"
+          , fixedSecs
+          , numbers.size() / fixedSecs / 1e6
+          , (long long)fixedTotal
+          );
+    printf( "speedup       %8.2fx\n", floatSecs / fixedSecs );
+
+    char exact[DECIMAL_STR_LEN];
+    formatDecimal( fixedSum, AMOUNT_SCALE, AMOUNT_SCALE, exact );
+    printf( "\nSum of %zu amounts\n"
+            "  float        %.2f\n"
+            "  fixed point  %s\n"
+          , rows
+          , (double)floatSum
+          , exact
+          );
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*===========================================================================*
+ ExportGen.cpp :
+ Writes a synthetic State Farm export (see SyntheticExport.h) to a file.
+
+ Usage: ExportGen SIZE OUTPUT.csv [--mix BEFORE,MATCH,WITHDRAWALS] [--seed N]
+
+   SIZE   1K, 64K, 256M, 10G... the export comes out no bigger than that
+   --mix  relative weights of the activity types, default 60,30,10
+   --seed anything; the same seed gives the same export, default 1
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SyntheticExport.h"
+
+int main( int   argc
+        , char *argv[]
+        )
+{
+    uint64_t     bytes    = 0;
+    const char * filename = nullptr;
+    ExportMix    mix      = DEFAULT_MIX;
+    uint64_t     seed     = 1;
+    bool         usage    = argc < 3 || !parseSize( argv[1], bytes );
+
+    if (!usage)
+    {
+        filename = argv[2];
+    }
+    for (int arg = 3; !usage && arg < argc; arg++)
+    {
+        if (  strcmp( argv[arg], "--mix" ) == 0
+           && arg + 1 < argc
+           )
+        {
+            usage = !parseMix( argv[++arg], mix );
+        }
+        else if (  strcmp( argv[arg], "--seed" ) == 0
+                && arg + 1 < argc
+                )
+        {
+            seed = strtoull( argv[++arg], nullptr, 10 );
+        }
+        else
+        {
+            usage = true;
+        }
+    } // for each option
+
+    if (usage)
+    {
+        printf( "Usage: ExportGen SIZE OUTPUT.csv [--mix BEFORE,MATCH,WITHDRAWALS] [--seed N]\n"
+                "SIZE is 1K, 64K, 256M, 10G...; the default mix is %u,%u,%u.\n"
+              , DEFAULT_MIX.beforeTax
+              , DEFAULT_MIX.companyMatch
+              , DEFAULT_MIX.withdrawals
+              );
+        return 1;
+    }
+
+    uint64_t rows = 0;
+
+    if (!writeSyntheticExport( filename, bytes, mix, seed, &rows ))
+    {
+        printf( "ERROR: Can't write output file...\n%s\n...disk full?\n", filename );
+        return 1;
+    }
+
+    printf( "%llu rows\n", (unsigned long long)rows );
+    return 0;
+
+} // main()
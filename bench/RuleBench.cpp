@@ -0,0 +1,121 @@
+/*===========================================================================*
+ RuleBench.cpp :
+ How the cost of finding a row's action rule grows with the number of
+ rules.  For 1, 4, 16... activity types, builds a rule set with a + and -
+ rule for each, then looks up a stream of activity types (a quarter of
+ them ones no rule names) two ways: ActionRules::find(), and what
+ makeTransaction() used to do - compare the activity type with each name
+ in turn - extended to the same rules.
+
+ Build (from this directory)...
+   cl /O2 /EHsc /std:c++17 /I..\CSVtoQIF RuleBench.cpp ..\CSVtoQIF\ActionRules.cpp ..\CSVtoQIF\MappedFile.cpp
+   g++ -O2 -std=c++17 -I../CSVtoQIF RuleBench.cpp ../CSVtoQIF/{ActionRules,MappedFile}.cpp
+
+ Usage: RuleBench [lookups, default 4000000] [most activity types, default 1024]
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ActionRules.h"
+#include "HeaderMap.h"
+
+static double elapsed( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static std::string activityName( size_t i )
+{
+    static const char * kinds[] = { "Before-Tax", "Company Match", "Roth", "Dividend", "Loan Repayment", "Rollover" };
+    return std::string( kinds[i % 6] ) + " " + std::to_string( i );
+}
+
+int main( int argc, char * argv[] )
+{
+    size_t lookups  = argc > 1 ? (size_t)atol( argv[1] ) : 4000000;
+    size_t mostKind = argc > 2 ? (size_t)atol( argv[2] ) : 1024;
+
+    printf( "%zu lookups per rule count\n", lookups );
+    printf( "activity types    table ns/row    if-chain ns/row\n" );
+
+    for (size_t kinds = 1; kinds <= mostKind; kinds *= 4)
+    {
+        std::vector<std::string> names;
+        std::string              text;
+        std::string              error;
+
+        for (size_t i = 0; i < kinds; i++)
+        {
+            names.push_back( activityName( i ) );
+            text += names.back() + " = + BuyX T Cash\n";
+            text += names.back() + " = - SellX T Cash\n";
+        }
+
+        ActionRules rules;
+        if (!rules.add( text.data(), text.size(), "(generated)", error ))
+        {
+            printf( "%s", error.c_str() );
+            return 1;
+        }
+
+        // What the rows say, a quarter of them something no rule names.
+        std::vector<std::string> rows;
+        unsigned                 seed = 12345;
+
+        for (size_t i = 0; i < 4096; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            rows.push_back( ( seed >> 8 ) % 4 == 0 ? "Unknown " + std::to_string( i ) : names[( seed >> 12 ) % kinds] );
+        }
+
+        std::vector<FieldView> fields;
+        for (const std::string & row : rows)
+        {
+            fields.push_back( { row.data(), row.size(), false } );
+        }
+
+        // The table.
+        auto   start      = std::chrono::steady_clock::now();
+        size_t tableCheck = 0;
+        for (size_t i = 0; i < lookups; i++)
+        {
+            tableCheck += rules.find( fields[i & 4095], ( i & 1 ) != 0 ).actionLen;
+        }
+        double tableSecs = elapsed( start );
+
+        // A name at a time.
+        start = std::chrono::steady_clock::now();
+        size_t chainCheck = 0;
+        for (size_t i = 0; i < lookups; i++)
+        {
+            const char * row    = rows[i & 4095].c_str();
+            const char * action = ( i & 1 ) != 0 ? "SellX" : "Buy";
+
+            for (const std::string & name : names)
+            {
+                if (equalsNoCase( row, name.c_str() ))
+                {
+                    action = ( i & 1 ) != 0 ? "SellX" : "BuyX";
+                    break;
+                }
+            }
+            chainCheck += strlen( action );
+        }
+        double chainSecs = elapsed( start );
+
+        printf( "%14zu %15.1f %18.1f%s\n"
+              , kinds
+              , tableSecs * 1e9 / lookups
+              , chainSecs * 1e9 / lookups
+              , tableCheck == chainCheck ? "" : "   (results differ!)"
+              );
+    } // for each rule count
+
+    return 0;
+}
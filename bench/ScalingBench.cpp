@@ -0,0 +1,98 @@
+/*===========================================================================*
+ ScalingBench.cpp :
+ Thread scaling of the single file converter.  Builds a synthetic State
+ Farm export in memory (see SyntheticExport.h), then converts it with
+ convertParallel() on 1, 2, 4... up to N threads, writing to the null
+ device, and reports MB/sec and speedup over one thread.
+
+ Build (from this directory)...
+   cl /O2 /EHsc /std:c++17 /I..\CSVtoQIF ScalingBench.cpp SyntheticExport.cpp ..\CSVtoQIF\ActionRules.cpp ..\CSVtoQIF\Compression.cpp ..\CSVtoQIF\CsvReader.cpp ..\CSVtoQIF\CsvScan.cpp ..\CSVtoQIF\DedupIndex.cpp ..\CSVtoQIF\FixedPoint.cpp ..\CSVtoQIF\HeaderMap.cpp ..\CSVtoQIF\MappedFile.cpp ..\CSVtoQIF\ParallelConvert.cpp ..\CSVtoQIF\QifRows.cpp ..\CSVtoQIF\QifWriter.cpp ..\CSVtoQIF\Stats.cpp ..\CSVtoQIF\ThreadPool.cpp
+   g++ -O2 -std=c++17 -pthread -I../CSVtoQIF ScalingBench.cpp SyntheticExport.cpp ../CSVtoQIF/{ActionRules,Compression,CsvReader,CsvScan,DedupIndex,FixedPoint,HeaderMap,MappedFile,ParallelConvert,QifRows,QifWriter,Stats,ThreadPool}.cpp
+
+ Usage: ScalingBench [MB of CSV, default 256] [max threads, default all]
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "CsvReader.h"
+#include "HeaderMap.h"
+#include "ParallelConvert.h"
+#include "QifRows.h"
+#include "QifWriter.h"
+#include "SyntheticExport.h"
+#include "ThreadPool.h"
+
+#ifdef    _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif // _WIN32
+
+// The same rows ConvertBench converts (see SyntheticExport.h), in memory.
+static std::string makeCsv( size_t bytes )
+{
+    SyntheticExport generator( DEFAULT_MIX, 1, bytes );
+    std::string     csv = SyntheticExport::header();
+    char            row[SYNTHETIC_ROW_MAX];
+
+    csv.reserve( bytes + sizeof( row ) );
+    while (csv.size() < bytes)
+    {
+        csv.append( row, generator.nextRow( row ) );
+    }
+    return csv;
+}
+
+int main( int argc, char * argv[] )
+{
+    size_t      mb         = argc > 1 ? (size_t)atoi( argv[1] ) : 256;
+    unsigned    maxThreads = argc > 2 ? (unsigned)atoi( argv[2] ) : ThreadPool::defaultThreads();
+    std::string csv        = makeCsv( mb << 20 );
+
+    CsvReader              reader( csv.data(), csv.size() );
+    std::vector<FieldView> fields;
+    HeaderMap              header;
+
+    reader.nextRow( fields );
+    mapHeader( fields, header );
+
+    QifWriter nullFile;
+    if (!nullFile.open( NULL_DEVICE ))
+    {
+        printf( "Can't open %s\n", NULL_DEVICE );
+        return 1;
+    }
+
+    printf( "%.1f MB synthetic export\n", csv.size() / 1048576.0 );
+    printf( "threads       rows     MB/sec  speedup\n" );
+
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+    {
+        counts.push_back( threads );
+    }
+    counts.push_back( maxThreads );
+
+    double baseline = 0.0;
+    for (unsigned threads : counts)
+    {
+        RowChecks checks;
+        auto      start = std::chrono::steady_clock::now();
+        size_t    rows  = convertParallel( header, csv.data(), reader.offset(), csv.size(), threads, nullFile, checks );
+        double    secs  = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        double    rate  = csv.size() / 1048576.0 / secs;
+
+        if (threads == 1)
+        {
+            baseline = rate;
+        }
+        printf( "%7u %10zu %10.1f %8.2fx\n", threads, rows, rate, rate / baseline );
+    }
+
+    return 0;
+}
@@ -0,0 +1,312 @@
+/*===========================================================================*
+ SyntheticExport.cpp :
+ The generator behind ExportGen, ConvertBench and the golden tests.
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "SyntheticExport.h"
+
+#define PLAN_NAME              "State Farm 401(k) Savings Plan"
+
+struct Fund
+{
+    const char * name;          // as it appears in the CSV, quotes and all
+    int64_t      startPrice;    // scaled by 10^4
+    bool         fixedPrice;
+};
+
+static const Fund FUNDS[8] =
+{
+    { "LifePath 2040"              ,  213345, false },
+    { "LifePath 2050"              ,  231190, false },
+    { "S&P 500 Index"              , 3011200, false },
+    { "Russell 2000 Index"         , 1874410, false },
+    { "International Equity"       ,  148820, false },
+    { "\"Bond Fund, Intermediate\"",  112650, false },
+    { "Stable Value"               ,   10000, true  },
+    { "Money Market"               ,   10000, true  }
+};
+
+const int FUND_COUNT = sizeof( FUNDS ) / sizeof( FUNDS[0] );
+
+// About how long a row is, to turn a size into a row count.
+const uint64_t TYPICAL_ROW_BYTES = 112;
+
+// Rows are gathered into this much before each fwrite().
+const size_t WRITE_BLOCK_SIZE = 1 << 20;
+
+// Fifty years of pay periods; after that periods get more rows instead.
+const uint64_t MAX_PERIODS = 26 * 50;
+
+bool parseMix( const char * text
+             , ExportMix  & mix
+             )
+{
+    char extra;
+
+    return sscanf( text
+                 , "%u,%u,%u%c"
+                 , &mix.beforeTax
+                 , &mix.companyMatch
+                 , &mix.withdrawals
+                 , &extra
+                 ) == 3
+        && mix.beforeTax + mix.companyMatch + mix.withdrawals > 0;
+}
+
+bool parseSize( const char * text
+              , uint64_t   & bytes
+              )
+{
+    char *   end   = nullptr;
+    uint64_t value = strtoull( text, &end, 10 );
+
+    if (end == text)
+    {
+        return false;
+    }
+
+    switch (*end)
+    {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    default:                                 break;
+    }
+
+    // Allow 64KB, 10GB...
+    if (*end == 'b' || *end == 'B')
+    {
+        end++;
+    }
+
+    bytes = value;
+    return *end == '\0' && value > 0;
+}
+
+SyntheticExport::SyntheticExport( const ExportMix & mix
+                                , uint64_t          seed
+                                , uint64_t          bytes
+                                )
+    : m_mix        ( mix )
+    , m_state      ( seed * 2 + 1 )
+    , m_rowInPeriod( 0 )
+    , m_year       ( 2008 )
+    , m_month      ( 1 )
+    , m_day        ( 4 )
+{
+    uint64_t rows    = bytes / TYPICAL_ROW_BYTES + 1;
+    uint64_t periods = rows / 6 + 1;
+
+    if (periods > MAX_PERIODS)
+    {
+        periods = MAX_PERIODS;
+    }
+    m_rowsPerPeriod = ( rows + periods - 1 ) / periods;
+
+    for (int fund = 0; fund < FUND_COUNT; fund++)
+    {
+        m_prices[fund] = FUNDS[fund].startPrice;
+    }
+}
+
+const char * SyntheticExport::header()
+{
+    return "VALUATION DATE,POSTING DATE,ACTIVITY TYPE,PLAN,ACCOUNT,FUND,AMOUNT,FUND NAV/PRICE,FUND UNITS\n";
+}
+
+uint32_t SyntheticExport::random()
+{
+    // 64 bit LCG, top bits out - plenty for test data, same everywhere.
+    m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)( m_state >> 33 );
+}
+
+int64_t SyntheticExport::randomIn( int64_t low
+                                 , int64_t high
+                                 )
+{
+    return low + (int64_t)( random() % (uint64_t)( high - low + 1 ) );
+}
+
+/*---------------------------------------------------------------------------*
+ nextPeriod() :
+ Two weeks on, and every price moves up to 1.5% either way.
+ *---------------------------------------------------------------------------*/
+void SyntheticExport::nextPeriod()
+{
+    static const int DAYS_IN_MONTH[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    m_day += 14;
+    for (;;)
+    {
+        bool leap = ( m_year % 4 == 0 && m_year % 100 != 0 ) || m_year % 400 == 0;
+        int  days = DAYS_IN_MONTH[m_month - 1] + ( m_month == 2 && leap ? 1 : 0 );
+
+        if (m_day <= days)
+        {
+            break;
+        }
+        m_day -= days;
+        if (++m_month > 12)
+        {
+            m_month = 1;
+            m_year++;
+        }
+    } // while past the end of the month
+
+    for (int fund = 0; fund < FUND_COUNT; fund++)
+    {
+        if (!FUNDS[fund].fixedPrice)
+        {
+            int64_t moved = m_prices[fund] + m_prices[fund] * randomIn( -150, 150 ) / 10000;
+            m_prices[fund] = moved > 100 ? moved : 100;
+        }
+    }
+}
+
+size_t SyntheticExport::nextRow( char * row )
+{
+    if (m_rowInPeriod == m_rowsPerPeriod)
+    {
+        nextPeriod();
+        m_rowInPeriod = 0;
+    }
+    m_rowInPeriod++;
+
+    unsigned     total = m_mix.beforeTax + m_mix.companyMatch + m_mix.withdrawals;
+    unsigned     pick  = random() % total;
+    const char * activity;
+    const char * account;
+    int64_t      cents;
+
+    if (pick < m_mix.beforeTax)
+    {
+        activity = "Before-Tax";
+        account  = "Before-Tax";
+        cents    = randomIn( 2500, 40000 );
+    }
+    else if (pick < m_mix.beforeTax + m_mix.companyMatch)
+    {
+        activity = "Company Match";
+        account  = "Company Match";
+        cents    = randomIn( 1250, 20000 );
+    }
+    else
+    {
+        activity = "Withdrawals";
+        account  = "Before-Tax";
+        cents    = -randomIn( 5000, 200000 );
+    }
+
+    int     fund  = (int)( random() % FUND_COUNT );
+    int64_t price = m_prices[fund];
+
+    // units = amount / price, to 6 places, rounded half away from zero.
+    int64_t magnitude = ( cents < 0 ? -cents : cents ) * 100000000LL;
+    int64_t units     = ( magnitude + price / 2 ) / price;
+    if (cents < 0)
+    {
+        units = -units;
+    }
+
+    // Prices are quoted to 4 places with the trailing zeros left off.
+    char priceText[32];
+    int  places = 4;
+    int64_t fraction = price % 10000;
+
+    while (places > 1 && fraction % 10 == 0)
+    {
+        fraction /= 10;
+        places--;
+    }
+    snprintf( priceText
+            , sizeof( priceText )
+            , "%lld.%0*lld"
+            , (long long)( price / 10000 )
+            , places
+            , (long long)fraction
+            );
+
+    uint64_t absUnits = (uint64_t)( units < 0 ? -units : units );
+    uint64_t absCents = (uint64_t)( cents < 0 ? -cents : cents );
+    int      len      = snprintf( row
+                                , SYNTHETIC_ROW_MAX
+                                , "%02d/%02d/%04d,%02d/%02d/%04d,%s," PLAN_NAME ",%s,%s,%s%llu.%02llu,%s,%s%llu.%06llu\n"
+                                , m_month, m_day, m_year
+                                , m_month, m_day, m_year
+                                , activity
+                                , account
+                                , FUNDS[fund].name
+                                , cents < 0 ? "-" : ""
+                                , (unsigned long long)( absCents / 100 )
+                                , (unsigned long long)( absCents % 100 )
+                                , priceText
+                                , units < 0 ? "-" : ""
+                                , (unsigned long long)( absUnits / 1000000 )
+                                , (unsigned long long)( absUnits % 1000000 )
+                                );
+    return (size_t)len;
+
+} // SyntheticExport::nextRow()
+
+bool writeSyntheticExport( const char      * filename
+                         , uint64_t          bytes
+                         , const ExportMix & mix
+                         , uint64_t          seed
+                         , uint64_t        * rows
+                         )
+{
+    FILE * csv = fopen( filename, "wb" );
+    if (csv == nullptr)
+    {
+        return false;
+    }
+
+    SyntheticExport   generator( mix, seed, bytes );
+    std::vector<char> block( WRITE_BLOCK_SIZE + SYNTHETIC_ROW_MAX );
+    size_t            used     = strlen( SyntheticExport::header() );
+    uint64_t          written  = 0;
+    uint64_t          rowCount = 0;
+    bool              ok       = true;
+
+    memcpy( block.data(), SyntheticExport::header(), used );
+
+    for (;;)
+    {
+        char   row[SYNTHETIC_ROW_MAX];
+        size_t len = generator.nextRow( row );
+
+        if (  rowCount > 0
+           && written + used + len > bytes
+           )
+        {
+            break;
+        }
+        memcpy( block.data() + used, row, len );
+        used += len;
+        rowCount++;
+
+        if (used >= WRITE_BLOCK_SIZE)
+        {
+            ok       = ok && fwrite( block.data(), 1, used, csv ) == used;
+            written += used;
+            used     = 0;
+        }
+    } // for each row
+
+    ok = ok && fwrite( block.data(), 1, used, csv ) == used;
+    ok = fclose( csv ) == 0 && ok;
+
+    if (rows != nullptr)
+    {
+        *rows = rowCount;
+    }
+    return ok;
+
+} // writeSyntheticExport()
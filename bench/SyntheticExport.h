@@ -0,0 +1,97 @@
+/*===========================================================================*
+ SyntheticExport.h :
+ Made up State Farm 401(k) exports, for benchmarks and golden tests.
+
+ The layout is the one documented at the bottom of QifFormat.h:
+
+     VALUATION DATE,POSTING DATE,ACTIVITY TYPE,PLAN,ACCOUNT,FUND,AMOUNT,FUND NAV/PRICE,FUND UNITS
+
+ Rows come a pay period (two weeks) at a time, oldest first, and each is a
+ Before-Tax contribution, a Company Match or a Withdrawal in proportions
+ set by an ExportMix.  Every fund's price takes a random walk from one
+ period to the next (the stable value and money market funds stay at
+ 1.0), and units are the amount at that price, rounded the way the real
+ exports round them - so price x units always agrees with the amount.
+ One fund name has a comma in it and is quoted.
+
+ Everything is integer arithmetic off one seeded generator, so a given
+ size, mix and seed gives the same bytes on every platform.
+
+ *===========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest row nextRow() can write, newline included.
+const size_t SYNTHETIC_ROW_MAX = 256;
+
+/*---------------------------------------------------------------------------*
+ ExportMix :
+ Relative weights of the three activity types.  60,30,10 means six rows
+ in ten are Before-Tax, three Company Match, one a Withdrawal.
+ *---------------------------------------------------------------------------*/
+struct ExportMix
+{
+    unsigned beforeTax;
+    unsigned companyMatch;
+    unsigned withdrawals;
+};
+
+const ExportMix DEFAULT_MIX = { 60, 30, 10 };
+
+// "60,30,10" - false if that isn't three numbers with a non-zero total.
+bool parseMix ( const char * text
+              , ExportMix  & mix
+              );
+
+// "1500", "64K", "256M", "10G" - bytes, false if it isn't a size.
+bool parseSize( const char * text
+              , uint64_t   & bytes
+              );
+
+// Write an export of at most bytes (always at least one row) to filename.
+// False if it couldn't be written; rows, if given, gets the row count.
+bool writeSyntheticExport( const char      * filename
+                         , uint64_t          bytes
+                         , const ExportMix & mix
+                         , uint64_t          seed
+                         , uint64_t        * rows = nullptr
+                         );
+
+class SyntheticExport
+{
+public:
+    // bytes is roughly how big the whole export will be; it sets how many
+    // rows go in each pay period, so that big exports don't run past the
+    // year 9999.
+    SyntheticExport( const ExportMix & mix
+                   , uint64_t          seed
+                   , uint64_t          bytes
+                   );
+
+    // The header line, newline and all.
+    static const char * header();
+
+    // Write the next row into row (SYNTHETIC_ROW_MAX bytes) and return its
+    // length.  No NUL is added.
+    size_t nextRow( char * row );
+
+private:
+    uint32_t random();
+    int64_t  randomIn( int64_t low
+                     , int64_t high
+                     );
+    void     nextPeriod();
+
+    ExportMix m_mix;
+    uint64_t  m_state;
+    uint64_t  m_rowsPerPeriod;
+    uint64_t  m_rowInPeriod;
+    int       m_year;
+    int       m_month;
+    int       m_day;
+    int64_t   m_prices[8];      // per fund, scaled by 10^4
+
+}; // class SyntheticExport
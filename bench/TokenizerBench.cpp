@@ -0,0 +1,148 @@
+/*===========================================================================*
+ TokenizerBench.cpp :
+ Microbenchmark of the CSV row splitter.  Times the old fgets()+strtok()
+ loop against CsvReader with each classifier the CPU supports, over the
+ same in-memory State Farm style export.
+
+ Build (from this directory)...
+   cl /O2 /EHsc /I..\CSVtoQIF TokenizerBench.cpp ..\CSVtoQIF\CsvReader.cpp ..\CSVtoQIF\CsvScan.cpp
+   g++ -O2 -I../CSVtoQIF TokenizerBench.cpp ../CSVtoQIF/CsvReader.cpp ../CSVtoQIF/CsvScan.cpp
+
+ Usage: TokenizerBench [MB of CSV, default 64]
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "CsvReader.h"
+
+static const char * activities[] = { "Before-Tax"
+                                   , "Company Match"
+                                   , "Nonelective Contributions"
+                                   , "Withdrawals"
+                                   };
+static const char * funds[]      = { "LifePath 2040"
+                                   , "S&P 500 Index"
+                                   , "\"Bond Fund, Intermediate\""
+                                   , "Stable Value"
+                                   };
+
+static std::string makeCsv( size_t bytes )
+{
+    std::string csv = "VALUATION DATE,POSTING DATE,ACTIVITY TYPE,PLAN,ACCOUNT,FUND,AMOUNT,FUND NAV/PRICE,FUND UNITS\n";
+    char        row[256];
+    unsigned    seed = 12345;
+
+    csv.reserve( bytes + sizeof( row ) );
+    while (csv.size() < bytes)
+    {
+        seed = seed * 1103515245 + 12345;
+        int day      = 1 + ( seed >> 8 ) % 28;
+        int activity = ( seed >> 12 ) % 4;
+        int fund     = ( seed >> 16 ) % 4;
+        int cents    = 100 + ( seed >> 4 ) % 50000;
+
+        snprintf( row
+                , sizeof( row )
+                , "05/%02d/2019,05/%02d/2019,%s,State Farm 401(k) Savings Plan,%s,%s,%s%d.%02d,21.3345,%.6f\n"
+                , day
+                , day
+                , activities[activity]
+                , activities[activity]
+                , funds[fund]
+                , activity == 3 ? "-" : ""
+                , cents / 100
+                , cents % 100
+                , cents / 2133.45
+                );
+        csv += row;
+    }
+    return csv;
+}
+
+// What main() used to do: copy a line into a 1 KB buffer, strtok it.
+static size_t strtokFields( const std::string & csv )
+{
+    char         input[1024 + 1];
+    size_t       count = 0;
+    const char * p     = csv.data();
+    const char * end   = csv.data() + csv.size();
+
+    while (p < end)
+    {
+        const char * nl  = (const char *)memchr( p, '\n', (size_t)( end - p ) );
+        size_t       len = ( nl ? nl + 1 : end ) - p;
+
+        if (len > 1023) len = 1023;
+        memcpy( input, p, len );
+        input[len] = '\0';
+        p += len;
+
+        for (char * tok = strtok( input, ",\n" ); tok != nullptr; tok = strtok( nullptr, ",\n" ))
+        {
+            count += tok[0] != '\0';
+        }
+    }
+    return count;
+}
+
+static size_t readerFields( const std::string & csv )
+{
+    CsvReader              reader( csv.data(), csv.size() );
+    std::vector<FieldView> fields;
+    size_t                 count = 0;
+
+    while (reader.nextRow( fields ))
+    {
+        count += fields.size();
+    }
+    return count;
+}
+
+template <class FN>
+static void report( const char * name, const std::string & csv, FN fn )
+{
+    const int runs = 5;
+    double    best = 1e30;
+    size_t    fields = 0;
+
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fields = fn( csv );
+        double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        if (secs < best) best = secs;
+    }
+
+    printf( "%-16s %10zu fields %8.1f MB/sec\n"
+          , name
+          , fields
+          , csv.size() / 1048576.0 / best
+          );
+}
+
+int main( int argc, char * argv[] )
+{
+    size_t      mb  = argc > 1 ? (size_t)atoi( argv[1] ) : 64;
+    std::string csv = makeCsv( mb << 20 );
+
+    printf( "%.1f MB synthetic export\n", csv.size() / 1048576.0 );
+
+    report( "strtok", csv, strtokFields );
+
+    const CsvScanIsa isas[] = { CSV_SCAN_SCALAR, CSV_SCAN_SSE2, CSV_SCAN_AVX2 };
+    for (CsvScanIsa isa : isas)
+    {
+        if (csvSetScanIsa( isa ))
+        {
+            std::string name = std::string( "CsvReader/" ) + csvScanIsaName( isa );
+            report( name.c_str(), csv, readerFields );
+        }
+    }
+    return 0;
+}
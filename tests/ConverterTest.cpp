@@ -0,0 +1,125 @@
+/*===========================================================================*
+ ConverterTest.cpp :
+ Converter::feed() has to give the same transactions however the export
+ is cut up.  Converts a small export with every awkward thing in it
+ (quoted commas and newlines, "" pairs, CR LF, blank lines, no newline at
+ the end) in one piece, then again in pieces of every size from 1 byte
+ up, and checks the QIF comes out the same as renderRows() makes of the
+ whole thing.
+
+ Exits 0 if it all matches, 1 (having said what didn't) if not.
+
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Converter.h"
+#include "QifRows.h"
+#include "QifWriter.h"
+
+static const char EXPORT_CSV[] =
+    "VALUATION DATE,POSTING DATE,ACTIVITY TYPE,PLAN,ACCOUNT,FUND,AMOUNT,FUND NAV/PRICE,FUND UNITS\r\n"
+    "05/10/2019,05/10/2019,Before-Tax,State Farm 401(k) Savings Plan,Before-Tax,LifePath 2040,125.50,21.3345,5.882492\r\n"
+    "05/10/2019,05/10/2019,Company Match,\"State Farm, 401(k)\",Company Match,LifePath 2040,\"1,062.75\",21.3345,49.814151\r\n"
+    "\r\n"
+    "05/17/2019,05/17/2019,Withdrawals,Plan,Before-Tax,\"Bond \"\"Core\"\"\nFund\",(300.00),21.5,-13.953488\n"
+    "\n"
+    "05/24/2019,05/24/2019,\"Nonelective\r\nContributions\",Plan,Plan,S&P 500 Index,$40.00,301.12,0.132837\n"
+    "05/31/2019,05/31/2019,Before-Tax,Plan,Plan,Stable Value,-12.5,1,-12.5";
+
+/*---------------------------------------------------------------------------*
+ BufferSink :
+ Writes the QIF into memory instead of a file.
+ *---------------------------------------------------------------------------*/
+class BufferSink : public TransactionSink
+{
+public:
+    void begin( const HeaderMap & ) override
+    {
+        out.line( HEADER_LINE, sizeof( HEADER_LINE ) - 1 );
+    }
+    void transaction( const Transaction & transaction ) override
+    {
+        writeTransaction( transaction, out );
+    }
+
+    QifBuffer out;
+};
+
+static std::string expected()
+{
+    size_t                 size = sizeof( EXPORT_CSV ) - 1;
+    CsvReader              reader( EXPORT_CSV, size );
+    std::vector<FieldView> fields;
+    HeaderMap              header;
+    QifBuffer              out;
+    RowChecks              checks;
+
+    reader.nextRow( fields );
+    mapHeader( fields, header );
+
+    out.line( HEADER_LINE, sizeof( HEADER_LINE ) - 1 );
+    renderRows( header, reader, out, checks );
+
+    return std::string( out.data(), out.size() );
+}
+
+// Feed the export piece bytes at a time.
+static std::string converted( size_t piece
+                            , size_t & rows
+                            )
+{
+    size_t     size = sizeof( EXPORT_CSV ) - 1;
+    BufferSink sink;
+    Converter  converter( sink );
+
+    for (size_t offset = 0; offset < size; offset += piece)
+    {
+        // A copy, so nothing can look past the end of the piece.
+        size_t            len = ( size - offset < piece ) ? size - offset : piece;
+        std::vector<char> copy( EXPORT_CSV + offset, EXPORT_CSV + offset + len );
+
+        converter.feed( copy.data(), copy.size() );
+    }
+    converter.finish();
+
+    rows = converter.rows();
+    return std::string( sink.out.data(), sink.out.size() );
+}
+
+int main()
+{
+    std::string want     = expected();
+    int         failures = 0;
+    size_t      rows     = 0;
+
+    if (converted( sizeof( EXPORT_CSV ), rows ) != want)
+    {
+        printf( "FAILED: one piece\n%s\n", converted( sizeof( EXPORT_CSV ), rows ).c_str() );
+        failures++;
+    }
+    if (rows != 5)
+    {
+        printf( "FAILED: %zu rows, expected 5\n", rows );
+        failures++;
+    }
+
+    for (size_t piece = 1; piece < sizeof( EXPORT_CSV ); piece++)
+    {
+        if (converted( piece, rows ) != want)
+        {
+            printf( "FAILED: %zu byte pieces\n", piece );
+            failures++;
+        }
+    } // for each piece size
+
+    if (failures == 0)
+    {
+        printf( "Converter: same QIF from pieces of 1 to %zu bytes\n", sizeof( EXPORT_CSV ) - 1 );
+    }
+    return failures == 0 ? 0 : 1;
+
+} // main()
@@ -0,0 +1,368 @@
+#
+# RunGolden.cmake : one golden test, run by ctest as
+#
+#   cmake -DCSVTOQIF=<csvtoqif> -DWORK=<scratch dir> -DNAME=<name>
+#         [-DCSV=<export.csv> -DGOLDEN=<expected.qif>]
+#         [-DEXPORTGEN=<ExportGen> -DSIZE=8M -DMIX=60,30,10 -DSEED=3 -DSHA256=<hash>]
+#         [-DJOBS=N] [-DRULES=<rule file>] [-DCACHE=ON] [-DOFX=<expected.ofx>]
+#         [-DSORT=<MB>] [-DAGGREGATE=ON] [-DGZIP=ON] [-DSECURITIES=ON]
+#         [-DTRUNCATE=<head>] [-DBATCH=ON] [-DDEDUP=<another export.csv>]
+#         [-DINCREMENTAL=ON]
+#         -P RunGolden.cmake
+#
+# Converts a copy of CSV (or an export ExportGen makes on the spot) in WORK
+# and compares the QIF with GOLDEN (or its SHA256 with SHA256).  Line ends
+# are compared as \n, so the same goldens do for Windows and everywhere else.
+#
+# With CACHE the CSV is converted to a column cache as well, and it's the
+# QIF converted from the cache that's compared.  With OFX the OFX file is
+# written too, and compared with OFX.  With SORT the rows are sorted (see
+# SortSink.h) in SORT MB of memory, so a small SORT sorts on disk.  With
+# AGGREGATE they're merged by day, fund and action (see AggregateSink.h).
+# With GZIP the CSV is gzipped and piped through csvtoqif -, QIF to stdout.
+# With SECURITIES the security list and prices go at the end of the QIF.
+# With TRUNCATE (head, which can cut a file short where CMake can't) the
+# gzipped CSV loses its second half and is converted by name: that has to
+# fail, and leave no QIF file behind.  With BATCH the gzipped CSV is put
+# in a directory of its own and the directory is converted, which has to
+# find it - and turn down the .csv.zst next to it, which would be written
+# to the same QIF file.
+#
+# With DEDUP the CSV is converted with a dedup index (-d), which has to
+# end up with a key per transaction written; converted again, it has to
+# come out with none.  Then DEDUP, another export, has to add its own
+# transactions to the count, and none the second time round.  Each time
+# the index's count has to match the slots it has filled - with a stale
+# .tmp, as a run that died would leave, lying next to it.  Last, the CSV
+# and a copy of it are converted in one run, and the copy has to come out
+# with none.
+#
+# With INCREMENTAL the CSV is converted with -i as it would be while the
+# export was still being written: first up to a dozen bytes into a row
+# halfway through, which has to wait, then the whole of it, which has to
+# carry on from there, so the two QIF files together are GOLDEN.  Then
+# again with nothing new, again with the first row changed, and again
+# with the two date columns swapped round, each of which has to say why
+# it did what it did.
+#
+# If a change is meant to change the output, run ctest with
+# CSVTOQIF_UPDATE_GOLDEN=1 in the environment to write the new goldens
+# (hashes are printed instead), and look over the diff before committing.
+#
+file(MAKE_DIRECTORY ${WORK})
+set(csv ${WORK}/${NAME}.csv)
+set(qif ${WORK}/${NAME}.qif)
+set(index ${WORK}/${NAME}.dedup)
+set(ofx ${WORK}/${NAME}.ofx)
+set(cache ${WORK}/${NAME}.txcache)
+file(REMOVE ${qif} ${qif}.state ${ofx} ${cache} ${csv}.gz ${index} ${index}.tmp)
+
+# The count in the dedup index's header - a little endian uint64 at 16 -
+# which has to be how many of the slots after the 32 byte header are used.
+macro(dedup_count var)
+    file(READ ${index} bytes HEX OFFSET 16 LIMIT 8)
+    string(REGEX MATCHALL ".." bytes "${bytes}")
+    list(REVERSE bytes)
+    string(JOIN "" bytes ${bytes})
+    math(EXPR ${var} "0x${bytes}")
+
+    file(READ ${index} slots HEX OFFSET 32)
+    string(REGEX MATCHALL "................" slots "${slots}")
+    list(FILTER slots EXCLUDE REGEX "^0+$")
+    list(LENGTH slots used)
+    if(NOT used EQUAL ${var})
+        message(FATAL_ERROR "${index} says it has ${${var}} keys but ${used} slots are used")
+    endif()
+endmacro()
+
+# What a run that died after writing the new index would leave.
+macro(stale_dedup_tmp)
+    string(REPEAT "stale slots " 8 stale)
+    file(WRITE ${index}.tmp "${stale}")
+endmacro()
+
+# Transactions in a QIF file.
+macro(transaction_count file var)
+    file(STRINGS ${file} ends REGEX "^\\^")
+    list(LENGTH ends ${var})
+endmacro()
+
+# Convert the CSV with -i, which has to say expect; var gets the QIF.
+macro(convert_incremental expect var)
+    execute_process(COMMAND ${CSVTOQIF} ${args} -i ${csv}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE  output)
+    if(NOT result EQUAL 0 OR NOT EXISTS ${qif})
+        message(FATAL_ERROR "csvtoqif ${args} -i ${csv} failed: ${result}\n${output}")
+    endif()
+    string(FIND "${output}" "${expect}" found)
+    if(found LESS 0)
+        message(FATAL_ERROR "csvtoqif ${args} -i ${csv} didn't say \"${expect}\"\n${output}")
+    endif()
+    file(READ ${qif} ${var})
+    string(REPLACE "\r\n" "\n" ${var} "${${var}}")
+endmacro()
+
+# Convert export with args; var gets the transactions written.
+macro(convert_counting export var)
+    execute_process(COMMAND ${CSVTOQIF} ${args} ${export}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE  output)
+    string(REGEX REPLACE "\\.csv$" ".qif" written ${export})
+    if(NOT result EQUAL 0 OR NOT EXISTS ${written})
+        message(FATAL_ERROR "csvtoqif ${args} ${export} failed: ${result}\n${output}")
+    endif()
+    transaction_count(${written} ${var})
+endmacro()
+
+if(DEFINED SIZE)
+    execute_process(COMMAND ${EXPORTGEN} ${SIZE} ${csv} --mix ${MIX} --seed ${SEED}
+                    RESULT_VARIABLE result
+                    OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "ExportGen ${SIZE} failed: ${result}")
+    endif()
+else()
+    configure_file(${CSV} ${csv} COPYONLY)
+endif()
+
+set(args)
+if(DEFINED JOBS)
+    list(APPEND args -j ${JOBS})
+endif()
+if(DEFINED RULES)
+    list(APPEND args -r ${RULES})
+endif()
+if(DEFINED OFX)
+    list(APPEND args --ofx)
+endif()
+if(CACHE)
+    list(APPEND args --cache)
+endif()
+if(DEFINED SORT)
+    list(APPEND args --sort-memory ${SORT})
+endif()
+if(AGGREGATE)
+    list(APPEND args --aggregate)
+endif()
+if(SECURITIES)
+    list(APPEND args --securities)
+endif()
+if(DEFINED DEDUP)
+    list(APPEND args -d ${index})
+    stale_dedup_tmp()
+endif()
+
+if(DEFINED TRUNCATE)
+    file(ARCHIVE_CREATE OUTPUT ${csv}.full.gz PATHS ${csv} FORMAT raw COMPRESSION GZip)
+    file(SIZE ${csv}.full.gz size)
+    math(EXPR half "${size} / 2")
+    execute_process(COMMAND ${TRUNCATE} -c ${half} ${csv}.full.gz
+                    OUTPUT_FILE ${csv}.gz)
+    file(REMOVE ${csv}.full.gz)
+    execute_process(COMMAND ${CSVTOQIF} ${args} ${csv}.gz
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE  output)
+    if(result EQUAL 0)
+        message(FATAL_ERROR "csvtoqif ${args} ${csv}.gz didn't fail\n${output}")
+    endif()
+    file(GLOB temporaries ${qif}.*.tmp)
+    if(EXISTS ${qif} OR temporaries)
+        message(FATAL_ERROR "csvtoqif ${args} ${csv}.gz failed, but left ${qif} behind\n${output}")
+    endif()
+    file(REMOVE ${csv} ${csv}.gz)
+    return()
+endif()
+
+if(INCREMENTAL)
+    file(READ ${GOLDEN} expected)
+    string(REPLACE "\r\n" "\n" expected "${expected}")
+    transaction_count(${GOLDEN} all)
+
+    file(READ ${csv} whole)
+    string(LENGTH "${whole}" size)
+    math(EXPR half "${size} / 2")
+    string(SUBSTRING "${whole}" ${half} -1 rest)
+    string(FIND "${rest}" "\n" newline)
+    math(EXPR cut "${half} + ${newline} + 1 + 12")
+    string(SUBSTRING "${whole}" 0 ${cut} partial)
+    file(WRITE ${csv} "${partial}")
+    convert_incremental("left 12 bytes of an unfinished last row" first)
+
+    file(WRITE ${csv} "${whole}")
+    convert_incremental("Incremental: " second)
+    string(FIND "${second}" "\n" newline)
+    math(EXPR newline "${newline} + 1")
+    string(SUBSTRING "${second}" ${newline} -1 second)
+    if(NOT "${first}${second}" STREQUAL expected)
+        message(FATAL_ERROR "${qif} from the export in two goes doesn't match ${GOLDEN}\n${output}")
+    endif()
+
+    convert_incremental("Incremental: 0 new bytes" nothing)
+    transaction_count(${qif} count)
+    if(NOT count EQUAL 0)
+        message(FATAL_ERROR "Nothing new, but ${qif} has ${count} transactions\n${output}")
+    endif()
+
+    # The same length, so only the check on the rows can notice.
+    string(FIND "${whole}" "\n" header)
+    math(EXPR row "${header} + 1")
+    math(EXPR after "${row} + 1")
+    string(SUBSTRING "${whole}" 0 ${row} before)
+    string(SUBSTRING "${whole}" ${after} -1 rest)
+    file(WRITE ${csv} "${before}9${rest}")
+    convert_incremental("Full rebuild: rows converted last time have changed" changed)
+    transaction_count(${qif} count)
+    if(NOT count EQUAL all)
+        message(FATAL_ERROR "A full rebuild wrote ${count} of ${all} transactions\n${output}")
+    endif()
+
+    string(REPLACE "VALUATION DATE,POSTING DATE" "POSTING DATE,VALUATION DATE" swapped "${before}9${rest}")
+    file(WRITE ${csv} "${swapped}")
+    convert_incremental("Full rebuild: the columns have changed" swapped)
+    transaction_count(${qif} count)
+    if(NOT count EQUAL all)
+        message(FATAL_ERROR "A full rebuild wrote ${count} of ${all} transactions\n${output}")
+    endif()
+
+    file(REMOVE ${csv} ${qif} ${qif}.state)
+    return()
+endif()
+
+if(BATCH)
+    set(dir ${WORK}/${NAME}.d)
+    file(REMOVE_RECURSE ${dir})
+    file(MAKE_DIRECTORY ${dir})
+    file(ARCHIVE_CREATE OUTPUT ${dir}/${NAME}.csv.gz PATHS ${csv} FORMAT raw COMPRESSION GZip)
+    file(WRITE ${dir}/${NAME}.csv.zst "not converted")
+    set(qif ${dir}/${NAME}.qif)
+    execute_process(COMMAND ${CSVTOQIF} -j 2 ${args} ${dir}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE  output)
+    string(FIND "${output}" "Not converting...\n${dir}/${NAME}.csv.zst\n" clash)
+    if(result EQUAL 0 OR clash LESS 0)
+        message(FATAL_ERROR "csvtoqif ${args} ${dir} didn't turn down ${NAME}.csv.zst, which would overwrite ${qif}\n${output}")
+    endif()
+    set(result 0)
+elseif(GZIP)
+    file(ARCHIVE_CREATE OUTPUT ${csv}.gz PATHS ${csv} FORMAT raw COMPRESSION GZip)
+    execute_process(COMMAND ${CSVTOQIF} ${args} -
+                    INPUT_FILE      ${csv}.gz
+                    OUTPUT_FILE     ${qif}
+                    RESULT_VARIABLE result
+                    ERROR_VARIABLE  output)
+else()
+    execute_process(COMMAND ${CSVTOQIF} ${args} ${csv}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE  output)
+endif()
+if(NOT result EQUAL 0 OR NOT EXISTS ${qif})
+    message(FATAL_ERROR "csvtoqif ${args} ${csv} failed: ${result}\n${output}")
+endif()
+
+if(CACHE)
+    file(REMOVE ${qif})
+    execute_process(COMMAND ${CSVTOQIF} ${cache}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE  output)
+    if(NOT result EQUAL 0 OR NOT EXISTS ${qif})
+        message(FATAL_ERROR "csvtoqif ${cache} failed: ${result}\n${output}")
+    endif()
+endif()
+
+if(DEFINED OFX)
+    file(READ ${ofx} actual)
+    string(REPLACE "\r\n" "\n" actual "${actual}")
+    if(DEFINED ENV{CSVTOQIF_UPDATE_GOLDEN})
+        file(WRITE ${OFX} "${actual}")
+    endif()
+    file(READ ${OFX} expected)
+    string(REPLACE "\r\n" "\n" expected "${expected}")
+    if(NOT actual STREQUAL expected)
+        message(FATAL_ERROR "${ofx} doesn't match ${OFX}")
+    endif()
+endif()
+
+file(READ ${qif} actual)
+string(REPLACE "\r\n" "\n" actual "${actual}")
+
+if(DEFINED SHA256)
+    string(SHA256 hash "${actual}")
+    if(DEFINED ENV{CSVTOQIF_UPDATE_GOLDEN})
+        message(STATUS "${NAME}: SHA256 ${hash}")
+    elseif(NOT hash STREQUAL SHA256)
+        message(FATAL_ERROR "${qif} has changed\n  SHA256 ${hash}\n  expected ${SHA256}")
+    endif()
+else()
+    if(DEFINED ENV{CSVTOQIF_UPDATE_GOLDEN})
+        file(WRITE ${GOLDEN} "${actual}")
+    endif()
+    file(READ ${GOLDEN} expected)
+    string(REPLACE "\r\n" "\n" expected "${expected}")
+    if(NOT actual STREQUAL expected)
+        message(FATAL_ERROR "${qif} doesn't match ${GOLDEN}")
+    endif()
+endif()
+
+if(DEFINED DEDUP)
+    transaction_count(${qif} first)
+    dedup_count(keys)
+    if(NOT keys EQUAL first)
+        message(FATAL_ERROR "${index} has ${keys} keys after ${first} transactions")
+    endif()
+
+    convert_counting(${csv} again)
+    dedup_count(keys)
+    if(NOT again EQUAL 0 OR NOT keys EQUAL first)
+        message(FATAL_ERROR "Converting ${csv} again wrote ${again} transactions; ${index} has ${keys} keys\n${output}")
+    endif()
+
+    set(more ${WORK}/${NAME}-more.csv)
+    configure_file(${DEDUP} ${more} COPYONLY)
+    stale_dedup_tmp()
+
+    convert_counting(${more} added)
+    dedup_count(keys)
+    math(EXPR expected "${first} + ${added}")
+    if(added EQUAL 0 OR NOT keys EQUAL expected)
+        message(FATAL_ERROR "${DEDUP} wrote ${added} transactions; ${index} has ${keys} keys, not ${expected}\n${output}")
+    endif()
+
+    convert_counting(${more} again)
+    dedup_count(keys)
+    if(NOT again EQUAL 0 OR NOT keys EQUAL expected)
+        message(FATAL_ERROR "Converting ${DEDUP} again wrote ${again} transactions; ${index} has ${keys} keys\n${output}")
+    endif()
+
+    # Both in one run, with a fresh index: the second has nothing left to
+    # write, however many threads there are.
+    file(REMOVE ${index})
+    configure_file(${CSV} ${more} COPYONLY)
+    execute_process(COMMAND ${CSVTOQIF} ${args} -j 2 ${csv} ${more}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE  output)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "csvtoqif ${args} -j 2 ${csv} ${more} failed: ${result}\n${output}")
+    endif()
+    string(REGEX REPLACE "\\.csv$" ".qif" moreQif ${more})
+    transaction_count(${qif} together)
+    transaction_count(${moreQif} again)
+    dedup_count(keys)
+    if(NOT together EQUAL first OR NOT again EQUAL 0 OR NOT keys EQUAL first)
+        message(FATAL_ERROR "The same export twice in one run wrote ${together} then ${again} transactions; ${index} has ${keys} keys\n${output}")
+    endif()
+
+    file(REMOVE ${more} ${moreQif} ${index} ${index}.tmp)
+endif()
+
+file(REMOVE ${csv} ${csv}.gz ${qif} ${qif}.state ${ofx} ${cache})
+if(BATCH)
+    file(REMOVE_RECURSE ${dir})
+endif()